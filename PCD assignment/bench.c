@@ -0,0 +1,531 @@
+// Benchmark harness for the compiler front end and code generator.
+//
+// Each benchmark is warmed up, calibrated so one sample lasts at least
+// --min-sample-ms, then sampled --samples times. Results are written to
+// stdout as JSON (per-operation nanoseconds: median, p90, p99, min, max,
+// mean); progress goes to stderr.
+//
+// Build: ./build_bench.sh    Run: ./bench [options] > results.json
+#define _POSIX_C_SOURCE 200809L
+
+#include "compiler.h"
+#include "codegen.h"
+#include <time.h>
+
+typedef struct {
+    const char* name;
+    bool (*setup)();                  // false skips the benchmark
+    long (*run)(long iterations);     // returns work units processed
+    const char* unit;
+} Benchmark;
+
+typedef struct {
+    int samples;
+    int warmup;
+    double min_sample_ms;
+    int terms;
+    long lex_bytes;
+    const char* filter;
+    const char* synthetic;      // "ll1" or "lalr1", NULL for sample grammar 3
+    int non_terminals;
+    int productions;
+    uint64_t seed;
+} BenchOptions;
+
+static BenchOptions options = { 30, 5, 2.0, 24, 1 << 20, NULL, NULL, 20, 50, 1 };
+
+// Shared workload
+static Grammar grammar;
+static FirstFollowSet first_sets[MAX_SYMBOLS];
+static FirstFollowSet follow_sets[MAX_SYMBOLS];
+static char* lex_input = NULL;
+static TokenSpanList lex_spans;
+static char* parse_input = NULL;
+static ParseTree tree;
+static char* statement_input = NULL;
+static OutputBuffer statement_output;
+static TACProgram eval_program;
+static JitCode eval_jit;
+static int64_t* eval_columns[MAX_SYMBOLS];
+static int64_t* eval_out = NULL;
+
+// Keeps results observable so the optimizer cannot drop the work
+static volatile long sink;
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Expression with `terms` operands mixing +, * and parentheses, e.g.
+// "a0 + a1 * (a2 + a3) * a4 + ..."
+static char* make_expression(int terms) {
+    size_t cap = (size_t)terms * 16 + 16;
+    char* text = malloc(cap);
+    if (text == NULL) return NULL;
+    
+    size_t len = 0;
+    bool open = false;
+    for (int i = 0; i < terms; i++) {
+        if (i > 0) len += (size_t)snprintf(text + len, cap - len, i % 3 ? " + " : " * ");
+        if (!open && i % 5 == 1 && i + 1 < terms) {
+            len += (size_t)snprintf(text + len, cap - len, "(");
+            open = true;
+        }
+        len += (size_t)snprintf(text + len, cap - len, "a%d", i % 26);
+        if (open && i % 5 == 2) {
+            len += (size_t)snprintf(text + len, cap - len, ")");
+            open = false;
+        }
+    }
+    if (open) len += (size_t)snprintf(text + len, cap - len, ")");
+    return text;
+}
+
+// Lexer input of roughly `bytes` bytes built from repeated expression lines
+static char* make_lex_input(long bytes) {
+    char* line = make_expression(32);
+    if (line == NULL) return NULL;
+    size_t line_len = strlen(line);
+    
+    char* text = malloc((size_t)bytes + line_len + 2);
+    if (text == NULL) {
+        free(line);
+        return NULL;
+    }
+    size_t len = 0;
+    while (len < (size_t)bytes) {
+        memcpy(text + len, line, line_len);
+        len += line_len;
+        text[len++] = '\n';
+    }
+    text[len] = '\0';
+    free(line);
+    return text;
+}
+
+// Generated grammar and one of its sentences as the parse input
+static char* make_synthetic_input() {
+    GrammarGenOptions opt;
+    grammar_gen_defaults(&opt);
+    opt.shape = strcmp(options.synthetic, "lalr1") == 0 ? GRAMMAR_SHAPE_LALR1 : GRAMMAR_SHAPE_LL1;
+    opt.non_terminals = options.non_terminals;
+    opt.productions = options.productions;
+    opt.seed = options.seed;
+    if (!generate_grammar(&grammar, &opt)) return NULL;
+    
+    OutputBuffer sentence;
+    outbuf_init(&sentence);
+    uint64_t seed = options.seed;
+    char* text = NULL;
+    if (generate_sentence(&grammar, options.terms, 64, &seed, &sentence) >= 0) {
+        text = malloc(sentence.len + 1);
+        if (text) memcpy(text, outbuf_cstr(&sentence), sentence.len + 1);
+    }
+    outbuf_free(&sentence);
+    return text;
+}
+
+static long run_lexer(long iterations) {
+    long tokens = 0;
+    for (long i = 0; i < iterations; i++) {
+        init_lexer(lex_input);
+        while (get_next_token().type != TOKEN_EOF) tokens++;
+    }
+    sink = tokens;
+    return tokens;
+}
+
+// The same input lexed whole, in chunks on one thread per CPU
+static long run_lexer_parallel(long iterations) {
+    long tokens = 0;
+    for (long i = 0; i < iterations; i++) {
+        if (lex_all_tokens(lex_input, 0, &lex_spans)) tokens += (long)lex_spans.count - 1;
+    }
+    sink = tokens;
+    return tokens;
+}
+
+static long run_first_sets(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        compute_first_sets(&grammar, first_sets);
+    }
+    sink = first_sets[0].first_count;
+    return iterations;
+}
+
+static long run_follow_sets(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        compute_follow_sets(&grammar, first_sets, follow_sets);
+    }
+    sink = follow_sets[0].follow_count;
+    return iterations;
+}
+
+static long run_ll_table(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        init_ll_parser(&grammar);
+        build_ll_table(&grammar, first_sets, follow_sets);
+    }
+    sink = get_ll_table_size();
+    return iterations;
+}
+
+static long run_lr_table(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        init_lr_parser(&grammar);
+        sink = construct_lr_table();
+    }
+    return iterations;
+}
+
+// Start-up and the first parse, with the whole table and with the states
+// the parse enters only
+static long run_first_parse_lr(long iterations) {
+    long accepted = 0;
+    for (long i = 0; i < iterations; i++) {
+        init_lr_parser(&grammar);
+        accepted += parse_lr(parse_input);
+    }
+    sink = accepted;
+    return iterations;
+}
+
+static long run_first_parse_lr_lazy(long iterations) {
+    set_lr_lazy_construction(true);
+    run_first_parse_lr(iterations);
+    set_lr_lazy_construction(false);
+    return iterations;
+}
+
+static bool setup_ll() {
+    compute_first_sets(&grammar, first_sets);
+    compute_follow_sets(&grammar, first_sets, follow_sets);
+    init_ll_parser(&grammar);
+    build_ll_table(&grammar, first_sets, follow_sets);
+    return true;
+}
+
+static bool setup_lr() {
+    set_lr_table_compression(false);
+    init_lr_parser(&grammar);
+    return construct_lr_table();
+}
+
+static bool setup_parse_ll() {
+    setup_ll();
+    return parse_ll(parse_input);
+}
+
+static bool setup_parse_lr() {
+    return setup_lr() && parse_lr(parse_input);
+}
+
+static bool setup_parse_lr_compact() {
+    set_lr_table_compression(true);
+    init_lr_parser(&grammar);
+    return construct_lr_table() && parse_lr(parse_input);
+}
+
+static long run_parse_ll(long iterations) {
+    long accepted = 0;
+    for (long i = 0; i < iterations; i++) {
+        accepted += parse_ll(parse_input);
+    }
+    sink = accepted;
+    return iterations;
+}
+
+static long run_parse_lr(long iterations) {
+    long accepted = 0;
+    for (long i = 0; i < iterations; i++) {
+        accepted += parse_lr(parse_input);
+    }
+    sink = accepted;
+    return iterations;
+}
+
+static bool setup_parse_pratt() {
+    return build_pratt_table(&grammar) && parse_pratt(parse_input);
+}
+
+static long run_parse_pratt(long iterations) {
+    long accepted = 0;
+    for (long i = 0; i < iterations; i++) {
+        accepted += parse_pratt(parse_input);
+    }
+    sink = accepted;
+    return iterations;
+}
+
+static bool setup_codegen() {
+    return setup_lr() && parse_lr_tree(parse_input, &tree, NULL) && generate_code_from_tree(&tree);
+}
+
+#define BENCH_STATEMENTS 1024
+
+// BENCH_STATEMENTS assignments of the parse input, one per line
+static bool setup_statements() {
+    if (statement_input == NULL) {
+        size_t line_len = strlen(parse_input) + 16;
+        statement_input = malloc(line_len * BENCH_STATEMENTS + 1);
+        if (statement_input == NULL) return false;
+        size_t len = 0;
+        for (int i = 0; i < BENCH_STATEMENTS; i++) {
+            len += (size_t)snprintf(statement_input + len, line_len + 1, "s%d = %s;\n", i, parse_input);
+        }
+    }
+    outbuf_reset(&statement_output);
+    return setup_lr() &&
+           compile_statements(NULL, statement_input, COMPILE_TAC, COMPILE_TRACE_NONE, 0, &statement_output) == COMPILE_OK;
+}
+
+// The statements parsed and compiled to TAC on one thread per CPU
+static long run_compile_statements(long iterations) {
+    long bytes = 0;
+    for (long i = 0; i < iterations; i++) {
+        outbuf_reset(&statement_output);
+        compile_statements(NULL, statement_input, COMPILE_TAC, COMPILE_TRACE_NONE, 0, &statement_output);
+        bytes += (long)statement_output.len;
+    }
+    sink = bytes;
+    return iterations * BENCH_STATEMENTS;
+}
+
+static long run_generate_assembly(long iterations) {
+    long bytes = 0;
+    for (long i = 0; i < iterations; i++) {
+        bytes += (long)strlen(generate_assembly());
+    }
+    sink = bytes;
+    return iterations;
+}
+
+#define BENCH_ROWS 65536
+
+// The parse input's TAC over BENCH_ROWS rows of seeded operands. The batch
+// evaluator's results must match the JIT's row by row; the expression has
+// no division, where the two differ (the batch yields 0, the JIT traps).
+static bool setup_eval() {
+    if (eval_out != NULL) return true;
+    if (!setup_codegen() || !lower_tac(&eval_program) || !jit_compile(&eval_program, &eval_jit)) return false;
+    
+    uint64_t seed = options.seed;
+    for (int v = 0; v < eval_program.var_count; v++) {
+        eval_columns[v] = malloc(BENCH_ROWS * sizeof(int64_t));
+        if (eval_columns[v] == NULL) return false;
+        for (size_t r = 0; r < BENCH_ROWS; r++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            eval_columns[v][r] = (int64_t)(seed >> 40) - (1 << 23);
+        }
+    }
+    eval_out = malloc(BENCH_ROWS * sizeof(int64_t));
+    if (eval_out == NULL || !eval_tac_batch(&eval_program, eval_columns, eval_out, BENCH_ROWS)) return false;
+    
+    int64_t vars[MAX_SYMBOLS];
+    for (size_t r = 0; r < BENCH_ROWS; r++) {
+        for (int v = 0; v < eval_program.var_count; v++) vars[v] = eval_columns[v][r];
+        if (eval_jit.function(vars) != eval_out[r]) {
+            fprintf(stderr, "eval: batch and JIT results differ at row %zu\n", r);
+            return false;
+        }
+    }
+    return true;
+}
+
+static long run_eval_batch(long iterations) {
+    for (long i = 0; i < iterations; i++) {
+        eval_tac_batch(&eval_program, eval_columns, eval_out, BENCH_ROWS);
+    }
+    sink = (long)eval_out[0];
+    return iterations * BENCH_ROWS;
+}
+
+// The same rows through the JIT-compiled function, one call per row
+static long run_eval_jit(long iterations) {
+    int64_t vars[MAX_SYMBOLS];
+    int64_t sum = 0;
+    for (long i = 0; i < iterations; i++) {
+        for (size_t r = 0; r < BENCH_ROWS; r++) {
+            for (int v = 0; v < eval_program.var_count; v++) vars[v] = eval_columns[v][r];
+            sum += eval_jit.function(vars);
+        }
+    }
+    sink = (long)sum;
+    return iterations * BENCH_ROWS;
+}
+
+static const Benchmark benchmarks[] = {
+    { "lexer",             NULL,          run_lexer,             "token" },
+    { "lexer_parallel",    NULL,          run_lexer_parallel,    "token" },
+    { "first_sets",        NULL,          run_first_sets,        "call" },
+    { "follow_sets",       setup_ll,      run_follow_sets,       "call" },
+    { "ll_table",          setup_ll,      run_ll_table,          "call" },
+    { "lr_table",          NULL,          run_lr_table,          "call" },
+    { "first_parse_lr",    NULL,          run_first_parse_lr,    "call" },
+    { "first_parse_lr_lazy", NULL,        run_first_parse_lr_lazy, "call" },
+    { "parse_ll",          setup_parse_ll, run_parse_ll,         "parse" },
+    { "parse_lr",          setup_parse_lr, run_parse_lr,         "parse" },
+    { "parse_lr_compact",  setup_parse_lr_compact, run_parse_lr, "parse" },
+    { "parse_pratt",       setup_parse_pratt, run_parse_pratt,   "parse" },
+    { "generate_assembly", setup_codegen, run_generate_assembly, "call" },
+    { "compile_statements", setup_statements, run_compile_statements, "statement" },
+    { "eval_batch",        setup_eval,    run_eval_batch,        "row" },
+    { "eval_jit",          setup_eval,    run_eval_jit,          "row" },
+};
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double* sorted, int count, double p) {
+    int rank = (int)(p / 100.0 * count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+// Double the iteration count until one sample reaches the minimum duration
+static long calibrate(const Benchmark* b) {
+    long iterations = 1;
+    while (iterations < (1L << 30)) {
+        double start = now_ns();
+        b->run(iterations);
+        if (now_ns() - start >= options.min_sample_ms * 1e6) break;
+        iterations *= 2;
+    }
+    return iterations;
+}
+
+static bool run_benchmark(const Benchmark* b, bool first) {
+    if (b->setup && !b->setup()) {
+        fprintf(stderr, "%-18s skipped (not supported for this grammar and input)\n", b->name);
+        return false;
+    }
+    
+    long iterations = calibrate(b);
+    for (int i = 0; i < options.warmup; i++) {
+        b->run(iterations);
+    }
+    
+    double* per_unit = malloc((size_t)options.samples * sizeof(double));
+    if (per_unit == NULL) return false;
+    
+    double total = 0;
+    long units = 0;
+    for (int i = 0; i < options.samples; i++) {
+        double start = now_ns();
+        units = b->run(iterations);
+        double elapsed = now_ns() - start;
+        per_unit[i] = elapsed / (double)(units > 0 ? units : 1);
+        total += per_unit[i];
+    }
+    qsort(per_unit, (size_t)options.samples, sizeof(double), compare_doubles);
+    
+    double median = percentile(per_unit, options.samples, 50);
+    fprintf(stderr, "%-18s %12.1f ns/%s (p90 %.1f, %ld iterations/sample)\n",
+            b->name, median, b->unit, percentile(per_unit, options.samples, 90), iterations);
+    
+    printf("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %ld, \"units_per_sample\": %ld, "
+           "\"ns_per_unit\": {\"median\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"min\": %.3f, \"max\": %.3f, \"mean\": %.3f}}",
+           first ? "" : ",", b->name, b->unit, iterations, units,
+           median, percentile(per_unit, options.samples, 90), percentile(per_unit, options.samples, 99),
+           per_unit[0], per_unit[options.samples - 1], total / options.samples);
+    free(per_unit);
+    return true;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --samples N         timed samples per benchmark (default 30)\n"
+            "  --warmup N          untimed warm-up samples (default 5)\n"
+            "  --min-sample-ms X   minimum duration of one sample (default 2)\n"
+            "  --terms N           operands in the parsed expression, or tokens in the\n"
+            "                      synthetic sentence (default 24)\n"
+            "  --lex-bytes N       size of the lexer input (default 1048576)\n"
+            "  --filter NAME       run only benchmarks whose name contains NAME\n"
+            "  --synthetic SHAPE   use a generated ll1 or lalr1 grammar instead of grammar 3\n"
+            "  --non-terminals N   synthetic grammar size (default 20)\n"
+            "  --productions N     synthetic grammar productions (default 50)\n"
+            "  --seed N            synthetic grammar and sentence seed (default 1)\n",
+            program);
+}
+
+static bool parse_options(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        if (value == NULL) return false;
+        if (strcmp(arg, "--samples") == 0) options.samples = atoi(value);
+        else if (strcmp(arg, "--warmup") == 0) options.warmup = atoi(value);
+        else if (strcmp(arg, "--min-sample-ms") == 0) options.min_sample_ms = atof(value);
+        else if (strcmp(arg, "--terms") == 0) options.terms = atoi(value);
+        else if (strcmp(arg, "--lex-bytes") == 0) options.lex_bytes = atol(value);
+        else if (strcmp(arg, "--filter") == 0) options.filter = value;
+        else if (strcmp(arg, "--synthetic") == 0) options.synthetic = value;
+        else if (strcmp(arg, "--non-terminals") == 0) options.non_terminals = atoi(value);
+        else if (strcmp(arg, "--productions") == 0) options.productions = atoi(value);
+        else if (strcmp(arg, "--seed") == 0) options.seed = strtoull(value, NULL, 10);
+        else return false;
+        i++;
+    }
+    if (options.synthetic && strcmp(options.synthetic, "ll1") != 0 && strcmp(options.synthetic, "lalr1") != 0) {
+        return false;
+    }
+    return options.samples > 0 && options.warmup >= 0 && options.terms > 0 && options.lex_bytes > 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (!parse_options(argc, argv)) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    parse_tree_init(&tree);
+    span_list_init(&lex_spans);
+    outbuf_init(&statement_output);
+    lex_input = make_lex_input(options.lex_bytes);
+    if (options.synthetic) {
+        parse_input = make_synthetic_input();
+    } else {
+        // Grammar 3 is LL(1) and SLR(1), so every stage accepts the same input
+        load_sample_grammar(&grammar, 3);
+        parse_input = make_expression(options.terms);
+    }
+    if (lex_input == NULL || parse_input == NULL) {
+        fprintf(stderr, "bench: out of memory\n");
+        return 1;
+    }
+    
+    printf("{\n  \"config\": {\"samples\": %d, \"warmup\": %d, \"min_sample_ms\": %.3f, "
+           "\"terms\": %d, \"lex_bytes\": %zu, \"grammar\": \"%s\", \"non_terminals\": %d, "
+           "\"productions\": %d, \"seed\": %llu},\n  \"benchmarks\": [",
+           options.samples, options.warmup, options.min_sample_ms, options.terms, strlen(lex_input),
+           options.synthetic ? options.synthetic : "sample-3", grammar.non_terminal_count,
+           grammar.prod_count, (unsigned long long)options.seed);
+    
+    bool first = true;
+    int count = (int)(sizeof(benchmarks) / sizeof(benchmarks[0]));
+    for (int i = 0; i < count; i++) {
+        if (options.filter && strstr(benchmarks[i].name, options.filter) == NULL) continue;
+        if (run_benchmark(&benchmarks[i], first)) first = false;
+    }
+    printf("\n  ]\n}\n");
+    
+    parse_tree_free(&tree);
+    span_list_free(&lex_spans);
+    outbuf_free(&statement_output);
+    free(statement_input);
+    for (int v = 0; v < eval_program.var_count; v++) free(eval_columns[v]);
+    free(eval_out);
+    jit_release(&eval_jit);
+    free(lex_input);
+    free(parse_input);
+    return 0;
+}
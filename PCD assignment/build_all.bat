@@ -23,7 +23,7 @@ goto end
 :build_gui
 echo.
 echo Building GUI Compiler...
-gcc -Wall -std=c11 -O2 -mwindows -o compiler_gui.exe gui_compiler.c lexer.c ll_parser.c lr_parser.c utils.c codegen.c -lcomctl32 -lgdi32
+gcc -Wall -std=c11 -O2 -mwindows -o compiler_gui.exe gui_compiler.c lexer.c ll_parser.c lr_parser.c utils.c parse_tree.c trace.c diagnostics.c grammar_gen.c grammar_transform.c stats.c codegen.c x86_encoder.c elf_writer.c -lcomctl32 -lgdi32
 if %ERRORLEVEL% EQU 0 (
     echo ✓ GUI Build successful!
     echo Starting GUI...
@@ -36,7 +36,7 @@ goto end
 :build_console
 echo.
 echo Building Console Compiler...
-gcc -Wall -std=c11 -O2 -o compiler.exe main.c lexer.c ll_parser.c lr_parser.c utils.c
+gcc -Wall -std=c11 -O2 -o compiler.exe main.c lexer.c ll_parser.c lr_parser.c pratt_parser.c utils.c parse_tree.c trace.c diagnostics.c grammar_gen.c grammar_transform.c stats.c pipeline.c statements.c cache.c cli.c server.c codegen.c x86_encoder.c elf_writer.c
 if %ERRORLEVEL% EQU 0 (
     echo ✓ Console Build successful!
     echo Run with: compiler.exe
@@ -48,7 +48,7 @@ goto end
 :build_both
 echo.
 echo Building Console Compiler...
-gcc -Wall -std=c11 -O2 -o compiler.exe main.c lexer.c ll_parser.c lr_parser.c utils.c
+gcc -Wall -std=c11 -O2 -o compiler.exe main.c lexer.c ll_parser.c lr_parser.c pratt_parser.c utils.c parse_tree.c trace.c diagnostics.c grammar_gen.c grammar_transform.c stats.c pipeline.c statements.c cache.c cli.c server.c codegen.c x86_encoder.c elf_writer.c
 if %ERRORLEVEL% EQU 0 (
     echo ✓ Console Build successful!
 ) else (
@@ -58,7 +58,7 @@ if %ERRORLEVEL% EQU 0 (
 
 echo.
 echo Building GUI Compiler...
-gcc -Wall -std=c11 -O2 -mwindows -o compiler_gui.exe gui_compiler.c lexer.c ll_parser.c lr_parser.c utils.c codegen.c -lcomctl32 -lgdi32
+gcc -Wall -std=c11 -O2 -mwindows -o compiler_gui.exe gui_compiler.c lexer.c ll_parser.c lr_parser.c utils.c parse_tree.c trace.c diagnostics.c grammar_gen.c grammar_transform.c stats.c codegen.c x86_encoder.c elf_writer.c -lcomctl32 -lgdi32
 if %ERRORLEVEL% EQU 0 (
     echo ✓ GUI Build successful!
     echo.
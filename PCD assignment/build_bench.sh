@@ -0,0 +1,4 @@
+#!/bin/sh
+# Build the benchmark harness (Linux). Run: ./bench > results.json
+cd "$(dirname "$0")" || exit 1
+gcc -Wall -std=c11 -O2 -pthread -o bench bench.c lexer.c ll_parser.c lr_parser.c pratt_parser.c utils.c parse_tree.c trace.c diagnostics.c grammar_gen.c grammar_transform.c stats.c statements.c codegen.c x86_encoder.c elf_writer.c "$@"
@@ -0,0 +1,384 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "compiler.h"
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+typedef CRITICAL_SECTION CacheLock;
+static void lock_init(CacheLock* l) { InitializeCriticalSection(l); }
+static void lock_destroy(CacheLock* l) { DeleteCriticalSection(l); }
+static void lock_acquire(CacheLock* l) { EnterCriticalSection(l); }
+static void lock_release(CacheLock* l) { LeaveCriticalSection(l); }
+static int make_directory(const char* path) { return _mkdir(path); }
+static long process_id() { return (long)_getpid(); }
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_mutex_t CacheLock;
+static void lock_init(CacheLock* l) { pthread_mutex_init(l, NULL); }
+static void lock_destroy(CacheLock* l) { pthread_mutex_destroy(l); }
+static void lock_acquire(CacheLock* l) { pthread_mutex_lock(l); }
+static void lock_release(CacheLock* l) { pthread_mutex_unlock(l); }
+static int make_directory(const char* path) { return mkdir(path, 0777); }
+static long process_id() { return (long)getpid(); }
+#endif
+
+// One cached result. The strings live in the same allocation, right after
+// the struct, so an entry is a single malloc.
+struct CacheEntry {
+    uint64_t grammar_hash;
+    uint64_t request_hash;
+    unsigned char phases;
+    unsigned char trace;
+    unsigned char status;
+    const char* name;       // "" when the name is not part of the key
+    const char* text;
+    const char* output;
+    size_t output_len;
+    const char* assembly;
+    size_t assembly_len;
+    size_t size;            // bytes charged against max_bytes
+    CacheEntry* chain;      // next entry in the same bucket
+    CacheEntry* newer;
+    CacheEntry* older;
+};
+
+// On-disk entry: magic, then the fixed header below, then name, text,
+// output and assembly back to back
+#define CACHE_MAGIC "PCDCACH1"
+#define CACHE_HEADER_SIZE (8 + 8 + 8 + 4 + 4 * 4)
+
+// Summary lines carry the input name, so it is only part of the request
+// when they are printed
+static const char* key_name(const char* name, CompileTrace trace) {
+    return name != NULL && trace != COMPILE_TRACE_NONE ? name : "";
+}
+
+static uint64_t request_hash(const char* name, const char* text, int phases, CompileTrace trace) {
+    unsigned char options[2] = { (unsigned char)phases, (unsigned char)trace };
+    uint64_t hash = hash_string(FNV_OFFSET_BASIS, text);
+    hash = hash_string(hash, name);
+    return hash_bytes(hash, options, sizeof(options));
+}
+
+static CacheEntry* new_entry(uint64_t grammar_hash, uint64_t hash, const char* name, const char* text,
+                             int phases, CompileTrace trace, CompileStatus status,
+                             const char* output, size_t output_len, const char* assembly, size_t assembly_len) {
+    size_t name_len = strlen(name);
+    size_t text_len = strlen(text);
+    size_t size = sizeof(CacheEntry) + name_len + 1 + text_len + 1 + output_len + assembly_len;
+    CacheEntry* e = malloc(size);
+    if (e == NULL) return NULL;
+    
+    char* p = (char*)(e + 1);
+    memcpy(p, name, name_len + 1);
+    e->name = p;
+    p += name_len + 1;
+    memcpy(p, text, text_len + 1);
+    e->text = p;
+    p += text_len + 1;
+    if (output_len) memcpy(p, output, output_len);
+    e->output = p;
+    p += output_len;
+    if (assembly_len) memcpy(p, assembly, assembly_len);
+    e->assembly = p;
+    
+    e->grammar_hash = grammar_hash;
+    e->request_hash = hash;
+    e->phases = (unsigned char)phases;
+    e->trace = (unsigned char)trace;
+    e->status = (unsigned char)status;
+    e->output_len = output_len;
+    e->assembly_len = assembly_len;
+    e->size = size;
+    e->chain = e->newer = e->older = NULL;
+    return e;
+}
+
+static bool entry_matches(const CacheEntry* e, uint64_t grammar_hash, uint64_t hash, const char* name,
+                          const char* text, int phases, CompileTrace trace) {
+    return e->grammar_hash == grammar_hash && e->request_hash == hash &&
+           e->phases == (unsigned char)phases && e->trace == (unsigned char)trace &&
+           strcmp(e->name, name) == 0 && strcmp(e->text, text) == 0;
+}
+
+static CacheEntry** bucket_of(CompileCache* cache, uint64_t grammar_hash, uint64_t hash) {
+    uint64_t mixed = grammar_hash ^ (hash * 0x9e3779b97f4a7c15ULL);
+    return &cache->buckets[(mixed >> 32) & (uint64_t)(cache->bucket_count - 1)];
+}
+
+static void unlink_lru(CompileCache* cache, CacheEntry* e) {
+    if (e->newer) e->newer->older = e->older;
+    else cache->newest = e->older;
+    if (e->older) e->older->newer = e->newer;
+    else cache->oldest = e->newer;
+    e->newer = e->older = NULL;
+}
+
+static void push_newest(CompileCache* cache, CacheEntry* e) {
+    e->older = cache->newest;
+    e->newer = NULL;
+    if (cache->newest) cache->newest->newer = e;
+    cache->newest = e;
+    if (cache->oldest == NULL) cache->oldest = e;
+}
+
+static void remove_entry(CompileCache* cache, CacheEntry* e) {
+    CacheEntry** link = bucket_of(cache, e->grammar_hash, e->request_hash);
+    while (*link != e) link = &(*link)->chain;
+    *link = e->chain;
+    unlink_lru(cache, e);
+    cache->stats.entries--;
+    cache->stats.bytes -= e->size;
+    free(e);
+}
+
+static CacheEntry* find_entry(CompileCache* cache, uint64_t grammar_hash, uint64_t hash, const char* name,
+                              const char* text, int phases, CompileTrace trace) {
+    for (CacheEntry* e = *bucket_of(cache, grammar_hash, hash); e != NULL; e = e->chain) {
+        if (entry_matches(e, grammar_hash, hash, name, text, phases, trace)) return e;
+    }
+    return NULL;
+}
+
+// Insert `e` as the newest entry and evict from the old end until the
+// cache is within its bounds again. Takes ownership of `e`.
+static void insert_entry(CompileCache* cache, CacheEntry* e) {
+    if (e->size > cache->max_bytes ||
+        find_entry(cache, e->grammar_hash, e->request_hash, e->name, e->text, e->phases, e->trace)) {
+        free(e);
+        return;
+    }
+    
+    CacheEntry** bucket = bucket_of(cache, e->grammar_hash, e->request_hash);
+    e->chain = *bucket;
+    *bucket = e;
+    push_newest(cache, e);
+    cache->stats.entries++;
+    cache->stats.bytes += e->size;
+    
+    while (cache->stats.entries > cache->max_entries || cache->stats.bytes > cache->max_bytes) {
+        remove_entry(cache, cache->oldest);
+        cache->stats.evictions++;
+    }
+}
+
+static void copy_out(const CacheEntry* e, OutputBuffer* output, OutputBuffer* assembly, CompileStatus* status) {
+    outbuf_write(output, e->output, e->output_len);
+    if (assembly) outbuf_write(assembly, e->assembly, e->assembly_len);
+    *status = (CompileStatus)e->status;
+}
+
+static void disk_path(const CompileCache* cache, uint64_t grammar_hash, uint64_t hash, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx-%016llx.cache", cache->disk_dir,
+             (unsigned long long)grammar_hash, (unsigned long long)hash);
+}
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+// Read an entry back from disk; NULL if it is missing, damaged or belongs
+// to a different request with the same hash
+static CacheEntry* read_disk_entry(CompileCache* cache, uint64_t grammar_hash, uint64_t hash, const char* name,
+                                   const char* text, int phases, CompileTrace trace) {
+    char path[1024];
+    disk_path(cache, grammar_hash, hash, path, sizeof(path));
+    size_t len = 0;
+    char* data = read_text_file(path, &len);
+    if (data == NULL) return NULL;
+    
+    CacheEntry* e = NULL;
+    const unsigned char* h = (const unsigned char*)data;
+    if (len >= CACHE_HEADER_SIZE && memcmp(h, CACHE_MAGIC, 8) == 0 &&
+        get_u64(h + 8) == grammar_hash && get_u64(h + 16) == hash) {
+        size_t name_len = get_u32(h + 28);
+        size_t text_len = get_u32(h + 32);
+        size_t output_len = get_u32(h + 36);
+        size_t assembly_len = get_u32(h + 40);
+        const char* p = data + CACHE_HEADER_SIZE;
+        
+        if (len == CACHE_HEADER_SIZE + name_len + text_len + output_len + assembly_len &&
+            h[24] == (unsigned char)phases && h[25] == (unsigned char)trace &&
+            name_len == strlen(name) && memcmp(p, name, name_len) == 0 &&
+            text_len == strlen(text) && memcmp(p + name_len, text, text_len) == 0) {
+            const char* output = p + name_len + text_len;
+            e = new_entry(grammar_hash, hash, name, text, phases, trace, (CompileStatus)h[26],
+                          output, output_len, output + output_len, assembly_len);
+        }
+    }
+    free(data);
+    return e;
+}
+
+// Write through a temporary file and rename, so readers never see a
+// partial entry. The temporary name is unique across the processes and
+// threads sharing the directory: process id, then a per-cache serial.
+static bool write_disk_entry(CompileCache* cache, const CacheEntry* e) {
+    char path[1024];
+    char temp[1100];
+    disk_path(cache, e->grammar_hash, e->request_hash, path, sizeof(path));
+    lock_acquire(cache->lock);
+    unsigned serial = cache->temp_serial++;
+    lock_release(cache->lock);
+    snprintf(temp, sizeof(temp), "%s.%ld-%u.tmp", path, process_id(), serial);
+    
+    unsigned char header[CACHE_HEADER_SIZE] = {0};
+    memcpy(header, CACHE_MAGIC, 8);
+    put_u64(header + 8, e->grammar_hash);
+    put_u64(header + 16, e->request_hash);
+    header[24] = e->phases;
+    header[25] = e->trace;
+    header[26] = e->status;
+    put_u32(header + 28, (uint32_t)strlen(e->name));
+    put_u32(header + 32, (uint32_t)strlen(e->text));
+    put_u32(header + 36, (uint32_t)e->output_len);
+    put_u32(header + 40, (uint32_t)e->assembly_len);
+    
+    FILE* file = fopen(temp, "wb");
+    if (file == NULL) return false;
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+              fwrite(e->name, 1, strlen(e->name), file) == strlen(e->name) &&
+              fwrite(e->text, 1, strlen(e->text), file) == strlen(e->text) &&
+              fwrite(e->output, 1, e->output_len, file) == e->output_len &&
+              fwrite(e->assembly, 1, e->assembly_len, file) == e->assembly_len;
+    if (fclose(file) != 0) ok = false;
+    
+    if (ok) {
+        remove(path);   // rename does not replace on Windows
+        ok = rename(temp, path) == 0;
+    }
+    if (!ok) remove(temp);
+    return ok;
+}
+
+bool cache_init(CompileCache* cache, int max_entries, size_t max_bytes, const char* disk_dir) {
+    memset(cache, 0, sizeof(*cache));
+    cache->max_entries = max_entries > 0 ? max_entries : 1;
+    cache->max_bytes = max_bytes;
+    
+    cache->bucket_count = 16;
+    while (cache->bucket_count < 2 * cache->max_entries) cache->bucket_count *= 2;
+    cache->buckets = calloc((size_t)cache->bucket_count, sizeof(CacheEntry*));
+    cache->lock = malloc(sizeof(CacheLock));
+    if (disk_dir) {
+        cache->disk_dir = malloc(strlen(disk_dir) + 1);
+        if (cache->disk_dir) strcpy(cache->disk_dir, disk_dir);
+    }
+    if (cache->buckets == NULL || cache->lock == NULL || (disk_dir && cache->disk_dir == NULL)) {
+        free(cache->buckets);
+        free(cache->lock);
+        free(cache->disk_dir);
+        memset(cache, 0, sizeof(*cache));
+        return false;
+    }
+    lock_init(cache->lock);
+    
+    // An existing directory is fine; failures show up as missing writes
+    if (disk_dir) make_directory(disk_dir);
+    return true;
+}
+
+void cache_free(CompileCache* cache) {
+    if (cache->lock == NULL) return;
+    while (cache->oldest) remove_entry(cache, cache->oldest);
+    lock_destroy(cache->lock);
+    free(cache->lock);
+    free(cache->buckets);
+    free(cache->disk_dir);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// On a hit, append the cached output (and assembly, if `assembly` is not
+// NULL) and set `status`
+bool cache_lookup(CompileCache* cache, uint64_t grammar_hash, const char* name, const char* text,
+                  int phases, CompileTrace trace, OutputBuffer* output, OutputBuffer* assembly,
+                  CompileStatus* status) {
+    name = key_name(name, trace);
+    uint64_t hash = request_hash(name, text, phases, trace);
+    
+    lock_acquire(cache->lock);
+    CacheEntry* e = find_entry(cache, grammar_hash, hash, name, text, phases, trace);
+    if (e) {
+        unlink_lru(cache, e);
+        push_newest(cache, e);
+        copy_out(e, output, assembly, status);
+        cache->stats.hits++;
+    }
+    lock_release(cache->lock);
+    if (e) return true;
+    
+    e = cache->disk_dir ? read_disk_entry(cache, grammar_hash, hash, name, text, phases, trace) : NULL;
+    
+    lock_acquire(cache->lock);
+    if (e) {
+        copy_out(e, output, assembly, status);
+        cache->stats.hits++;
+        cache->stats.disk_hits++;
+        insert_entry(cache, e);
+    } else {
+        cache->stats.misses++;
+    }
+    lock_release(cache->lock);
+    return e != NULL;
+}
+
+void cache_store(CompileCache* cache, uint64_t grammar_hash, const char* name, const char* text,
+                 int phases, CompileTrace trace, CompileStatus status,
+                 const OutputBuffer* output, const OutputBuffer* assembly) {
+    name = key_name(name, trace);
+    uint64_t hash = request_hash(name, text, phases, trace);
+    CacheEntry* e = new_entry(grammar_hash, hash, name, text, phases, trace, status,
+                              output->data, output->len,
+                              assembly ? assembly->data : NULL, assembly ? assembly->len : 0);
+    if (e == NULL) return;
+    
+    bool written = cache->disk_dir && write_disk_entry(cache, e);
+    
+    lock_acquire(cache->lock);
+    if (written) cache->stats.disk_writes++;
+    insert_entry(cache, e);
+    lock_release(cache->lock);
+}
+
+CacheStats cache_get_stats(CompileCache* cache) {
+    lock_acquire(cache->lock);
+    CacheStats stats = cache->stats;
+    lock_release(cache->lock);
+    return stats;
+}
+
+void print_cache_stats(CompileCache* cache) {
+    CacheStats s = cache_get_stats(cache);
+    uint64_t lookups = s.hits + s.misses;
+    
+    printf("\n=== RESULT CACHE ===\n");
+    printf("%-32s %llu\n", "Lookups", (unsigned long long)lookups);
+    printf("%-32s %llu (%.1f%%)\n", "Hits", (unsigned long long)s.hits,
+           lookups ? 100.0 * (double)s.hits / (double)lookups : 0.0);
+    printf("%-32s %llu\n", "  of which from disk", (unsigned long long)s.disk_hits);
+    printf("%-32s %llu\n", "Misses", (unsigned long long)s.misses);
+    printf("%-32s %llu\n", "Evictions", (unsigned long long)s.evictions);
+    printf("%-32s %llu\n", "Disk writes", (unsigned long long)s.disk_writes);
+    printf("%-32s %d / %d\n", "Entries", s.entries, cache->max_entries);
+    printf("%-32s %zu / %zu\n", "Bytes", s.bytes, cache->max_bytes);
+}
@@ -0,0 +1,451 @@
+// Non-interactive command-line driver. Runs the selected phases over each
+// input, locally or on a compile server, and exits with a status code;
+// nothing here ever reads standard input unless "-" is given as an input.
+#include "compiler.h"
+#include "codegen.h"
+
+// Exit status: worst CompileStatus over all inputs, or 2 on usage errors
+enum {
+    CLI_EXIT_OK = COMPILE_OK,
+    CLI_EXIT_REJECTED = COMPILE_REJECTED,
+    CLI_EXIT_ERROR = COMPILE_ERROR
+};
+
+typedef struct {
+    const char* name;   // file name, "<expr>" or "<stdin>"
+    char* text;
+    bool owned;
+} CliInput;
+
+typedef struct {
+    const char* grammar_file;
+    int sample;
+    int phases;
+    const char* output;
+    CompileTrace trace;
+    bool stats;
+    bool compact_tables;
+    bool lazy_tables;
+    bool statements;        // each input is a stream of ';'-separated statements
+    bool help;
+    const char* serve;      // socket path to serve on
+    const char* connect;    // socket path of a running server
+    int threads;
+    int cache_entries;      // 0 disables the result cache
+    const char* cache_dir;
+    CliInput* inputs;
+    int input_count;
+} CliOptions;
+
+static Grammar grammar;
+static FirstFollowSet first_sets[MAX_SYMBOLS];
+static FirstFollowSet follow_sets[MAX_SYMBOLS];
+static CompileContext context;
+static CompileCache cache;
+static uint64_t grammar_key;    // grammar_hash of the loaded grammar
+static TACProgram program;
+
+static void cli_usage(const char* program_name) {
+    fprintf(stderr,
+            "Usage: %s [options] [input files...]\n"
+            "  -g, --grammar FILE   grammar file, one \"A -> x y | z\" rule per line\n"
+            "  -s, --sample N       built-in sample grammar 1-3 (default 3)\n"
+            "  -e, --expr TEXT      compile TEXT as an input (may be repeated)\n"
+            "  -p, --phases LIST    comma-separated lex,ll,lr,glr,pratt,tac,asm,obj (default\n"
+            "                       lr); code comes from the pratt tree when selected, else\n"
+            "                       from glr's first derivation, else from lr\n"
+            "  -o, --output BASE    write BASE.asm / BASE.o (one input only; default is\n"
+            "                       the input name without its extension, or \"out\")\n"
+            "  -t, --trace LEVEL    none, summary (default) or steps\n"
+            "      --stats          print performance counters at the end\n"
+            "      --compact-tables parse LR with compressed tables (default reductions,\n"
+            "                       row displacement, 16-bit entries)\n"
+            "      --lazy-tables    build each LR state the first time a parse enters it\n"
+            "      --statements     compile each input as \"x = expr;\" / \"expr;\" statements\n"
+            "                       on --threads threads; phases lr or pratt, and tac\n"
+            "      --serve PATH     load the grammar once and serve compile requests on\n"
+            "                       the Unix domain socket PATH until interrupted\n"
+            "      --threads N      worker threads for --serve and --statements (default:\n"
+            "                       one per CPU)\n"
+            "      --connect PATH   send the inputs to a server instead of compiling\n"
+            "                       locally; asm output is printed, obj is not supported\n"
+            "      --cache-entries N  in-memory result cache size (default %d, 0 = off)\n"
+            "      --cache-dir DIR  also keep cached results on disk in DIR\n"
+            "  -h, --help           show this help\n"
+            "An input of \"-\" reads standard input. Exit status is 0 when every input\n"
+            "is accepted, 1 when one is rejected and 2 on usage or I/O errors.\n",
+            program_name, CACHE_DEFAULT_ENTRIES);
+}
+
+static bool parse_phases(const char* list, int* phases) {
+    static const struct { const char* name; int bit; } names[] = {
+        { "lex", COMPILE_LEX }, { "ll", COMPILE_LL }, { "lr", COMPILE_LR },
+        { "tac", COMPILE_TAC }, { "asm", COMPILE_ASM }, { "obj", COMPILE_OBJ },
+        { "glr", COMPILE_GLR }, { "pratt", COMPILE_PRATT }
+    };
+    
+    *phases = 0;
+    const char* p = list;
+    while (*p != '\0') {
+        size_t len = strcspn(p, ",");
+        bool found = false;
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (strlen(names[i].name) == len && strncmp(names[i].name, p, len) == 0) {
+                *phases |= names[i].bit;
+                found = true;
+            }
+        }
+        if (!found) return false;
+        p += len;
+        if (*p == ',') p++;
+    }
+    return *phases != 0;
+}
+
+static bool add_input(CliOptions* opt, const char* name, char* text, bool owned) {
+    if (text == NULL) {
+        fprintf(stderr, "compiler: cannot read %s\n", name);
+        return false;
+    }
+    CliInput* in = &opt->inputs[opt->input_count++];
+    in->name = name;
+    in->text = text;
+    in->owned = owned;
+    return true;
+}
+
+static char* read_stdin() {
+    size_t len = 0;
+    size_t cap = 4096;
+    char* text = malloc(cap);
+    while (text != NULL) {
+        size_t n = fread(text + len, 1, cap - len - 1, stdin);
+        len += n;
+        if (n == 0) break;
+        if (len + 1 == cap) {
+            char* grown = realloc(text, cap * 2);
+            if (grown == NULL) free(text);
+            text = grown;
+            cap *= 2;
+        }
+    }
+    if (text) text[len] = '\0';
+    return text;
+}
+
+// Returns CLI_EXIT_OK, or the exit status to stop with
+static int parse_cli_options(int argc, char* argv[], CliOptions* opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->sample = 3;
+    opt->phases = COMPILE_LR;
+    opt->trace = COMPILE_TRACE_SUMMARY;
+    opt->cache_entries = CACHE_DEFAULT_ENTRIES;
+    opt->inputs = calloc((size_t)argc, sizeof(CliInput));
+    if (opt->inputs == NULL) return CLI_EXIT_ERROR;
+    
+    bool stdin_used = false;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            opt->help = true;
+            return CLI_EXIT_OK;
+        }
+        if (strcmp(arg, "--stats") == 0) {
+            opt->stats = true;
+            continue;
+        }
+        if (strcmp(arg, "--compact-tables") == 0) {
+            opt->compact_tables = true;
+            continue;
+        }
+        if (strcmp(arg, "--lazy-tables") == 0) {
+            opt->lazy_tables = true;
+            continue;
+        }
+        if (strcmp(arg, "--statements") == 0) {
+            opt->statements = true;
+            continue;
+        }
+        if (strcmp(arg, "-") == 0) {
+            if (stdin_used) continue;
+            stdin_used = true;
+            if (!add_input(opt, "<stdin>", read_stdin(), true)) return CLI_EXIT_ERROR;
+            continue;
+        }
+        if (arg[0] != '-') {
+            if (!add_input(opt, arg, read_text_file(arg, NULL), true)) return CLI_EXIT_ERROR;
+            continue;
+        }
+        
+        if (value == NULL) {
+            fprintf(stderr, "compiler: %s needs a value\n", arg);
+            return CLI_EXIT_ERROR;
+        }
+        if (strcmp(arg, "--serve") == 0) {
+            opt->serve = value;
+        } else if (strcmp(arg, "--connect") == 0) {
+            opt->connect = value;
+        } else if (strcmp(arg, "--threads") == 0) {
+            opt->threads = atoi(value);
+        } else if (strcmp(arg, "--cache-entries") == 0) {
+            opt->cache_entries = atoi(value);
+        } else if (strcmp(arg, "--cache-dir") == 0) {
+            opt->cache_dir = value;
+        } else if (strcmp(arg, "-g") == 0 || strcmp(arg, "--grammar") == 0) {
+            opt->grammar_file = value;
+        } else if (strcmp(arg, "-s") == 0 || strcmp(arg, "--sample") == 0) {
+            opt->sample = atoi(value);
+            if (opt->sample < 1 || opt->sample > 3) {
+                fprintf(stderr, "compiler: sample grammar must be 1, 2 or 3\n");
+                return CLI_EXIT_ERROR;
+            }
+        } else if (strcmp(arg, "-e") == 0 || strcmp(arg, "--expr") == 0) {
+            add_input(opt, "<expr>", argv[i + 1], false);
+        } else if (strcmp(arg, "-p") == 0 || strcmp(arg, "--phases") == 0) {
+            if (!parse_phases(value, &opt->phases)) {
+                fprintf(stderr, "compiler: unknown phase list \"%s\"\n", value);
+                return CLI_EXIT_ERROR;
+            }
+        } else if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0) {
+            opt->output = value;
+        } else if (strcmp(arg, "-t") == 0 || strcmp(arg, "--trace") == 0) {
+            if (strcmp(value, "none") == 0) opt->trace = COMPILE_TRACE_NONE;
+            else if (strcmp(value, "summary") == 0) opt->trace = COMPILE_TRACE_SUMMARY;
+            else if (strcmp(value, "steps") == 0) opt->trace = COMPILE_TRACE_STEPS;
+            else {
+                fprintf(stderr, "compiler: unknown trace level \"%s\"\n", value);
+                return CLI_EXIT_ERROR;
+            }
+        } else {
+            fprintf(stderr, "compiler: unknown option %s\n", arg);
+            cli_usage(argv[0]);
+            return CLI_EXIT_ERROR;
+        }
+        i++;
+    }
+    
+    if (opt->serve) {
+        if (opt->input_count > 0 || opt->connect) {
+            fprintf(stderr, "compiler: --serve takes no inputs\n");
+            return CLI_EXIT_ERROR;
+        }
+        return CLI_EXIT_OK;
+    }
+    if (opt->statements) {
+        int parsers = opt->phases & (COMPILE_LR | COMPILE_PRATT);
+        if (opt->connect || (opt->phases & ~(COMPILE_LR | COMPILE_PRATT | COMPILE_TAC)) ||
+            parsers == (COMPILE_LR | COMPILE_PRATT)) {
+            fprintf(stderr, "compiler: --statements takes one of the lr and pratt phases, and tac\n");
+            return CLI_EXIT_ERROR;
+        }
+        if (opt->trace == COMPILE_TRACE_STEPS) {
+            fprintf(stderr, "compiler: --statements has no steps trace\n");
+            return CLI_EXIT_ERROR;
+        }
+    }
+    if (opt->connect && (opt->phases & COMPILE_OBJ)) {
+        fprintf(stderr, "compiler: obj output needs a local compile\n");
+        return CLI_EXIT_ERROR;
+    }
+    if (opt->input_count == 0) {
+        fprintf(stderr, "compiler: no input (give files, -e TEXT or -)\n");
+        return CLI_EXIT_ERROR;
+    }
+    if (opt->output && opt->input_count > 1 && (opt->phases & (COMPILE_ASM | COMPILE_OBJ))) {
+        fprintf(stderr, "compiler: -o needs exactly one input\n");
+        return CLI_EXIT_ERROR;
+    }
+    return CLI_EXIT_OK;
+}
+
+// Output path for `in`: BASE + extension, BASE being -o, the input file
+// name without its extension, or "out" for inline and piped inputs
+static void output_path(const CliOptions* opt, const CliInput* in, const char* extension, char* path, size_t size) {
+    const char* base = opt->output;
+    size_t len;
+    if (base != NULL) {
+        len = strlen(base);
+    } else if (in->name[0] != '<') {
+        base = in->name;
+        const char* dot = strrchr(base, '.');
+        const char* slash = strrchr(base, '/');
+        len = dot && (slash == NULL || dot > slash) ? (size_t)(dot - base) : strlen(base);
+    } else {
+        base = "out";
+        len = 3;
+    }
+    snprintf(path, size, "%.*s%s", (int)len, base, extension);
+}
+
+static bool write_text_file(const char* path, const OutputBuffer* text) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) return false;
+    bool ok = fwrite(text->data, 1, text->len, file) == text->len;
+    if (fclose(file) != 0) ok = false;
+    return ok;
+}
+
+static int compile_input(const CliOptions* opt, const CliInput* in, OutputBuffer* out) {
+    if (opt->statements) {
+        CompileStatus status = compile_statements(in->name, in->text, opt->phases, opt->trace, opt->threads, out);
+        outbuf_flush(out);
+        return status;
+    }
+    
+    CompileCache* results = opt->cache_entries > 0 ? &cache : NULL;
+    CompileStatus status = compile_cached(results, &grammar, grammar_key, in->name, in->text,
+                                          opt->phases, opt->trace, &context);
+    outbuf_write(out, context.output.data, context.output.len);
+    outbuf_flush(out);
+    if (status != COMPILE_OK || !(opt->phases & (COMPILE_ASM | COMPILE_OBJ))) return status;
+    
+    char path[1024];
+    if (opt->phases & COMPILE_ASM) {
+        output_path(opt, in, ".asm", path, sizeof(path));
+        if (!write_text_file(path, &context.assembly)) {
+            fprintf(stderr, "compiler: cannot write %s\n", path);
+            return CLI_EXIT_ERROR;
+        }
+    }
+    if (opt->phases & COMPILE_OBJ) {
+        output_path(opt, in, ".o", path, sizeof(path));
+        if (!lower_tac(&program)) {
+            fprintf(stderr, "compiler: %s: program cannot be encoded as an object\n", in->name);
+            return CLI_EXIT_REJECTED;
+        }
+        if (!write_elf_object(path, &program, true)) {
+            fprintf(stderr, "compiler: cannot write %s\n", path);
+            return CLI_EXIT_ERROR;
+        }
+    }
+    return status;
+}
+
+// Send every input to a running server and print its replies
+static int run_client(const CliOptions* opt) {
+    int fd = server_connect(opt->connect);
+    if (fd < 0) {
+        fprintf(stderr, "compiler: cannot connect to %s\n", opt->connect);
+        return CLI_EXIT_ERROR;
+    }
+    
+    OutputBuffer reply;
+    outbuf_init(&reply);
+    int status = CLI_EXIT_OK;
+    for (int i = 0; i < opt->input_count; i++) {
+        CompileStatus result;
+        outbuf_reset(&reply);
+        if (!server_request(fd, opt->phases, opt->trace, opt->inputs[i].text, &reply, &result)) {
+            fprintf(stderr, "compiler: %s: no reply from server\n", opt->inputs[i].name);
+            status = CLI_EXIT_ERROR;
+            break;
+        }
+        fwrite(reply.data, 1, reply.len, stdout);
+        if ((int)result > status) status = result;
+    }
+    fflush(stdout);
+    outbuf_free(&reply);
+    server_disconnect(fd);
+    return status;
+}
+
+static void free_cli_options(CliOptions* opt) {
+    for (int i = 0; i < opt->input_count; i++) {
+        if (opt->inputs[i].owned) free(opt->inputs[i].text);
+    }
+    free(opt->inputs);
+}
+
+int run_cli(int argc, char* argv[]) {
+    CliOptions opt;
+    int status = parse_cli_options(argc, argv, &opt);
+    if (status != CLI_EXIT_OK || opt.help) {
+        if (opt.help) cli_usage(argv[0]);
+        free_cli_options(&opt);
+        return status;
+    }
+    
+    if (opt.grammar_file) {
+        char error[256];
+        if (!load_grammar_file(&grammar, opt.grammar_file, error, sizeof(error))) {
+            fprintf(stderr, "compiler: %s\n", error);
+            free_cli_options(&opt);
+            return CLI_EXIT_ERROR;
+        }
+    } else {
+        load_sample_grammar(&grammar, opt.sample);
+    }
+    
+    // Compressed tables can report errors from another state, and lazily
+    // built ones number their states in another order, so their results
+    // are cached apart. Server workers share the tables, which lazy
+    // construction would write while they parse, so it is left off there
+    // and for statement workers.
+    bool lazy = opt.lazy_tables && !opt.compact_tables && !opt.serve && !opt.statements;
+    grammar_key = grammar_hash(&grammar);
+    if (opt.compact_tables) grammar_key = hash_string(grammar_key, "compact-tables");
+    if (lazy) grammar_key = hash_string(grammar_key, "lazy-tables");
+    set_lr_table_compression(opt.compact_tables);
+    set_lr_lazy_construction(lazy);
+    if (opt.cache_entries > 0 && !cache_init(&cache, opt.cache_entries, CACHE_DEFAULT_BYTES, opt.cache_dir)) {
+        opt.cache_entries = 0;
+    }
+    if (opt.serve) {
+        status = run_server(&grammar, opt.cache_entries > 0 ? &cache : NULL, opt.serve, opt.threads);
+        cache_free(&cache);
+        free_cli_options(&opt);
+        return status;
+    }
+    if (opt.connect) {
+        cache_free(&cache);
+        status = run_client(&opt);
+        free_cli_options(&opt);
+        return status;
+    }
+    
+    reset_compiler_stats();
+    if (opt.phases & COMPILE_LL) {
+        init_ll_parser(&grammar);
+        compute_first_sets(&grammar, first_sets);
+        compute_follow_sets(&grammar, first_sets, follow_sets);
+        build_ll_table(&grammar, first_sets, follow_sets);
+    }
+    if (opt.phases & COMPILE_PRATT) {
+        if (!build_pratt_table(&grammar)) {
+            fprintf(stderr, "compiler: grammar has no operator-precedence form for the pratt phase\n");
+            cache_free(&cache);
+            free_cli_options(&opt);
+            return CLI_EXIT_ERROR;
+        }
+    }
+    if ((opt.phases & (COMPILE_LR | COMPILE_GLR)) || ((opt.phases & COMPILE_CODEGEN) && !(opt.phases & COMPILE_PRATT))) {
+        init_lr_parser(&grammar);
+        if (!construct_lr_table()) {
+            fprintf(stderr, "compiler: grammar exceeds the LR table limits\n");
+            cache_free(&cache);
+            free_cli_options(&opt);
+            return CLI_EXIT_ERROR;
+        }
+    }
+    
+    OutputBuffer out;
+    outbuf_init_file(&out, stdout);
+    compile_context_init(&context);
+    for (int i = 0; i < opt.input_count; i++) {
+        int result = compile_input(&opt, &opt.inputs[i], &out);
+        if (result > status) status = result;
+    }
+    if (opt.stats) {
+        print_compiler_stats();
+        if (opt.cache_entries > 0) print_cache_stats(&cache);
+    }
+    fflush(stdout);
+    
+    outbuf_free(&out);
+    compile_context_free(&context);
+    cache_free(&cache);
+    free_cli_options(&opt);
+    return status;
+}
@@ -2,25 +2,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
-static CodeGenerator codegen;
-static char assembly_code[10000];
+// Per thread, so concurrent compiles each generate into their own state
+static _Thread_local CodeGenerator codegen;
+static _Thread_local OutputBuffer assembly_code = { NULL, 0, 0, NULL, -1, false };
 
 void init_codegen() {
     codegen.instr_count = 0;
     codegen.temp_count = 0;
     codegen.label_count = 0;
-    memset(assembly_code, 0, sizeof(assembly_code));
+    outbuf_reset(&assembly_code);
 }
 
+// Temporaries are named "%t0", "%t1", ...; the lexer never produces a '%'
+// in an identifier, so they cannot collide with source variables
 char* new_temp() {
-    static char temp[20];
-    sprintf(temp, "t%d", codegen.temp_count++);
+    static _Thread_local char temp[20];
+    sprintf(temp, "%%t%d", codegen.temp_count++);
     return temp;
 }
 
 char* new_label() {
-    static char label[20];
+    static _Thread_local char label[20];
     sprintf(label, "L%d", codegen.label_count++);
     return label;
 }
@@ -29,6 +33,7 @@ void emit(const char* op, const char* arg1, const char* arg2, const char* result
     if (codegen.instr_count >= MAX_CODE_LINES) return;
     
     TAC* instr = &codegen.instructions[codegen.instr_count++];
+    compiler_stats.tac_emitted++;
     strncpy(instr->op, op, sizeof(instr->op) - 1);
     instr->op[sizeof(instr->op) - 1] = '\0';
     
@@ -48,114 +53,480 @@ void emit(const char* op, const char* arg1, const char* arg2, const char* result
     } else instr->result[0] = '\0';
 }
 
-void generate_code_from_tokens() {
-    // This is a simplified code generator for arithmetic expressions
-    // It generates three-address code
+// Whether `name` is a temporary made by new_temp()
+bool is_temp_name(const char* name) {
+    if (name[0] != '%' || name[1] != 't' || name[2] == '\0') return false;
+    for (int i = 2; name[i]; i++) {
+        if (!isdigit((unsigned char)name[i])) return false;
+    }
+    return true;
+}
+
+static inline bool is_operator_leaf(const ParseTree* tree, const ParseNode* node) {
+    if (node->token < 0) return false;
+    const char* lexeme = tree->tokens[node->token].lexeme;
+    return lexeme[1] == '\0' && strchr("+-*/", lexeme[0]) != NULL;
+}
+
+static inline bool is_leaf_lexeme(const ParseTree* tree, const ParseNode* node, const char* lexeme) {
+    return node->token >= 0 && strcmp(tree->tokens[node->token].lexeme, lexeme) == 0;
+}
+
+// Operands during the walk: a token index for a source operand, -(t + 1)
+// for temporary t, NO_OPERAND when a tail has no inherited left operand
+#define NO_OPERAND INT_MIN
+
+static const char* operand_name(const ParseTree* tree, int operand, char* buffer) {
+    if (operand >= 0) return tree->tokens[operand].lexeme;
+    sprintf(buffer, "%%t%d", -operand - 1);
+    return buffer;
+}
+
+static int emit_binary_temp(const ParseTree* tree, char op, int left, int right) {
+    char op_text[2] = { op, '\0' };
+    char left_name[50], right_name[50];
+    int temp = codegen.temp_count;
+    emit(op_text, operand_name(tree, left, left_name), operand_name(tree, right, right_name), new_temp());
+    return -(temp + 1);
+}
+
+// What a pending node does with the operand just generated below it
+enum {
+    RESUME_LEFT,        // A op B: A is done, generate B
+    RESUME_RIGHT,       // A op B: both done, emit
+    RESUME_TAIL,        // op B [Tail]: B is done, fold into the inherited operand
+    RESUME_HEAD         // A Tail: A is done, it is the tail's inherited operand
+};
+
+// One pending node on the walk's stack: node, resume step, and the
+// operand it holds (the left one for RESUME_RIGHT, the inherited one for
+// RESUME_TAIL)
+#define FRAME_INTS 3
+
+// Generate code for the subtree at the root and store the operand holding
+// its value in `value`. The inherited operand handed down to expression
+// tails such as E' -> + T E' keeps LL-style grammars left-associative.
+// The walk is iterative over the preorder pool, with its stack kept in the
+// tree like parse_tree_finish's, so neither long operand chains nor deep
+// parentheses can overflow the C stack. It stops with failure once the
+// code buffer is full.
+static bool gen_node(ParseTree* tree, int* value) {
+    int n = 0, inherited = NO_OPERAND, operand = NO_OPERAND, top = 0;
     
+    while (true) {
+        // Descend from n until a subtree yields its operand
+        while (operand == NO_OPERAND) {
+            if (codegen.instr_count >= MAX_CODE_LINES) return false;
+            const ParseNode* node = &tree->nodes[n];
+            int c0 = n + 1;
+            int c1 = node->child_count > 1 ? c0 + tree->nodes[c0].size : -1;
+            int c2 = node->child_count > 2 ? c1 + tree->nodes[c1].size : -1;
+            
+            if (node->token >= 0) {
+                // Operand leaf
+                operand = node->token;
+                break;
+            }
+            if (node->child_count == 0) {
+                // Epsilon: the tail contributes nothing
+                if (inherited == NO_OPERAND) return false;
+                operand = inherited;
+                break;
+            }
+            if (node->child_count == 1) {
+                n = c0;
+                continue;
+            }
+            
+            const ParseNode* first = &tree->nodes[c0];
+            const ParseNode* second = &tree->nodes[c1];
+            int resume;
+            if (node->child_count == 3 && is_leaf_lexeme(tree, first, "(") &&
+                is_leaf_lexeme(tree, &tree->nodes[c2], ")")) {
+                n = c1;
+                inherited = NO_OPERAND;
+                continue;
+            } else if (node->child_count == 3 && is_operator_leaf(tree, second)) {
+                resume = RESUME_LEFT;
+            } else if (is_operator_leaf(tree, first) && inherited != NO_OPERAND) {
+                resume = RESUME_TAIL;
+            } else if (node->child_count == 2) {
+                resume = RESUME_HEAD;
+            } else {
+                return false;
+            }
+            
+            if (!grow_array(&tree->failed, (void**)&tree->stack, &tree->stack_cap,
+                            (top + 1) * FRAME_INTS, sizeof(int))) {
+                return false;
+            }
+            int* frame = &tree->stack[top++ * FRAME_INTS];
+            frame[0] = n;
+            frame[1] = resume;
+            frame[2] = inherited;
+            n = resume == RESUME_TAIL ? c1 : c0;
+            inherited = NO_OPERAND;
+        }
+        
+        if (top == 0) {
+            *value = operand;
+            return true;
+        }
+        
+        // Hand the operand to the innermost pending node
+        int* frame = &tree->stack[--top * FRAME_INTS];
+        const ParseNode* node = &tree->nodes[frame[0]];
+        int c0 = frame[0] + 1;
+        int c1 = c0 + tree->nodes[c0].size;
+        int c2 = node->child_count > 2 ? c1 + tree->nodes[c1].size : -1;
+        
+        switch (frame[1]) {
+            case RESUME_LEFT:
+                frame[1] = RESUME_RIGHT;
+                frame[2] = operand;
+                top++;
+                n = c2;
+                inherited = NO_OPERAND;
+                operand = NO_OPERAND;
+                break;
+            case RESUME_RIGHT: {
+                const ParseNode* op = &tree->nodes[c1];
+                operand = emit_binary_temp(tree, tree->tokens[op->token].lexeme[0], frame[2], operand);
+                break;
+            }
+            case RESUME_TAIL: {
+                const ParseNode* op = &tree->nodes[c0];
+                operand = emit_binary_temp(tree, tree->tokens[op->token].lexeme[0], frame[2], operand);
+                if (node->child_count == 2) break;
+                if (node->child_count != 3) return false;
+                n = c2;
+                inherited = operand;
+                operand = NO_OPERAND;
+                break;
+            }
+            default:
+                n = c1;
+                inherited = operand;
+                operand = NO_OPERAND;
+                break;
+        }
+    }
+}
+
+// Generate three-address code for an expression parse tree built by any of
+// the parsers. Leaves are operands, and operator tokens become TAC ops.
+static bool gen_tree(ParseTree* tree) {
     init_codegen();
+    if (tree->node_count == 0) return false;
     
-    // Example: For "a + b * c", generate:
-    // t1 = b * c
-    // t2 = a + t1
+    int value;
+    if (!gen_node(tree, &value)) return false;
     
-    emit("=", "a", "", "t0");
-    emit("=", "b", "", "t1");
-    emit("=", "c", "", "t2");
-    emit("*", "t1", "t2", "t3");
-    emit("+", "t0", "t3", "t4");
+    // A lone operand still needs an instruction holding the result
+    if (codegen.instr_count == 0) {
+        char name[50];
+        emit("=", operand_name(tree, value, name), "", new_temp());
+    }
+    return codegen.instr_count < MAX_CODE_LINES;
 }
 
-char* generate_assembly() {
-    assembly_code[0] = '\0';
-    char buffer[500];
-    
-    strcat(assembly_code, "; Assembly Code Generated by Compiler\n");
-    strcat(assembly_code, "; Target: x86-64 Architecture\n");
-    strcat(assembly_code, "\n");
-    strcat(assembly_code, "section .data\n");
+bool generate_code_from_tree(ParseTree* tree) {
+    PhaseTimer timer = phase_begin();
+    bool ok = gen_tree(tree);
+    phase_end(PHASE_CODEGEN, timer);
+    return ok;
+}
+
+// NASM name of a TAC operand. '%' starts a NASM preprocessor token, so
+// temporary "%tN" becomes the label "t.N", which no identifier can spell.
+static const char* asm_name(const char* name, char* buffer) {
+    if (!is_temp_name(name)) return name;
+    sprintf(buffer, "t.%s", name + 2);
+    return buffer;
+}
+
+void emit_assembly(OutputBuffer* out) {
+    outbuf_puts(out, "; Assembly Code Generated by Compiler\n");
+    outbuf_puts(out, "; Target: x86-64 Architecture\n");
+    outbuf_puts(out, "\n");
+    outbuf_puts(out, "section .data\n");
     
     // Add variable declarations
     for (int i = 0; i < codegen.temp_count; i++) {
-        sprintf(buffer, "    t%d: dq 0\n", i);
-        strcat(assembly_code, buffer);
+        outbuf_printf(out, "    t.%d: dq 0\n", i);
     }
     
-    strcat(assembly_code, "\nsection .text\n");
-    strcat(assembly_code, "    global _start\n\n");
-    strcat(assembly_code, "_start:\n");
+    outbuf_puts(out, "\nsection .text\n");
+    outbuf_puts(out, "    global _start\n\n");
+    outbuf_puts(out, "_start:\n");
     
     // Generate assembly from TAC
     for (int i = 0; i < codegen.instr_count; i++) {
         TAC* instr = &codegen.instructions[i];
+        char arg1_buffer[50], arg2_buffer[50], result_buffer[50];
+        const char* arg1 = asm_name(instr->arg1, arg1_buffer);
+        const char* arg2 = asm_name(instr->arg2, arg2_buffer);
+        const char* result = asm_name(instr->result, result_buffer);
         
         if (strcmp(instr->op, "=") == 0) {
-            sprintf(buffer, "    mov rax, [%s]      ; %s = %s\n", 
-                    instr->arg1, instr->result, instr->arg1);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    mov [%s], rax\n", instr->result);
-            strcat(assembly_code, buffer);
+            outbuf_printf(out, "    mov rax, [%s]      ; %s = %s\n", 
+                          arg1, result, arg1);
+            outbuf_printf(out, "    mov [%s], rax\n", result);
         }
         else if (strcmp(instr->op, "+") == 0) {
-            sprintf(buffer, "    mov rax, [%s]      ; %s = %s + %s\n", 
-                    instr->arg1, instr->result, instr->arg1, instr->arg2);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    add rax, [%s]\n", instr->arg2);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    mov [%s], rax\n", instr->result);
-            strcat(assembly_code, buffer);
+            outbuf_printf(out, "    mov rax, [%s]      ; %s = %s + %s\n", 
+                          arg1, result, arg1, arg2);
+            outbuf_printf(out, "    add rax, [%s]\n", arg2);
+            outbuf_printf(out, "    mov [%s], rax\n", result);
         }
         else if (strcmp(instr->op, "-") == 0) {
-            sprintf(buffer, "    mov rax, [%s]      ; %s = %s - %s\n", 
-                    instr->arg1, instr->result, instr->arg1, instr->arg2);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    sub rax, [%s]\n", instr->arg2);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    mov [%s], rax\n", instr->result);
-            strcat(assembly_code, buffer);
+            outbuf_printf(out, "    mov rax, [%s]      ; %s = %s - %s\n", 
+                          arg1, result, arg1, arg2);
+            outbuf_printf(out, "    sub rax, [%s]\n", arg2);
+            outbuf_printf(out, "    mov [%s], rax\n", result);
         }
         else if (strcmp(instr->op, "*") == 0) {
-            sprintf(buffer, "    mov rax, [%s]      ; %s = %s * %s\n", 
-                    instr->arg1, instr->result, instr->arg1, instr->arg2);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    imul rax, [%s]\n", instr->arg2);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    mov [%s], rax\n", instr->result);
-            strcat(assembly_code, buffer);
+            outbuf_printf(out, "    mov rax, [%s]      ; %s = %s * %s\n", 
+                          arg1, result, arg1, arg2);
+            outbuf_printf(out, "    imul rax, [%s]\n", arg2);
+            outbuf_printf(out, "    mov [%s], rax\n", result);
         }
         else if (strcmp(instr->op, "/") == 0) {
-            sprintf(buffer, "    mov rax, [%s]      ; %s = %s / %s\n", 
-                    instr->arg1, instr->result, instr->arg1, instr->arg2);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    xor rdx, rdx\n");
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    idiv qword [%s]\n", instr->arg2);
-            strcat(assembly_code, buffer);
-            sprintf(buffer, "    mov [%s], rax\n", instr->result);
-            strcat(assembly_code, buffer);
+            outbuf_printf(out, "    mov rax, [%s]      ; %s = %s / %s\n", 
+                          arg1, result, arg1, arg2);
+            outbuf_puts(out, "    xor rdx, rdx\n");
+            outbuf_printf(out, "    idiv qword [%s]\n", arg2);
+            outbuf_printf(out, "    mov [%s], rax\n", result);
         }
         
-        strcat(assembly_code, "\n");
+        outbuf_puts(out, "\n");
     }
     
     // Exit system call
-    strcat(assembly_code, "    ; Exit program\n");
-    strcat(assembly_code, "    mov rax, 60        ; sys_exit\n");
-    strcat(assembly_code, "    xor rdi, rdi       ; exit code 0\n");
-    strcat(assembly_code, "    syscall\n");
+    outbuf_puts(out, "    ; Exit program\n");
+    outbuf_puts(out, "    mov rax, 60        ; sys_exit\n");
+    outbuf_puts(out, "    xor rdi, rdi       ; exit code 0\n");
+    outbuf_puts(out, "    syscall\n");
+}
+
+char* generate_assembly() {
+    PhaseTimer timer = phase_begin();
+    outbuf_reset(&assembly_code);
+    emit_assembly(&assembly_code);
+    phase_end(PHASE_ASSEMBLY, timer);
+    return (char*)outbuf_cstr(&assembly_code);
+}
+
+bool write_assembly_file(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) return false;
+    
+    // Stream straight to the file; nothing is kept in memory past the
+    // flush threshold
+    OutputBuffer out;
+    outbuf_init_file(&out, file);
+    emit_assembly(&out);
+    bool ok = outbuf_flush(&out);
+    outbuf_free(&out);
     
-    return assembly_code;
+    if (fclose(file) != 0) ok = false;
+    return ok;
 }
 
-void print_tac() {
-    printf("\n=== THREE-ADDRESS CODE ===\n");
+// This thread's generator, holding the code of the last compile
+const CodeGenerator* get_code_generator() {
+    return &codegen;
+}
+
+void format_tac(OutputBuffer* out) {
+    outbuf_puts(out, "\n=== THREE-ADDRESS CODE ===\n");
     for (int i = 0; i < codegen.instr_count; i++) {
         TAC* instr = &codegen.instructions[i];
-        printf("%d: ", i);
+        outbuf_printf(out, "%d: ", i);
         
         if (strcmp(instr->op, "=") == 0) {
-            printf("%s = %s\n", instr->result, instr->arg1);
+            outbuf_printf(out, "%s = %s\n", instr->result, instr->arg1);
+        } else {
+            outbuf_printf(out, "%s = %s %s %s\n", instr->result, instr->arg1, instr->op, instr->arg2);
+        }
+    }
+}
+
+void print_tac() {
+    OutputBuffer out;
+    fflush(stdout);
+    outbuf_init_file(&out, stdout);
+    format_tac(&out);
+    outbuf_flush(&out);
+    outbuf_free(&out);
+}
+
+static bool is_number_literal(const char* name) {
+    int i = (name[0] == '-') ? 1 : 0;
+    if (name[i] == '\0') return false;
+    for (; name[i]; i++) {
+        if (!isdigit((unsigned char)name[i])) return false;
+    }
+    return true;
+}
+
+static bool resolve_operand(TACProgram* prog, const char* name, Operand* out) {
+    if (name[0] == '\0') {
+        out->kind = OPERAND_NONE;
+        out->value = 0;
+        return true;
+    }
+    
+    if (is_number_literal(name)) {
+        out->kind = OPERAND_CONST;
+        out->value = strtoll(name, NULL, 10);
+        return true;
+    }
+    
+    if (is_temp_name(name)) {
+        int index = atoi(name + 2);
+        if (index >= MAX_TEMPS) return false;
+        out->kind = OPERAND_TEMP;
+        out->value = index;
+        if (index >= prog->temp_count) prog->temp_count = index + 1;
+        return true;
+    }
+    
+    out->kind = OPERAND_VAR;
+    for (int i = 0; i < prog->var_count; i++) {
+        if (strcmp(prog->variables[i], name) == 0) {
+            out->value = i;
+            return true;
+        }
+    }
+    if (prog->var_count >= MAX_SYMBOLS) return false;
+    
+    strncpy(prog->variables[prog->var_count], name, MAX_TOKEN_LEN - 1);
+    prog->variables[prog->var_count][MAX_TOKEN_LEN - 1] = '\0';
+    out->value = prog->var_count++;
+    return true;
+}
+
+// Resolve the current TAC into slot form for the native and batch back-ends
+bool lower_tac(TACProgram* prog) {
+    prog->count = 0;
+    prog->var_count = 0;
+    prog->temp_count = 0;
+    prog->value.kind = OPERAND_NONE;
+    prog->value.value = 0;
+    
+    for (int i = 0; i < codegen.instr_count; i++) {
+        TAC* instr = &codegen.instructions[i];
+        ResolvedTAC* out = &prog->code[prog->count];
+        
+        if (strlen(instr->op) != 1 || strchr("=+-*/", instr->op[0]) == NULL) return false;
+        out->op = instr->op[0];
+        
+        if (!resolve_operand(prog, instr->arg1, &out->arg1)) return false;
+        if (!resolve_operand(prog, instr->arg2, &out->arg2)) return false;
+        if (!resolve_operand(prog, instr->result, &out->result)) return false;
+        
+        if (out->arg1.kind == OPERAND_NONE) return false;
+        if (out->op != '=' && out->arg2.kind == OPERAND_NONE) return false;
+        if (out->result.kind != OPERAND_VAR && out->result.kind != OPERAND_TEMP) return false;
+        
+        prog->value = out->result;
+        prog->count++;
+    }
+    return true;
+}
+
+// Batch kernels. Arithmetic wraps like the native code does; each loop is a
+// plain element-wise pass so the compiler can vectorize it. Division by zero
+// yields 0 and INT64_MIN / -1 wraps, where the JIT and the NASM output trap
+// on idiv: one bad row must not abort a whole batch.
+static inline int64_t wrap_add(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static inline int64_t wrap_sub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static inline int64_t wrap_mul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+
+static inline int64_t safe_div(int64_t a, int64_t b) {
+    if (b == 0) return 0;
+    if (b == -1) return wrap_sub(0, a);
+    return a / b;
+}
+
+static void batch_column_op(char op, const int64_t* a, const int64_t* b, int64_t* d, size_t n) {
+    switch (op) {
+        case '+': for (size_t k = 0; k < n; k++) d[k] = wrap_add(a[k], b[k]); break;
+        case '-': for (size_t k = 0; k < n; k++) d[k] = wrap_sub(a[k], b[k]); break;
+        case '*': for (size_t k = 0; k < n; k++) d[k] = wrap_mul(a[k], b[k]); break;
+        case '/': for (size_t k = 0; k < n; k++) d[k] = safe_div(a[k], b[k]); break;
+    }
+}
+
+static void batch_scalar_op(char op, const int64_t* a, int64_t c, int64_t* d, size_t n) {
+    switch (op) {
+        case '+': for (size_t k = 0; k < n; k++) d[k] = wrap_add(a[k], c); break;
+        case '-': for (size_t k = 0; k < n; k++) d[k] = wrap_sub(a[k], c); break;
+        case '*': for (size_t k = 0; k < n; k++) d[k] = wrap_mul(a[k], c); break;
+        case '/':
+            if (c == 0 || c == -1) {
+                for (size_t k = 0; k < n; k++) d[k] = safe_div(a[k], c);
+            } else {
+                for (size_t k = 0; k < n; k++) d[k] = a[k] / c;
+            }
+            break;
+    }
+}
+
+static int64_t* batch_slot(const Operand* operand, int64_t* const columns[], int64_t* temps, size_t offset) {
+    if (operand->kind == OPERAND_VAR) return columns[operand->value] + offset;
+    return temps + (size_t)operand->value * TAC_BATCH_SIZE;
+}
+
+// Evaluate the program over `rows` rows of columnar input. columns[i] holds
+// the values of variable slot i; assignments to variables write back into
+// their column. The program value for each row is stored in out[row].
+// Every instruction runs over a whole block of TAC_BATCH_SIZE rows before
+// the next one starts.
+bool eval_tac_batch(const TACProgram* prog, int64_t* const columns[], int64_t* out, size_t rows) {
+    if (prog->value.kind == OPERAND_NONE) return false;
+    
+    // One block per temporary plus one scratch block for broadcast literals
+    size_t slots = (size_t)prog->temp_count + 1;
+    int64_t* temps = malloc(slots * TAC_BATCH_SIZE * sizeof(int64_t));
+    if (temps == NULL) return false;
+    int64_t* broadcast = temps + (size_t)prog->temp_count * TAC_BATCH_SIZE;
+    
+    for (size_t offset = 0; offset < rows; offset += TAC_BATCH_SIZE) {
+        size_t n = rows - offset < TAC_BATCH_SIZE ? rows - offset : TAC_BATCH_SIZE;
+        
+        for (int i = 0; i < prog->count; i++) {
+            const ResolvedTAC* instr = &prog->code[i];
+            int64_t* d = batch_slot(&instr->result, columns, temps, offset);
+            
+            const int64_t* a;
+            if (instr->arg1.kind == OPERAND_CONST) {
+                int64_t c = instr->arg1.value;
+                int64_t* fill = (instr->op == '=') ? d : broadcast;
+                for (size_t k = 0; k < n; k++) fill[k] = c;
+                if (instr->op == '=') continue;
+                a = broadcast;
+            } else {
+                a = batch_slot(&instr->arg1, columns, temps, offset);
+            }
+            
+            if (instr->op == '=') {
+                if (d != a) memmove(d, a, n * sizeof(int64_t));
+            } else if (instr->arg2.kind == OPERAND_CONST) {
+                batch_scalar_op(instr->op, a, instr->arg2.value, d, n);
+            } else {
+                batch_column_op(instr->op, a, batch_slot(&instr->arg2, columns, temps, offset), d, n);
+            }
+        }
+        
+        if (prog->value.kind == OPERAND_CONST) {
+            for (size_t k = 0; k < n; k++) out[offset + k] = prog->value.value;
         } else {
-            printf("%s = %s %s %s\n", instr->result, instr->arg1, instr->op, instr->arg2);
+            memcpy(out + offset, batch_slot(&prog->value, columns, temps, offset), n * sizeof(int64_t));
         }
     }
+    
+    free(temps);
+    return true;
 }
@@ -2,9 +2,11 @@
 #define CODEGEN_H
 
 #include "compiler.h"
+#include <stdint.h>
 
 #define MAX_CODE_LINES 500
 #define MAX_TEMPS 100
+#define TAC_BATCH_SIZE 1024
 
 // Three-address code instruction
 typedef struct {
@@ -22,13 +24,90 @@ typedef struct {
     int label_count;
 } CodeGenerator;
 
+// Operand of a lowered TAC instruction. `value` is the slot index for
+// variables and temporaries, or the literal itself for constants.
+typedef enum {
+    OPERAND_NONE,
+    OPERAND_VAR,
+    OPERAND_TEMP,
+    OPERAND_CONST
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int64_t value;
+} Operand;
+
+typedef struct {
+    char op;        // '=', '+', '-', '*' or '/'
+    Operand arg1;
+    Operand arg2;
+    Operand result;
+} ResolvedTAC;
+
+// TAC with names resolved to variable slots, temporary slots and literals.
+// Variables are numbered in order of first appearance.
+typedef struct {
+    ResolvedTAC code[MAX_CODE_LINES];
+    int count;
+    char variables[MAX_SYMBOLS][MAX_TOKEN_LEN];
+    int var_count;
+    int temp_count;
+    Operand value;  // operand holding the value of the whole program
+} TACProgram;
+
+// PC-relative reference from code to data section offset `addend + 4`
+typedef struct {
+    size_t offset;
+    int64_t addend;
+} X86Reloc;
+
+// x86-64 machine code under construction
+typedef struct {
+    unsigned char* bytes;
+    size_t len;
+    size_t cap;
+    X86Reloc* relocs;
+    int reloc_count;
+    int reloc_cap;
+    bool failed;
+} X86Code;
+
+// Natively compiled TAC program. The function reads (and, for assignments
+// to variables, writes) vars[i] for every TACProgram variable slot i.
+typedef int64_t (*JitFunction)(int64_t* vars);
+
+typedef struct {
+    void* memory;
+    size_t size;
+    JitFunction function;
+} JitCode;
+
 // Function declarations
 void init_codegen();
 char* new_temp();
+bool is_temp_name(const char* name);
 char* new_label();
 void emit(const char* op, const char* arg1, const char* arg2, const char* result);
-void generate_code_from_tokens();
+bool generate_code_from_tree(ParseTree* tree);
 char* generate_assembly();
+void emit_assembly(OutputBuffer* out);
+bool write_assembly_file(const char* path);
+const CodeGenerator* get_code_generator();
+void format_tac(OutputBuffer* out);
 void print_tac();
+bool lower_tac(TACProgram* prog);
+bool eval_tac_batch(const TACProgram* prog, int64_t* const columns[], int64_t* out, size_t rows);
+
+// x86-64 encoder and JIT
+void x86_code_init(X86Code* code);
+void x86_code_free(X86Code* code);
+bool encode_tac_x86(const TACProgram* prog, X86Code* code);
+bool encode_tac_x86_object(const TACProgram* prog, X86Code* code, bool with_start, size_t* start_offset);
+bool jit_compile(const TACProgram* prog, JitCode* jit);
+void jit_release(JitCode* jit);
+
+// ELF64 relocatable object output
+bool write_elf_object(const char* path, const TACProgram* prog, bool with_start);
 
 #endif // CODEGEN_H
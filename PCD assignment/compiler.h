@@ -6,13 +6,17 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define MAX_TOKEN_LEN 100
 #define MAX_TOKENS 1000
 #define MAX_PRODUCTIONS 50
 #define MAX_SYMBOLS 50
-#define MAX_STACK 100
 #define MAX_STATES 100
+#define MAX_LR_ITEMS 200
+
+// Starting value for hash_bytes (64-bit FNV-1a)
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
 
 // Token types
 typedef enum {
@@ -39,6 +43,23 @@ typedef struct {
     int column;
 } Token;
 
+// Token of a whole-input lex (lex_all_tokens). The lexeme stays in the
+// input, `length` bytes at `offset`, so a span is a fifth of a Token.
+typedef struct {
+    CompilerTokenType type;
+    int length;
+    int line;
+    int column;
+    size_t offset;
+} TokenSpan;
+
+// Growable span array; keeps its capacity across lex_all_tokens calls
+typedef struct {
+    TokenSpan* spans;
+    size_t count;
+    size_t cap;
+} TokenSpanList;
+
 // Production rule structure
 typedef struct {
     char lhs[MAX_TOKEN_LEN];
@@ -46,6 +67,22 @@ typedef struct {
     int rhs_count;
 } Production;
 
+// Yacc-style operator precedence, from "%left + -" lines and the like.
+// Each line is one level, later lines binding tighter; a production takes
+// the precedence of its last terminal. The LR table builder settles
+// shift/reduce conflicts with them.
+typedef enum {
+    ASSOC_LEFT,
+    ASSOC_RIGHT,
+    ASSOC_NONASSOC
+} Associativity;
+
+typedef struct {
+    char terminal[MAX_TOKEN_LEN];
+    int level;              // 1 for the first declaration line
+    Associativity assoc;
+} PrecedenceDecl;
+
 // Grammar structure
 typedef struct {
     Production productions[MAX_PRODUCTIONS];
@@ -55,6 +92,8 @@ typedef struct {
     int terminal_count;
     char non_terminals[MAX_SYMBOLS][MAX_TOKEN_LEN];
     int non_terminal_count;
+    PrecedenceDecl precedence[MAX_SYMBOLS];
+    int precedence_count;
 } Grammar;
 
 // First and Follow sets
@@ -81,7 +120,7 @@ typedef struct {
 
 // LR State
 typedef struct {
-    LRItem items[MAX_PRODUCTIONS];
+    LRItem items[MAX_LR_ITEMS];
     int item_count;
 } LRState;
 
@@ -99,11 +138,336 @@ typedef struct {
     int state;  // for shift, or production number for reduce
 } LRTableEntry;
 
+// Parse tree node. Nodes are stored in preorder in one contiguous pool, so
+// the first child of node n is n + 1 and each following sibling starts
+// `size` nodes after the previous one.
+typedef struct {
+    int symbol;         // grammar symbol id (see symbol_id)
+    int production;     // production index for interior nodes, -1 for leaves
+    int token;          // index into ParseTree.tokens for leaves, -1 otherwise
+    int child_count;
+    int size;           // number of nodes in this subtree, including itself
+} ParseNode;
+
+// Node as created by a parser, before preorder layout
+typedef struct {
+    int symbol;
+    int production;
+    int token;
+    int first_link;     // children are links[first_link .. first_link + child_count)
+    int child_count;
+} ParseBuildNode;
+
+// Parse tree in a flat node pool. All arrays grow geometrically and keep
+// their capacity across parse_tree_reset, so repeated parses allocate
+// nothing per node.
+typedef struct {
+    ParseNode* nodes;
+    int node_count;
+    int node_cap;
+    Token* tokens;
+    int token_count;
+    int token_cap;
+    ParseBuildNode* build;
+    int build_count;
+    int build_cap;
+    int* links;
+    int link_count;
+    int link_cap;
+    int* stack;         // walk scratch for parse_tree_finish and codegen
+    int stack_cap;
+    bool failed;
+} ParseTree;
+
+// Shared packed parse forest built by the GLR parser. A forest node is a
+// grammar symbol spanning input tokens [start, end); a terminal node refers
+// to its token, and a non-terminal node has a list of packed nodes, one per
+// distinct way of deriving it. Packed nodes list their children as forest
+// node indexes in `children`. Sub-derivations common to several parses are
+// stored once, so an ambiguous input does not multiply the forest.
+typedef struct {
+    int symbol;
+    int start;
+    int end;
+    int token;          // index into ParseForest.tokens for terminals, -1 otherwise
+    int packed;         // first packed node, -1 for terminals
+} ForestNode;
+
+typedef struct {
+    int production;
+    int first_child;    // children[first_child .. first_child + child_count)
+    int child_count;
+    int next;           // next packed node of the same forest node, -1 at the end
+} ForestPacked;
+
+// Arrays grow geometrically and keep their capacity across
+// parse_forest_reset, like ParseTree
+typedef struct {
+    ForestNode* nodes;
+    int node_count;
+    int node_cap;
+    ForestPacked* packed;
+    int packed_count;
+    int packed_cap;
+    int* children;
+    int child_count;
+    int child_cap;
+    Token* tokens;
+    int token_count;
+    int token_cap;
+    int root;           // -1 until a parse succeeds
+    bool failed;
+} ParseForest;
+
+// Parser stack of integer ids: grammar symbol ids for the LL parser, states
+// for the LR parser. The parse tree node of each entry is kept in a parallel
+// array so a reduction's children are contiguous. Both arrays grow
+// geometrically and keep their capacity, so nesting depth is bounded only
+// by memory.
+typedef struct {
+    int* ids;
+    int* nodes;     // parse tree node per entry, -1 when no tree is built
+    int top;
+    int cap;
+} ParseStack;
+
+// Growable output buffer with an explicit write cursor. When a FILE* or a
+// file descriptor sink is attached, pending bytes are flushed once they pass
+// OUTBUF_FLUSH_THRESHOLD instead of growing the buffer further.
+#define OUTBUF_INITIAL_CAPACITY 4096
+#define OUTBUF_FLUSH_THRESHOLD (64 * 1024)
+
+typedef struct {
+    char* data;
+    size_t len;     // write cursor
+    size_t cap;
+    FILE* file;     // optional FILE* sink
+    int fd;         // optional descriptor sink, -1 when unused
+    bool failed;    // set on allocation or write failure
+} OutputBuffer;
+
+// Parser trace events. The parsers emit one compact record per step
+// through a TraceSink; turning them into text is left to the consumer
+// (see format_parse_trace). A NULL sink disables tracing entirely.
+typedef enum {
+    TRACE_LL,
+    TRACE_LR
+} TraceParser;
+
+typedef enum {
+    TRACE_MATCH,        // LL: terminal on top of the stack matched
+    TRACE_EXPAND,       // LL: non-terminal replaced by a production
+    TRACE_SHIFT,        // LR: lookahead shifted, state pushed
+    TRACE_REDUCE,       // LR: production reduced, GOTO state pushed
+    TRACE_ACCEPT,
+    TRACE_ERROR,
+    TRACE_RECOVER       // after an ERROR: symbol popped or pushed, or -1 when a token was skipped
+} TraceAction;
+
+typedef enum {
+    TRACE_ERROR_NONE,
+    TRACE_ERROR_UNEXPECTED,     // input left after the stack emptied / no action
+    TRACE_ERROR_MISMATCH,       // LL: terminal on the stack differs from input
+    TRACE_ERROR_NO_PRODUCTION,  // LL: empty table cell
+    TRACE_ERROR_NO_GOTO,        // LR: empty GOTO cell
+    TRACE_ERROR_OVERFLOW,       // parse stack full
+    TRACE_ERROR_LEFT_RECURSION, // LL: table cell expands back to itself without input
+    TRACE_ERROR_STACK_EMPTY
+} TraceError;
+
+typedef struct {
+    int step;
+    unsigned char parser;       // TraceParser
+    unsigned char action;       // TraceAction
+    unsigned char error;        // TraceError, for TRACE_ERROR
+    int production;             // EXPAND/REDUCE, -1 otherwise
+    int state;                  // LR state pushed or current, -1 for LL
+    int symbol;                 // symbol id the action applies to
+    int token;                  // index of the lookahead token in the input
+    int depth;                  // RECOVER: stack depth after recovering
+} TraceEvent;
+
+typedef struct TraceSink {
+    void (*emit)(struct TraceSink* sink, const TraceEvent* event);
+} TraceSink;
+
+// Sink that records events in a growable array for later replay
+typedef struct {
+    TraceSink sink;     // must stay first: pass &log.sink to the parsers
+    TraceEvent* events;
+    int count;
+    int cap;
+    bool failed;
+} TraceLog;
+
+// Synthetic grammar generator. LL1 grammars are LL(1) by construction and
+// LALR1 grammars are SLR(1) expression grammars; the same seed always
+// yields the same grammar.
+typedef enum {
+    GRAMMAR_SHAPE_LL1,
+    GRAMMAR_SHAPE_LALR1
+} GrammarShape;
+
+typedef struct {
+    GrammarShape shape;
+    int non_terminals;      // clamped to MAX_SYMBOLS
+    int productions;        // clamped to MAX_PRODUCTIONS
+    int max_rhs;            // longest alternative (LL1)
+    int epsilon_percent;    // chance of an ε alternative per non-terminal
+    int recursion_percent;  // chance an extra alternative recurses
+    uint64_t seed;
+} GrammarGenOptions;
+
+// Hot-path counters and per-phase timers. Always compiled in: counters are
+// plain increments and timers are read only at phase boundaries, never per
+// token. Counters are per thread and accumulate until reset_compiler_stats().
+typedef enum {
+    PHASE_LEX,
+    PHASE_FIRST,
+    PHASE_FOLLOW,
+    PHASE_LL_TABLE,
+    PHASE_LR_TABLE,
+    PHASE_LL_PARSE,     // includes the lexing it drives
+    PHASE_LR_PARSE,     // includes the lexing it drives
+    PHASE_GLR_PARSE,    // includes the lexing it drives
+    PHASE_PRATT_PARSE,  // includes the lexing it drives
+    PHASE_CODEGEN,
+    PHASE_ASSEMBLY,
+    PHASE_COUNT
+} CompilerPhase;
+
+typedef struct {
+    uint64_t tokens;
+    uint64_t bytes_scanned;
+    uint64_t first_iterations;
+    uint64_t follow_iterations;
+    uint64_t ll_lookups;
+    uint64_t expansions;
+    uint64_t matches;
+    int ll_max_depth;
+    uint64_t lr_lookups;
+    uint64_t shifts;
+    uint64_t reduces;
+    int lr_max_depth;
+    uint64_t pratt_reduces;
+    int pratt_max_depth;
+    uint64_t tac_emitted;
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t phase_cycles[PHASE_COUNT];     // 0 where no cycle counter exists
+    uint64_t phase_calls[PHASE_COUNT];
+} CompilerStats;
+
+typedef struct {
+    uint64_t ns;
+    uint64_t cycles;
+} PhaseTimer;
+
+extern _Thread_local CompilerStats compiler_stats;
+
+// Syntax errors found by the last parse on this thread. The parsers recover
+// and keep going, so one pass reports every error; only the first
+// MAX_DIAGNOSTICS are kept, but all are counted.
+#define MAX_DIAGNOSTICS 100
+#define MAX_DIAGNOSTIC_LEN 160
+
+typedef struct {
+    int line;
+    int column;
+    char message[MAX_DIAGNOSTIC_LEN];
+} Diagnostic;
+
+typedef struct {
+    Diagnostic items[MAX_DIAGNOSTICS];
+    int count;      // kept in items
+    int total;      // reported, including those past MAX_DIAGNOSTICS
+} DiagnosticList;
+
+// One compile of a source text (pipeline.c), shared by the command-line
+// driver and the compile server. Phases are a bit mask.
+enum {
+    COMPILE_LEX = 1 << 0,
+    COMPILE_LL  = 1 << 1,
+    COMPILE_LR  = 1 << 2,
+    COMPILE_TAC = 1 << 3,
+    COMPILE_ASM = 1 << 4,
+    COMPILE_OBJ = 1 << 5,
+    COMPILE_GLR = 1 << 6,   // generalized LR; code is then generated from its first derivation
+    COMPILE_PRATT = 1 << 7  // Pratt parser; code is then generated from its tree
+};
+
+// Phases that need the LR parse tree and generated code
+#define COMPILE_CODEGEN (COMPILE_TAC | COMPILE_ASM | COMPILE_OBJ)
+
+typedef enum {
+    COMPILE_TRACE_NONE,     // results only through the status
+    COMPILE_TRACE_SUMMARY,  // one ACCEPTED/REJECTED line per parser
+    COMPILE_TRACE_STEPS     // full STACK / INPUT / ACTION traces
+} CompileTrace;
+
+// Ordered by severity: the worst status over several inputs is the max
+typedef enum {
+    COMPILE_OK,
+    COMPILE_REJECTED,
+    COMPILE_ERROR
+} CompileStatus;
+
+// Scratch space reused across compiles; one per thread. compile_cached
+// leaves the compile's text output and assembly in `output`/`assembly`.
+typedef struct {
+    ParseTree tree;
+    ParseForest forest;
+    TraceLog trace;
+    OutputBuffer output;
+    OutputBuffer assembly;
+} CompileContext;
+
+// Content-addressed cache of compile results (cache.c), in front of the
+// whole lex -> parse -> codegen pipeline. Entries are keyed by the grammar
+// hash and a hash of the request: input text, phases, trace level and, when
+// summary lines name the input, that name. The request itself is stored and
+// compared on lookup, so a hash collision is a miss, never a wrong result.
+// A bounded LRU lives in memory; with a directory set, entries are also
+// written to and read back from disk. The disk store is never pruned: it
+// grows by one file per distinct request until the directory is cleared.
+// All functions are thread-safe.
+typedef struct CacheEntry CacheEntry;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t disk_hits;     // misses in memory answered from disk
+    uint64_t disk_writes;
+    uint64_t evictions;
+    int entries;
+    size_t bytes;
+} CacheStats;
+
+typedef struct {
+    CacheEntry** buckets;
+    int bucket_count;       // power of two
+    CacheEntry* newest;     // LRU list, most recently used first
+    CacheEntry* oldest;
+    int max_entries;
+    size_t max_bytes;
+    char* disk_dir;         // NULL for memory only
+    unsigned temp_serial;   // names this process's temporary files
+    CacheStats stats;
+    void* lock;
+} CompileCache;
+
+#define CACHE_DEFAULT_ENTRIES 1024
+#define CACHE_DEFAULT_BYTES (64 * 1024 * 1024)
+
 // Function declarations for Lexer
 void init_lexer(const char* input);
 Token get_next_token();
 Token peek_token();
 const char* token_type_to_string(CompilerTokenType type);
+void span_list_init(TokenSpanList* list);
+void span_list_free(TokenSpanList* list);
+bool lex_all_tokens(const char* input, int threads, TokenSpanList* out);
+Token token_from_span(const char* input, const TokenSpan* span);
+void format_tokens(OutputBuffer* out);
 void print_tokens();
 
 // Function declarations for LL Parser
@@ -112,20 +476,152 @@ void compute_first_sets(Grammar* g, FirstFollowSet first_sets[]);
 void compute_follow_sets(Grammar* g, FirstFollowSet first_sets[], FirstFollowSet follow_sets[]);
 void build_ll_table(Grammar* g, FirstFollowSet first_sets[], FirstFollowSet follow_sets[]);
 bool parse_ll(const char* input);
+bool parse_ll_tree(const char* input, ParseTree* tree, TraceSink* trace);
 void print_first_follow_sets(FirstFollowSet sets[], int count);
 int get_ll_table_size();
+Grammar* get_ll_grammar();
+void print_ll_grammar();
 
 // Function declarations for LR Parser
 void init_lr_parser(Grammar* g);
 void build_lr_items(Grammar* g);
 void build_lr_table(Grammar* g);
+bool construct_lr_table();
+void set_lr_table_compression(bool enabled);
+void set_lr_lazy_construction(bool enabled);
 bool parse_lr(const char* input);
+bool parse_lr_tree(const char* input, ParseTree* tree, TraceSink* trace);
+void free_lr_stack();
+bool parse_glr(const char* input, ParseForest* forest);
 void print_lr_table();
 
+// Function declarations for the Pratt parser
+bool build_pratt_table(Grammar* g);
+bool parse_pratt(const char* input);
+bool parse_pratt_tree(const char* input, ParseTree* tree);
+void free_pratt_stack();
+void print_pratt_table();
+
 // Utility functions
 void print_grammar(Grammar* g);
 void load_sample_grammar(Grammar* g, int choice);
+bool load_grammar_file(Grammar* g, const char* path, char* error, size_t error_size);
+char* read_text_file(const char* path, size_t* length);
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t n);
+uint64_t hash_string(uint64_t hash, const char* s);
+uint64_t grammar_hash(const Grammar* g);
 bool is_terminal(const char* symbol, Grammar* g);
 bool is_non_terminal(const char* symbol, Grammar* g);
+int symbol_id(const char* symbol, Grammar* g);
+const char* symbol_name(int id, Grammar* g);
+const char* terminal_for_token(const Token* token, Grammar* g);
+const PrecedenceDecl* find_precedence(const Grammar* g, const char* terminal);
+
+// Parse tree functions
+bool grow_array(bool* failed, void** array, int* cap, int needed, size_t size);
+void parse_tree_init(ParseTree* tree);
+void parse_tree_reset(ParseTree* tree);
+void parse_tree_free(ParseTree* tree);
+int parse_tree_add_leaf(ParseTree* tree, int symbol, const Token* token);
+int parse_tree_add_node(ParseTree* tree, int symbol, int production);
+void parse_tree_set_token(ParseTree* tree, int node, const Token* token);
+void parse_tree_set_children(ParseTree* tree, int node, const int* children, int count);
+bool parse_tree_finish(ParseTree* tree, int root);
+void print_parse_tree(const ParseTree* tree, Grammar* g);
+bool parse_stack_reserve(ParseStack* stack, int needed);
+void parse_stack_free(ParseStack* stack);
+void parse_forest_init(ParseForest* forest);
+void parse_forest_reset(ParseForest* forest);
+void parse_forest_free(ParseForest* forest);
+int forest_add_token(ParseForest* forest, int symbol, const Token* token, int position);
+int forest_add_node(ParseForest* forest, int symbol, int start, int end);
+bool forest_add_packed(ParseForest* forest, int node, int production, const int* children, int count);
+uint64_t count_derivations(const ParseForest* forest);
+bool forest_to_tree(const ParseForest* forest, ParseTree* tree);
+void format_parse_forest(OutputBuffer* out, const ParseForest* forest, Grammar* g);
+void print_parse_forest(const ParseForest* forest, Grammar* g);
+
+// Output buffer functions
+void outbuf_init(OutputBuffer* ob);
+void outbuf_init_file(OutputBuffer* ob, FILE* file);
+void outbuf_init_fd(OutputBuffer* ob, int fd);
+void outbuf_reset(OutputBuffer* ob);
+void outbuf_free(OutputBuffer* ob);
+void outbuf_write(OutputBuffer* ob, const char* data, size_t n);
+void outbuf_puts(OutputBuffer* ob, const char* s);
+void outbuf_printf(OutputBuffer* ob, const char* fmt, ...);
+bool outbuf_flush(OutputBuffer* ob);
+const char* outbuf_cstr(OutputBuffer* ob);
+
+// Grammar and sentence generator functions
+void grammar_gen_defaults(GrammarGenOptions* opt);
+bool generate_grammar(Grammar* g, const GrammarGenOptions* opt);
+int generate_sentence(Grammar* g, int target_tokens, int max_depth, uint64_t* seed, OutputBuffer* out);
+
+// Grammar rewriting for the LL parser
+int transform_for_ll(const Grammar* in, Grammar* out, int origin[]);
+
+// Statistics functions
+void reset_compiler_stats();
+const CompilerStats* get_compiler_stats();
+void add_compiler_stats(const CompilerStats* other);
+const char* phase_name(CompilerPhase phase);
+uint64_t stats_now_ns();
+uint64_t stats_now_cycles();
+PhaseTimer phase_begin();
+void phase_end(CompilerPhase phase, PhaseTimer timer);
+void print_compiler_stats();
+
+// Compile pipeline functions. The grammar's LL and LR tables must already
+// be built for the phases requested.
+void compile_context_init(CompileContext* ctx);
+void compile_context_free(CompileContext* ctx);
+CompileStatus compile_source(Grammar* g, const char* name, const char* text, int phases,
+                             CompileTrace trace, CompileContext* ctx, OutputBuffer* out);
+CompileStatus compile_cached(CompileCache* cache, Grammar* g, uint64_t grammar_hash, const char* name,
+                             const char* text, int phases, CompileTrace trace, CompileContext* ctx);
+CompileStatus compile_statements(const char* name, const char* text, int phases, CompileTrace trace,
+                                 int threads, OutputBuffer* out);
+
+// Result cache functions
+bool cache_init(CompileCache* cache, int max_entries, size_t max_bytes, const char* disk_dir);
+void cache_free(CompileCache* cache);
+bool cache_lookup(CompileCache* cache, uint64_t grammar_hash, const char* name, const char* text,
+                  int phases, CompileTrace trace, OutputBuffer* output, OutputBuffer* assembly,
+                  CompileStatus* status);
+void cache_store(CompileCache* cache, uint64_t grammar_hash, const char* name, const char* text,
+                 int phases, CompileTrace trace, CompileStatus status,
+                 const OutputBuffer* output, const OutputBuffer* assembly);
+CacheStats cache_get_stats(CompileCache* cache);
+void print_cache_stats(CompileCache* cache);
+
+// Command-line driver (cli.c)
+int run_cli(int argc, char* argv[]);
+
+// Compile server (server.c). Messages are framed as a 4-byte big-endian
+// length and a body: phase mask, trace level and source text for a request;
+// CompileStatus byte and output text for a reply.
+#define SERVER_MAX_MESSAGE (16 * 1024 * 1024)
+int run_server(Grammar* g, CompileCache* cache, const char* socket_path, int threads);
+int server_connect(const char* socket_path);
+bool server_request(int fd, int phases, CompileTrace trace, const char* text,
+                    OutputBuffer* reply, CompileStatus* status);
+void server_disconnect(int fd);
+
+// Diagnostic functions (diagnostics.c)
+void reset_diagnostics();
+const DiagnosticList* get_diagnostics();
+void add_diagnostic(const Token* token, const char* fmt, ...);
+const char* describe_token(const Token* token);
+void format_expected(char* buffer, size_t size, const char* const* terminals, int count);
+void format_diagnostics(OutputBuffer* out, const char* name);
+void print_diagnostics();
+
+// Parse trace functions
+void trace_log_init(TraceLog* log);
+void trace_log_reset(TraceLog* log);
+void trace_log_free(TraceLog* log);
+void format_parse_trace(OutputBuffer* out, const TraceLog* log, Grammar* g, const char* input);
+void print_parse_trace(const TraceLog* log, Grammar* g, const char* input);
 
 #endif // COMPILER_H
@@ -0,0 +1,82 @@
+#include "compiler.h"
+#include <stdarg.h>
+
+static _Thread_local DiagnosticList diagnostics;
+
+void reset_diagnostics() {
+    diagnostics.count = 0;
+    diagnostics.total = 0;
+}
+
+const DiagnosticList* get_diagnostics() {
+    return &diagnostics;
+}
+
+// Record an error at `token`'s position. Past MAX_DIAGNOSTICS the error is
+// only counted.
+void add_diagnostic(const Token* token, const char* fmt, ...) {
+    diagnostics.total++;
+    if (diagnostics.count >= MAX_DIAGNOSTICS) return;
+    
+    Diagnostic* d = &diagnostics.items[diagnostics.count++];
+    d->line = token->line;
+    d->column = token->column;
+    
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(d->message, sizeof(d->message), fmt, args);
+    va_end(args);
+}
+
+// "'lexeme'", or "end of input" at EOF. The result is overwritten by the
+// next call on the same thread.
+const char* describe_token(const Token* token) {
+    static _Thread_local char text[MAX_TOKEN_LEN + 2];
+    if (token->type == TOKEN_EOF) return "end of input";
+    snprintf(text, sizeof(text), "'%s'", token->lexeme);
+    return text;
+}
+
+// "'a', 'b' or end of input" for the terminals a parser could have used
+void format_expected(char* buffer, size_t size, const char* const* terminals, int count) {
+    size_t len = 0;
+    buffer[0] = '\0';
+    
+    for (int i = 0; i < count && len < size; i++) {
+        const char* separator = i == 0 ? "" : (i == count - 1 ? " or " : ", ");
+        int n;
+        if (strcmp(terminals[i], "$") == 0) {
+            n = snprintf(buffer + len, size - len, "%send of input", separator);
+        } else {
+            n = snprintf(buffer + len, size - len, "%s'%s'", separator, terminals[i]);
+        }
+        if (n < 0) break;
+        len += (size_t)n;
+    }
+}
+
+// One "name:line:column: error: message" line per diagnostic; `name` may
+// be NULL
+void format_diagnostics(OutputBuffer* out, const char* name) {
+    for (int i = 0; i < diagnostics.count; i++) {
+        const Diagnostic* d = &diagnostics.items[i];
+        if (name) outbuf_printf(out, "%s:", name);
+        outbuf_printf(out, "%d:%d: error: %s\n", d->line, d->column, d->message);
+    }
+    if (diagnostics.total > diagnostics.count) {
+        if (name) outbuf_printf(out, "%s: ", name);
+        outbuf_printf(out, "%d more errors not shown\n", diagnostics.total - diagnostics.count);
+    }
+}
+
+void print_diagnostics() {
+    if (diagnostics.total == 0) return;
+    
+    OutputBuffer out;
+    fflush(stdout);
+    outbuf_init_file(&out, stdout);
+    outbuf_printf(&out, "\n=== SYNTAX ERRORS (%d) ===\n", diagnostics.total);
+    format_diagnostics(&out, NULL);
+    outbuf_flush(&out);
+    outbuf_free(&out);
+}
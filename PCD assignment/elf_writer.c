@@ -0,0 +1,272 @@
+#include "codegen.h"
+
+// ELF64 constants used by the writer
+#define ELF_HEADER_SIZE 64
+#define ELF_SECTION_HEADER_SIZE 64
+#define ELF_SYMBOL_SIZE 24
+#define ELF_RELA_SIZE 24
+
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+
+#define SHF_WRITE 0x1
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_INFO_LINK 0x40
+
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define STT_SECTION 3
+
+#define R_X86_64_PC32 2
+
+// Section indices in the order the headers are written
+enum {
+    SEC_NULL,
+    SEC_TEXT,
+    SEC_DATA,
+    SEC_SYMTAB,
+    SEC_STRTAB,
+    SEC_RELA_TEXT,
+    SEC_NOTE_STACK,
+    SEC_SHSTRTAB,
+    SEC_COUNT
+};
+
+// Symbol index of the .data section symbol that relocations refer to
+#define SYM_DATA_SECTION 2
+
+typedef struct {
+    uint32_t name;
+    unsigned char info;
+    uint16_t shndx;
+    uint64_t value;
+    uint64_t size;
+} ElfSymbol;
+
+typedef struct {
+    ElfSymbol symbols[MAX_SYMBOLS + MAX_TEMPS + 8];
+    int symbol_count;
+    OutputBuffer strtab;
+} SymbolTable;
+
+static void put_u8(OutputBuffer* out, unsigned char value) {
+    outbuf_write(out, (const char*)&value, 1);
+}
+
+static void put_u16(OutputBuffer* out, uint16_t value) {
+    unsigned char bytes[2] = { (unsigned char)value, (unsigned char)(value >> 8) };
+    outbuf_write(out, (const char*)bytes, 2);
+}
+
+static void put_u32(OutputBuffer* out, uint32_t value) {
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; i++) bytes[i] = (unsigned char)(value >> (8 * i));
+    outbuf_write(out, (const char*)bytes, 4);
+}
+
+static void put_u64(OutputBuffer* out, uint64_t value) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = (unsigned char)(value >> (8 * i));
+    outbuf_write(out, (const char*)bytes, 8);
+}
+
+static void put_padding(OutputBuffer* out, size_t count) {
+    static const char zeros[16] = {0};
+    while (count > 0) {
+        size_t n = count < sizeof(zeros) ? count : sizeof(zeros);
+        outbuf_write(out, zeros, n);
+        count -= n;
+    }
+}
+
+static inline size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Append a NUL-terminated name to a string table and return its offset
+static uint32_t add_string(OutputBuffer* table, const char* name) {
+    uint32_t offset = (uint32_t)table->len;
+    outbuf_write(table, name, strlen(name) + 1);
+    return offset;
+}
+
+static void add_symbol(SymbolTable* table, const char* name, int binding, int type,
+                       int shndx, uint64_t value, uint64_t size) {
+    ElfSymbol* sym = &table->symbols[table->symbol_count++];
+    sym->name = name ? add_string(&table->strtab, name) : 0;
+    sym->info = (unsigned char)((binding << 4) | type);
+    sym->shndx = (uint16_t)shndx;
+    sym->value = value;
+    sym->size = size;
+}
+
+static void put_section_header(OutputBuffer* out, uint32_t name, uint32_t type, uint64_t flags,
+                               uint64_t offset, uint64_t size, uint32_t link, uint32_t info,
+                               uint64_t alignment, uint64_t entsize) {
+    put_u32(out, name);
+    put_u32(out, type);
+    put_u64(out, flags);
+    put_u64(out, 0);  // sh_addr
+    put_u64(out, offset);
+    put_u64(out, size);
+    put_u32(out, link);
+    put_u32(out, info);
+    put_u64(out, alignment);
+    put_u64(out, entsize);
+}
+
+// Write the program as an ELF64 relocatable object for x86-64 Linux.
+// .text holds `expr_eval` (and `_start` when requested), .data holds one
+// 8-byte slot per variable followed by the temporaries. Variables are
+// exported as global symbols, so C code can declare them `extern int64_t`,
+// and every data access is an R_X86_64_PC32 relocation against .data.
+bool write_elf_object(const char* path, const TACProgram* prog, bool with_start) {
+    X86Code code;
+    size_t start_offset = 0;
+    x86_code_init(&code);
+    if (!encode_tac_x86_object(prog, &code, with_start, &start_offset)) {
+        x86_code_free(&code);
+        return false;
+    }
+    
+    // Symbol table: null, section symbols and temporaries are local and
+    // must precede the globals. It lives on this call's stack (about 5 KB),
+    // so concurrent writers on different threads do not share it.
+    SymbolTable symtab;
+    symtab.symbol_count = 0;
+    outbuf_init(&symtab.strtab);
+    add_string(&symtab.strtab, "");
+    
+    add_symbol(&symtab, NULL, STB_LOCAL, 0, 0, 0, 0);
+    add_symbol(&symtab, NULL, STB_LOCAL, STT_SECTION, SEC_TEXT, 0, 0);
+    add_symbol(&symtab, NULL, STB_LOCAL, STT_SECTION, SEC_DATA, 0, 0);
+    for (int i = 0; i < prog->temp_count; i++) {
+        char name[20];
+        sprintf(name, "%%t%d", i);
+        add_symbol(&symtab, name, STB_LOCAL, STT_OBJECT, SEC_DATA, (uint64_t)(prog->var_count + i) * 8, 8);
+    }
+    int first_global = symtab.symbol_count;
+    
+    add_symbol(&symtab, "expr_eval", STB_GLOBAL, STT_FUNC, SEC_TEXT, 0,
+               with_start ? start_offset : code.len);
+    if (with_start) {
+        add_symbol(&symtab, "_start", STB_GLOBAL, STT_FUNC, SEC_TEXT, start_offset, code.len - start_offset);
+    }
+    for (int i = 0; i < prog->var_count; i++) {
+        add_symbol(&symtab, prog->variables[i], STB_GLOBAL, STT_OBJECT, SEC_DATA, (uint64_t)i * 8, 8);
+    }
+    
+    // Section name table
+    OutputBuffer shstrtab;
+    outbuf_init(&shstrtab);
+    uint32_t names[SEC_COUNT];
+    names[SEC_NULL] = add_string(&shstrtab, "");
+    names[SEC_TEXT] = add_string(&shstrtab, ".text");
+    names[SEC_DATA] = add_string(&shstrtab, ".data");
+    names[SEC_SYMTAB] = add_string(&shstrtab, ".symtab");
+    names[SEC_STRTAB] = add_string(&shstrtab, ".strtab");
+    names[SEC_RELA_TEXT] = add_string(&shstrtab, ".rela.text");
+    names[SEC_NOTE_STACK] = add_string(&shstrtab, ".note.GNU-stack");
+    names[SEC_SHSTRTAB] = add_string(&shstrtab, ".shstrtab");
+    
+    // File layout
+    size_t data_size = (size_t)(prog->var_count + prog->temp_count) * 8;
+    size_t symtab_size = (size_t)symtab.symbol_count * ELF_SYMBOL_SIZE;
+    size_t rela_size = (size_t)code.reloc_count * ELF_RELA_SIZE;
+    
+    size_t text_offset = ELF_HEADER_SIZE;
+    size_t data_offset = align_up(text_offset + code.len, 8);
+    size_t symtab_offset = align_up(data_offset + data_size, 8);
+    size_t strtab_offset = symtab_offset + symtab_size;
+    size_t rela_offset = align_up(strtab_offset + symtab.strtab.len, 8);
+    size_t shstrtab_offset = rela_offset + rela_size;
+    size_t shdr_offset = align_up(shstrtab_offset + shstrtab.len, 8);
+    
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        outbuf_free(&symtab.strtab);
+        outbuf_free(&shstrtab);
+        x86_code_free(&code);
+        return false;
+    }
+    
+    OutputBuffer out;
+    outbuf_init_file(&out, file);
+    
+    // ELF header
+    static const unsigned char ident[16] = { 0x7F, 'E', 'L', 'F', 2, 1, 1, 0 };
+    outbuf_write(&out, (const char*)ident, sizeof(ident));
+    put_u16(&out, 1);       // ET_REL
+    put_u16(&out, 62);      // EM_X86_64
+    put_u32(&out, 1);       // EV_CURRENT
+    put_u64(&out, 0);       // e_entry
+    put_u64(&out, 0);       // e_phoff
+    put_u64(&out, shdr_offset);
+    put_u32(&out, 0);       // e_flags
+    put_u16(&out, ELF_HEADER_SIZE);
+    put_u16(&out, 0);       // e_phentsize
+    put_u16(&out, 0);       // e_phnum
+    put_u16(&out, ELF_SECTION_HEADER_SIZE);
+    put_u16(&out, SEC_COUNT);
+    put_u16(&out, SEC_SHSTRTAB);
+    
+    // .text and .data
+    outbuf_write(&out, (const char*)code.bytes, code.len);
+    put_padding(&out, data_offset - (text_offset + code.len));
+    put_padding(&out, data_size);
+    put_padding(&out, symtab_offset - (data_offset + data_size));
+    
+    // .symtab and .strtab
+    for (int i = 0; i < symtab.symbol_count; i++) {
+        ElfSymbol* sym = &symtab.symbols[i];
+        put_u32(&out, sym->name);
+        put_u8(&out, sym->info);
+        put_u8(&out, 0);    // st_other
+        put_u16(&out, sym->shndx);
+        put_u64(&out, sym->value);
+        put_u64(&out, sym->size);
+    }
+    outbuf_write(&out, symtab.strtab.data, symtab.strtab.len);
+    put_padding(&out, rela_offset - (strtab_offset + symtab.strtab.len));
+    
+    // .rela.text
+    for (int i = 0; i < code.reloc_count; i++) {
+        put_u64(&out, code.relocs[i].offset);
+        put_u64(&out, ((uint64_t)SYM_DATA_SECTION << 32) | R_X86_64_PC32);
+        put_u64(&out, (uint64_t)code.relocs[i].addend);
+    }
+    
+    // .shstrtab and section headers
+    outbuf_write(&out, shstrtab.data, shstrtab.len);
+    put_padding(&out, shdr_offset - (shstrtab_offset + shstrtab.len));
+    
+    put_section_header(&out, names[SEC_NULL], 0, 0, 0, 0, 0, 0, 0, 0);
+    put_section_header(&out, names[SEC_TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR,
+                       text_offset, code.len, 0, 0, 16, 0);
+    put_section_header(&out, names[SEC_DATA], SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,
+                       data_offset, data_size, 0, 0, 8, 0);
+    put_section_header(&out, names[SEC_SYMTAB], SHT_SYMTAB, 0,
+                       symtab_offset, symtab_size, SEC_STRTAB, (uint32_t)first_global, 8, ELF_SYMBOL_SIZE);
+    put_section_header(&out, names[SEC_STRTAB], SHT_STRTAB, 0,
+                       strtab_offset, symtab.strtab.len, 0, 0, 1, 0);
+    put_section_header(&out, names[SEC_RELA_TEXT], SHT_RELA, SHF_INFO_LINK,
+                       rela_offset, rela_size, SEC_SYMTAB, SEC_TEXT, 8, ELF_RELA_SIZE);
+    put_section_header(&out, names[SEC_NOTE_STACK], SHT_PROGBITS, 0,
+                       shdr_offset, 0, 0, 0, 1, 0);
+    put_section_header(&out, names[SEC_SHSTRTAB], SHT_STRTAB, 0,
+                       shstrtab_offset, shstrtab.len, 0, 0, 1, 0);
+    
+    bool ok = outbuf_flush(&out);
+    if (fclose(file) != 0) ok = false;
+    
+    outbuf_free(&out);
+    outbuf_free(&symtab.strtab);
+    outbuf_free(&shstrtab);
+    x86_code_free(&code);
+    return ok;
+}
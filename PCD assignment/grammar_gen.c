@@ -0,0 +1,424 @@
+#include "compiler.h"
+
+// xorshift64*: small, fast and fully determined by the seed, so a failing
+// grammar or sentence can be reproduced from the seed alone
+static uint64_t next_random(uint64_t* state) {
+    if (*state == 0) *state = 0x9E3779B97F4A7C15ULL;
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static int random_below(uint64_t* state, int bound) {
+    return bound > 0 ? (int)(next_random(state) % (uint64_t)bound) : 0;
+}
+
+static bool chance(uint64_t* state, int percent) {
+    return random_below(state, 100) < percent;
+}
+
+static inline int clamp(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+void grammar_gen_defaults(GrammarGenOptions* opt) {
+    opt->shape = GRAMMAR_SHAPE_LL1;
+    opt->non_terminals = 10;
+    opt->productions = 25;
+    opt->max_rhs = 6;
+    opt->epsilon_percent = 20;
+    opt->recursion_percent = 30;
+    opt->seed = 1;
+}
+
+static void add_terminal(Grammar* g, const char* name) {
+    if (g->terminal_count < MAX_SYMBOLS) strcpy(g->terminals[g->terminal_count++], name);
+}
+
+static Production* add_production(Grammar* g, const char* lhs) {
+    Production* prod = &g->productions[g->prod_count++];
+    strcpy(prod->lhs, lhs);
+    prod->rhs_count = 0;
+    return prod;
+}
+
+static void append_rhs(Production* prod, const char* symbol) {
+    if (prod->rhs_count < MAX_PRODUCTIONS) strcpy(prod->rhs[prod->rhs_count++], symbol);
+}
+
+// LL(1) by construction: every alternative starts with a "lead" terminal
+// that is unique among the alternatives of its non-terminal, and every
+// non-terminal in a body is followed by a "separator" terminal (or ends the
+// body). FIRST sets then hold only leads and FOLLOW sets only separators
+// and $, so no table cell can get two entries, ε alternatives included.
+static void generate_ll1(Grammar* g, const GrammarGenOptions* opt, uint64_t* rng) {
+    int n = clamp(opt->non_terminals, 1, MAX_SYMBOLS);
+    int m = clamp(opt->productions, n, MAX_PRODUCTIONS);
+    int max_rhs = clamp(opt->max_rhs, 3, MAX_PRODUCTIONS);
+    int separators = clamp(n / 2, 2, 8);
+    
+    // Alternatives per non-terminal: one each, then ε and extra ones
+    int alternatives[MAX_SYMBOLS];
+    bool epsilon[MAX_SYMBOLS];
+    int budget = m - n;
+    for (int i = 0; i < n; i++) {
+        alternatives[i] = 1;
+        epsilon[i] = budget > 0 && chance(rng, opt->epsilon_percent);
+        if (epsilon[i]) budget--;
+    }
+    int max_leads = MAX_SYMBOLS - 1 - separators;
+    for (int tries = 0; budget > 0 && tries < 100 * MAX_PRODUCTIONS; tries++) {
+        int i = random_below(rng, n);
+        if (alternatives[i] < max_leads) {
+            alternatives[i]++;
+            budget--;
+        }
+    }
+    
+    int leads = 1;
+    for (int i = 0; i < n; i++) {
+        if (alternatives[i] > leads) leads = alternatives[i];
+    }
+    
+    char name[MAX_TOKEN_LEN];
+    for (int i = 0; i < leads; i++) {
+        sprintf(name, "k%d", i);
+        add_terminal(g, name);
+    }
+    for (int i = 0; i < separators; i++) {
+        sprintf(name, "s%d", i);
+        add_terminal(g, name);
+    }
+    add_terminal(g, "$");
+    
+    for (int i = 0; i < n; i++) {
+        sprintf(g->non_terminals[i], "N%d", i);
+    }
+    g->non_terminal_count = n;
+    strcpy(g->start_symbol, g->non_terminals[0]);
+    
+    // Bodies: lead terminal first, with distinct leads per non-terminal
+    int first_production[MAX_SYMBOLS];
+    for (int i = 0; i < n; i++) {
+        int order[MAX_SYMBOLS];
+        for (int k = 0; k < leads; k++) order[k] = k;
+        for (int k = leads - 1; k > 0; k--) {
+            int j = random_below(rng, k + 1);
+            int t = order[k]; order[k] = order[j]; order[j] = t;
+        }
+        
+        first_production[i] = g->prod_count;
+        for (int a = 0; a < alternatives[i]; a++) {
+            Production* prod = add_production(g, g->non_terminals[i]);
+            append_rhs(prod, g->terminals[order[a]]);
+        }
+        if (epsilon[i]) append_rhs(add_production(g, g->non_terminals[i]), "ε");
+    }
+    
+    // Reachability: hang every non-terminal off the first alternative of an
+    // earlier one. First alternatives only point forward, so each
+    // non-terminal has a derivation that terminates.
+    for (int i = 1; i < n; i++) {
+        int parent = random_below(rng, i);
+        while (g->productions[first_production[parent]].rhs_count + 2 > max_rhs) {
+            parent = (parent + 1) % i;
+        }
+        Production* prod = &g->productions[first_production[parent]];
+        append_rhs(prod, g->non_terminals[i]);
+        append_rhs(prod, g->terminals[leads + random_below(rng, separators)]);
+    }
+    
+    // Random filling. Recursive references (to this or an earlier
+    // non-terminal) are only placed in the other alternatives.
+    for (int p = 0; p < g->prod_count; p++) {
+        Production* prod = &g->productions[p];
+        if (strcmp(prod->rhs[0], "ε") == 0) continue;
+        
+        int i = symbol_id(prod->lhs, g) - g->terminal_count;
+        bool first = p == first_production[i];
+        int length = 1 + random_below(rng, max_rhs);
+        
+        while (prod->rhs_count + 2 <= length) {
+            bool backward = !first && chance(rng, opt->recursion_percent);
+            if (backward) {
+                append_rhs(prod, g->non_terminals[random_below(rng, i + 1)]);
+            } else if (i + 1 < n && chance(rng, 50)) {
+                append_rhs(prod, g->non_terminals[i + 1 + random_below(rng, n - i - 1)]);
+            }
+            append_rhs(prod, g->terminals[leads + random_below(rng, separators)]);
+        }
+    }
+}
+
+// Operator-precedence family, SLR(1) and so LALR(1) by construction:
+//   E_i -> E_i op E_i+1 | E_i+1        one level per non-terminal
+//   P   -> ( E_0 ) | id [S]            primary
+//   S   -> [ E_0 ] | ε                 optional index, when ε is enabled
+// Extra productions add operators to random levels or, with
+// recursion_percent, new bracket pairs around E_0.
+static void generate_lalr1(Grammar* g, const GrammarGenOptions* opt, uint64_t* rng) {
+    static const char* base_ops[] = { "+", "*", "-", "/" };
+    bool suffix = opt->epsilon_percent > 0;
+    int n = clamp(opt->non_terminals, suffix ? 3 : 2, MAX_SYMBOLS);
+    int levels = n - 1 - (suffix ? 1 : 0);
+    int base = 2 * levels + 2 + (suffix ? 2 : 0);
+    if (base > MAX_PRODUCTIONS) {
+        levels = (MAX_PRODUCTIONS - 2 - (suffix ? 2 : 0)) / 2;
+        n = levels + 1 + (suffix ? 1 : 0);
+        base = 2 * levels + 2 + (suffix ? 2 : 0);
+    }
+    int extra = clamp(opt->productions, base, MAX_PRODUCTIONS) - base;
+    
+    for (int i = 0; i < levels; i++) {
+        sprintf(g->non_terminals[i], "E%d", i);
+    }
+    strcpy(g->non_terminals[levels], "P");
+    if (suffix) strcpy(g->non_terminals[levels + 1], "S");
+    g->non_terminal_count = n;
+    strcpy(g->start_symbol, g->non_terminals[0]);
+    
+    add_terminal(g, "id");
+    add_terminal(g, "(");
+    add_terminal(g, ")");
+    add_terminal(g, "$");
+    if (suffix) {
+        add_terminal(g, "[");
+        add_terminal(g, "]");
+    }
+    
+    int op_count = 0;
+    char name[MAX_TOKEN_LEN];
+    for (int i = 0; i < levels + extra; i++) {
+        bool bracket = i >= levels && chance(rng, opt->recursion_percent);
+        int level = i < levels ? i : random_below(rng, levels);
+        const char* next = g->non_terminals[level + 1];
+        
+        if (g->terminal_count + (bracket ? 2 : 1) > MAX_SYMBOLS) break;
+        if (bracket) {
+            Production* prod = add_production(g, "P");
+            sprintf(name, "l%d", i);
+            add_terminal(g, name);
+            append_rhs(prod, name);
+            append_rhs(prod, g->non_terminals[0]);
+            sprintf(name, "r%d", i);
+            add_terminal(g, name);
+            append_rhs(prod, name);
+            continue;
+        }
+        
+        if (op_count < 4) strcpy(name, base_ops[op_count]);
+        else sprintf(name, "o%d", op_count);
+        op_count++;
+        add_terminal(g, name);
+        
+        Production* prod = add_production(g, g->non_terminals[level]);
+        append_rhs(prod, g->non_terminals[level]);
+        append_rhs(prod, name);
+        append_rhs(prod, next);
+        if (i < levels) append_rhs(add_production(g, g->non_terminals[level]), next);
+    }
+    
+    Production* prod = add_production(g, "P");
+    append_rhs(prod, "(");
+    append_rhs(prod, g->non_terminals[0]);
+    append_rhs(prod, ")");
+    prod = add_production(g, "P");
+    append_rhs(prod, "id");
+    if (suffix) {
+        append_rhs(prod, "S");
+        prod = add_production(g, "S");
+        append_rhs(prod, "[");
+        append_rhs(prod, g->non_terminals[0]);
+        append_rhs(prod, "]");
+        append_rhs(add_production(g, "S"), "ε");
+    }
+}
+
+// Fill `g` with a random grammar of the requested shape. Sizes are clamped
+// to the fixed MAX_SYMBOLS / MAX_PRODUCTIONS limits of Grammar.
+bool generate_grammar(Grammar* g, const GrammarGenOptions* opt) {
+    uint64_t rng = opt->seed;
+    g->prod_count = 0;
+    g->terminal_count = 0;
+    g->non_terminal_count = 0;
+    g->precedence_count = 0;
+    
+    if (opt->shape == GRAMMAR_SHAPE_LALR1) {
+        generate_lalr1(g, opt, &rng);
+    } else {
+        generate_ll1(g, opt, &rng);
+    }
+    return g->prod_count > 0;
+}
+
+// Shortest-derivation data used to steer sentence length
+#define SENTENCE_ATTEMPTS 8
+
+typedef struct {
+    int rhs[MAX_PRODUCTIONS][MAX_PRODUCTIONS];   // symbol ids, ε dropped
+    int rhs_count[MAX_PRODUCTIONS];
+    int lhs[MAX_PRODUCTIONS];
+    int min_len[MAX_SYMBOLS * 2];                // per symbol id
+    int prod_min[MAX_PRODUCTIONS];
+    int best[MAX_SYMBOLS * 2];                   // production realising min_len
+} SentencePlan;
+
+static bool plan_sentences(Grammar* g, SentencePlan* plan) {
+    int symbols = g->terminal_count + g->non_terminal_count;
+    for (int s = 0; s < symbols; s++) {
+        plan->min_len[s] = s < g->terminal_count ? 1 : INT32_MAX;
+        plan->best[s] = -1;
+    }
+    
+    for (int p = 0; p < g->prod_count; p++) {
+        Production* prod = &g->productions[p];
+        plan->lhs[p] = symbol_id(prod->lhs, g);
+        plan->rhs_count[p] = 0;
+        for (int r = 0; r < prod->rhs_count; r++) {
+            if (strcmp(prod->rhs[r], "ε") == 0) continue;
+            int id = symbol_id(prod->rhs[r], g);
+            if (id < 0) return false;
+            plan->rhs[p][plan->rhs_count[p]++] = id;
+        }
+    }
+    
+    // Bellman-Ford style fixpoint; only strict improvements are taken, so
+    // following `best` always terminates
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int p = 0; p < g->prod_count; p++) {
+            long total = 0;
+            for (int r = 0; r < plan->rhs_count[p] && total < INT32_MAX; r++) {
+                total += plan->min_len[plan->rhs[p][r]];
+            }
+            plan->prod_min[p] = total < INT32_MAX ? (int)total : INT32_MAX;
+            if (plan->prod_min[p] < plan->min_len[plan->lhs[p]]) {
+                plan->min_len[plan->lhs[p]] = plan->prod_min[p];
+                plan->best[plan->lhs[p]] = p;
+                changed = true;
+            }
+        }
+    }
+    int start = symbol_id(g->start_symbol, g);
+    return start >= g->terminal_count && plan->best[start] >= 0;
+}
+
+// Growable int array used for the derivation stack and the sentence
+typedef struct {
+    int* data;
+    int count;
+    int cap;
+} IntList;
+
+static bool push_int(IntList* list, int value) {
+    if (list->count == list->cap) {
+        int new_cap = list->cap ? list->cap * 2 : 256;
+        int* grown = realloc(list->data, (size_t)new_cap * sizeof(int));
+        if (grown == NULL) return false;
+        list->data = grown;
+        list->cap = new_cap;
+    }
+    list->data[list->count++] = value;
+    return true;
+}
+
+// One leftmost derivation into `sentence` (terminal ids). While the
+// shortest completion of the pending symbols leaves room, alternatives are
+// drawn at random, weighted towards those with more non-terminals so the
+// sentence can grow; past that point, or below `max_depth` levels of
+// nesting, the shortest alternative is forced.
+static bool derive(Grammar* g, const SentencePlan* plan, int target, int max_depth,
+                   uint64_t* seed, IntList* stack, IntList* sentence) {
+    int start = symbol_id(g->start_symbol, g);
+    stack->count = 0;
+    sentence->count = 0;
+    if (!push_int(stack, start) || !push_int(stack, 0)) return false;
+    
+    long pending = plan->min_len[start];
+    while (stack->count > 0) {
+        int depth = stack->data[--stack->count];
+        int symbol = stack->data[--stack->count];
+        pending -= plan->min_len[symbol];
+        
+        if (symbol < g->terminal_count) {
+            if (!push_int(sentence, symbol)) return false;
+            continue;
+        }
+        
+        long room = (long)target - sentence->count - pending;
+        int choice = plan->best[symbol];
+        if (depth < max_depth && room > plan->min_len[symbol]) {
+            int total = 0;
+            int weights[MAX_PRODUCTIONS];
+            for (int p = 0; p < g->prod_count; p++) {
+                weights[p] = 0;
+                if (plan->lhs[p] != symbol || plan->prod_min[p] > room) continue;
+                
+                weights[p] = 1;
+                for (int r = 0; r < plan->rhs_count[p]; r++) {
+                    if (plan->rhs[p][r] >= g->terminal_count) weights[p] += 4;
+                }
+                total += weights[p];
+            }
+            for (int pick = random_below(seed, total), p = 0; total > 0 && p < g->prod_count; p++) {
+                if (pick < weights[p]) {
+                    choice = p;
+                    break;
+                }
+                pick -= weights[p];
+            }
+        }
+        
+        for (int r = plan->rhs_count[choice] - 1; r >= 0; r--) {
+            if (!push_int(stack, plan->rhs[choice][r]) || !push_int(stack, depth + 1)) return false;
+            pending += plan->min_len[plan->rhs[choice][r]];
+        }
+    }
+    return true;
+}
+
+// Write a random sentence of `g` to `out`, aiming for `target_tokens`
+// tokens: the closest of a few derivations is kept, since small grammars
+// may not reach every length. Lexemes are separated by spaces and "id"
+// becomes a numbered identifier. Returns the number of tokens written, or
+// -1 if the grammar derives no sentence.
+int generate_sentence(Grammar* g, int target_tokens, int max_depth, uint64_t* seed, OutputBuffer* out) {
+    static SentencePlan plan;
+    if (!plan_sentences(g, &plan)) return -1;
+    
+    IntList stack = { NULL, 0, 0 };
+    IntList attempt = { NULL, 0, 0 };
+    IntList best = { NULL, 0, 0 };
+    bool ok = true;
+    
+    for (int i = 0; ok && i < SENTENCE_ATTEMPTS; i++) {
+        ok = derive(g, &plan, target_tokens, max_depth, seed, &stack, &attempt);
+        if (ok && (i == 0 || abs(attempt.count - target_tokens) < abs(best.count - target_tokens))) {
+            IntList swap = best;
+            best = attempt;
+            attempt = swap;
+        }
+        if (best.count == target_tokens) break;
+    }
+    
+    int written = -1;
+    if (ok) {
+        for (int i = 0; i < best.count; i++) {
+            const char* terminal = g->terminals[best.data[i]];
+            if (i > 0) outbuf_puts(out, " ");
+            if (strcmp(terminal, "id") == 0) {
+                outbuf_printf(out, "v%d", random_below(seed, 1000));
+            } else {
+                outbuf_puts(out, terminal);
+            }
+        }
+        written = best.count;
+    }
+    
+    free(stack.data);
+    free(attempt.data);
+    free(best.data);
+    return written;
+}
@@ -0,0 +1,330 @@
+#include "compiler.h"
+
+// Rewriting a grammar for the LL(1) parser: left recursion, direct and
+// indirect, becomes right recursion through a tail non-terminal, and
+// alternatives that share a prefix are left-factored. So
+//   E -> E + T | T        becomes   E -> T E'   E' -> + T E' | ε
+//   A -> a B | a C        becomes   A -> a A'   A' -> B | C
+// New non-terminals are named after the one they came from with primes
+// added, and go after the original non-terminals so symbol ids of the
+// original symbols do not change. Each rewritten production keeps the index
+// of the original production it came from, -1 for the ε tails and factored
+// prefixes the rewrite introduces.
+//
+// Left recursion hidden behind a nullable prefix (A -> B A x with B =>* ε)
+// is not removed; the LL parser reports it when it reaches it.
+
+static Grammar* work;
+static int* work_origin;
+
+// Each step rebuilds the production list here and copies it back
+static Grammar next;
+static int next_origin[MAX_PRODUCTIONS];
+
+static inline int rhs_length(const Production* p) {
+    if (p->rhs_count == 1 && strcmp(p->rhs[0], "ε") == 0) return 0;
+    return p->rhs_count;
+}
+
+static inline bool starts_with(const Production* p, const char* symbol) {
+    return rhs_length(p) > 0 && strcmp(p->rhs[0], symbol) == 0;
+}
+
+static int non_terminal_index(const Grammar* g, const char* symbol) {
+    for (int i = 0; i < g->non_terminal_count; i++) {
+        if (strcmp(g->non_terminals[i], symbol) == 0) return i;
+    }
+    return -1;
+}
+
+// Append p's symbols from position `from` on to q
+static bool append_from(Production* q, const Production* p, int from) {
+    for (int i = from; i < rhs_length(p); i++) {
+        if (q->rhs_count >= MAX_PRODUCTIONS) return false;
+        strcpy(q->rhs[q->rhs_count++], p->rhs[i]);
+    }
+    return true;
+}
+
+static bool append_symbol(Production* q, const char* symbol) {
+    if (q->rhs_count >= MAX_PRODUCTIONS) return false;
+    strcpy(q->rhs[q->rhs_count++], symbol);
+    return true;
+}
+
+static void start_production(Production* q, const char* lhs) {
+    strcpy(q->lhs, lhs);
+    q->rhs_count = 0;
+}
+
+static bool emit(const Production* q, int origin) {
+    if (next.prod_count >= MAX_PRODUCTIONS) return false;
+    Production* p = &next.productions[next.prod_count];
+    *p = *q;
+    if (p->rhs_count == 0) {
+        strcpy(p->rhs[0], "ε");
+        p->rhs_count = 1;
+    }
+    next_origin[next.prod_count++] = origin;
+    return true;
+}
+
+static void commit() {
+    memcpy(work->productions, next.productions, sizeof(Production) * (size_t)next.prod_count);
+    memcpy(work_origin, next_origin, sizeof(int) * (size_t)next.prod_count);
+    work->prod_count = next.prod_count;
+    next.prod_count = 0;
+}
+
+// A fresh non-terminal named `base` with primes appended
+static bool new_non_terminal(const char* base, char* name) {
+    size_t len = strlen(base);
+    if (len + 1 >= MAX_TOKEN_LEN || work->non_terminal_count >= MAX_SYMBOLS) return false;
+    strcpy(name, base);
+    do {
+        if (len + 1 >= MAX_TOKEN_LEN) return false;
+        name[len++] = '\'';
+        name[len] = '\0';
+    } while (is_terminal(name, work) || is_non_terminal(name, work));
+    strcpy(work->non_terminals[work->non_terminal_count++], name);
+    return true;
+}
+
+static int last_production_of(const char* lhs) {
+    int last = -1;
+    for (int i = 0; i < work->prod_count; i++) {
+        if (strcmp(work->productions[i].lhs, lhs) == 0) last = i;
+    }
+    return last;
+}
+
+// Ai -> Aj γ becomes Ai -> δ γ for every Aj -> δ
+static bool substitute(const char* ai, const char* aj) {
+    static Production q;
+    for (int i = 0; i < work->prod_count; i++) {
+        const Production* p = &work->productions[i];
+        if (strcmp(p->lhs, ai) != 0 || !starts_with(p, aj)) {
+            if (!emit(p, work_origin[i])) return false;
+            continue;
+        }
+        for (int k = 0; k < work->prod_count; k++) {
+            const Production* d = &work->productions[k];
+            if (strcmp(d->lhs, aj) != 0) continue;
+            start_production(&q, ai);
+            if (!append_from(&q, d, 0) || !append_from(&q, p, 1) || !emit(&q, work_origin[i])) return false;
+        }
+    }
+    commit();
+    return true;
+}
+
+// A -> A α | β becomes A -> β A', A' -> α A' | ε. A -> A is dropped.
+static bool remove_direct_recursion(const char* a) {
+    static Production q;
+    bool recursive = false, base = false;
+    for (int i = 0; i < work->prod_count; i++) {
+        const Production* p = &work->productions[i];
+        if (strcmp(p->lhs, a) != 0) continue;
+        if (starts_with(p, a)) recursive = true;
+        else base = true;
+    }
+    if (!recursive) return true;
+    if (!base) return false;  // A never derives a sentence
+    
+    char tail[MAX_TOKEN_LEN];
+    if (!new_non_terminal(a, tail)) return false;
+    
+    int last = last_production_of(a);
+    for (int i = 0; i < work->prod_count; i++) {
+        const Production* p = &work->productions[i];
+        if (strcmp(p->lhs, a) != 0) {
+            if (!emit(p, work_origin[i])) return false;
+        } else if (!starts_with(p, a)) {
+            start_production(&q, a);
+            if (!append_from(&q, p, 0) || !append_symbol(&q, tail) || !emit(&q, work_origin[i])) return false;
+        }
+        if (i != last) continue;
+        
+        // The tail goes right after A's last production
+        for (int k = 0; k <= last; k++) {
+            const Production* r = &work->productions[k];
+            if (strcmp(r->lhs, a) != 0 || !starts_with(r, a) || rhs_length(r) == 1) continue;
+            start_production(&q, tail);
+            if (!append_from(&q, r, 1) || !append_symbol(&q, tail) || !emit(&q, work_origin[k])) return false;
+        }
+        start_production(&q, tail);
+        if (!emit(&q, -1)) return false;
+    }
+    commit();
+    return true;
+}
+
+// reach[a][b] when a derives b as its leftmost symbol in one or more steps
+static bool reach[MAX_SYMBOLS][MAX_SYMBOLS];
+
+static bool find_left_recursion(const Grammar* g) {
+    int n = g->non_terminal_count;
+    bool any = false;
+    memset(reach, 0, sizeof(reach));
+    for (int i = 0; i < g->prod_count; i++) {
+        const Production* p = &g->productions[i];
+        if (rhs_length(p) == 0) continue;
+        int a = non_terminal_index(g, p->lhs);
+        int b = non_terminal_index(g, p->rhs[0]);
+        if (a >= 0 && b >= 0) reach[a][b] = true;
+    }
+    for (int k = 0; k < n; k++) {
+        for (int i = 0; i < n; i++) {
+            if (!reach[i][k]) continue;
+            for (int j = 0; j < n; j++) reach[i][j] |= reach[k][j];
+        }
+    }
+    for (int i = 0; i < n; i++) any |= reach[i][i];
+    return any;
+}
+
+// The textbook ordering algorithm, restricted to non-terminals that are
+// mutually left-recursive so the rest of the grammar is left alone
+static bool remove_left_recursion(int* rewrites) {
+    if (!find_left_recursion(work)) return true;
+    
+    int n = work->non_terminal_count;
+    static bool cyclic[MAX_SYMBOLS][MAX_SYMBOLS];
+    memcpy(cyclic, reach, sizeof(cyclic));
+    for (int i = 0; i < n; i++) {
+        if (!cyclic[i][i]) continue;
+        for (int j = 0; j < i; j++) {
+            if (!cyclic[j][j] || !cyclic[i][j] || !cyclic[j][i]) continue;
+            if (!substitute(work->non_terminals[i], work->non_terminals[j])) return false;
+        }
+        // Copy: new non-terminals may be added after this one
+        char a[MAX_TOKEN_LEN];
+        strcpy(a, work->non_terminals[i]);
+        if (!remove_direct_recursion(a)) return false;
+        (*rewrites)++;
+    }
+    return true;
+}
+
+static int common_prefix(const Production* p, const Production* q) {
+    int len = 0;
+    while (len < rhs_length(p) && len < rhs_length(q) && strcmp(p->rhs[len], q->rhs[len]) == 0) len++;
+    return len;
+}
+
+static bool same_suffix(const Production* p, int from_p, const Production* q, int from_q) {
+    if (rhs_length(p) - from_p != rhs_length(q) - from_q) return false;
+    for (int i = 0; from_p + i < rhs_length(p); i++) {
+        if (strcmp(p->rhs[from_p + i], q->rhs[from_q + i]) != 0) return false;
+    }
+    return true;
+}
+
+// Factor the first group of A's alternatives that share a first symbol:
+// A -> α β1 | α β2 becomes A -> α A', A' -> β1 | β2. Returns 1 when
+// something was factored, 0 when nothing was, -1 past the limits.
+static int factor_once(const char* a) {
+    static Production q;
+    int first = -1, prefix = 0;
+    for (int i = 0; i < work->prod_count && first < 0; i++) {
+        const Production* p = &work->productions[i];
+        if (strcmp(p->lhs, a) != 0 || rhs_length(p) == 0) continue;
+        for (int k = i + 1; k < work->prod_count; k++) {
+            const Production* r = &work->productions[k];
+            if (strcmp(r->lhs, a) != 0 || !starts_with(r, p->rhs[0])) continue;
+            int len = common_prefix(p, r);
+            if (first < 0 || len < prefix) prefix = len;
+            first = i;
+        }
+    }
+    if (first < 0) return 0;
+    
+    char rest[MAX_TOKEN_LEN];
+    if (!new_non_terminal(a, rest)) return -1;
+    
+    const char* lead = work->productions[first].rhs[0];
+    int last = last_production_of(a);
+    for (int i = 0; i < work->prod_count; i++) {
+        const Production* p = &work->productions[i];
+        bool member = strcmp(p->lhs, a) == 0 && starts_with(p, lead);
+        if (i == first) {
+            start_production(&q, a);
+            for (int k = 0; k < prefix; k++) append_symbol(&q, p->rhs[k]);
+            if (!append_symbol(&q, rest) || !emit(&q, -1)) return -1;
+        } else if (!member) {
+            if (!emit(p, work_origin[i])) return -1;
+        }
+        if (i != last) continue;
+        
+        // An empty remainder goes last, as in E' -> + T E' | ε, so it only
+        // takes the table cells no other alternative wants
+        for (int pass = 0; pass < 2; pass++) {
+            for (int k = 0; k <= last; k++) {
+                const Production* m = &work->productions[k];
+                if (strcmp(m->lhs, a) != 0 || !starts_with(m, lead)) continue;
+                if ((rhs_length(m) == prefix) != (pass == 1)) continue;
+                
+                // Alternatives identical after the prefix become one
+                bool duplicate = false;
+                for (int d = 0; d < k && !duplicate; d++) {
+                    const Production* o = &work->productions[d];
+                    duplicate = strcmp(o->lhs, a) == 0 && starts_with(o, lead) && same_suffix(o, prefix, m, prefix);
+                }
+                if (duplicate) continue;
+                
+                start_production(&q, rest);
+                if (!append_from(&q, m, prefix) || !emit(&q, work_origin[k])) return -1;
+            }
+        }
+    }
+    commit();
+    return 1;
+}
+
+static bool left_factor(int* rewrites) {
+    // New non-terminals join the list and are factored in turn
+    for (int n = 0; n < work->non_terminal_count; n++) {
+        char a[MAX_TOKEN_LEN];
+        strcpy(a, work->non_terminals[n]);
+        int result;
+        while ((result = factor_once(a)) > 0) (*rewrites)++;
+        if (result < 0) return false;
+    }
+    return true;
+}
+
+// Whether some non-terminal is left-recursive or has two alternatives
+// starting with the same symbol; only then is a rewrite needed
+static bool needs_rewrite(const Grammar* g) {
+    for (int i = 0; i < g->prod_count; i++) {
+        const Production* p = &g->productions[i];
+        if (rhs_length(p) == 0) continue;
+        if (strcmp(p->rhs[0], p->lhs) == 0) return true;
+        for (int k = i + 1; k < g->prod_count; k++) {
+            const Production* r = &g->productions[k];
+            if (strcmp(r->lhs, p->lhs) == 0 && starts_with(r, p->rhs[0])) return true;
+        }
+    }
+    
+    // Indirect left recursion
+    return find_left_recursion(g);
+}
+
+// Rewrite `in` into `out` for LL(1) parsing (see the top of this file);
+// origin[i] is the production of `in` that out's production i came from,
+// or -1. Returns the number of non-terminals rewritten, 0 leaving `out`
+// untouched when `in` has no left recursion and no common prefixes, and -1
+// when the result would exceed the grammar limits.
+int transform_for_ll(const Grammar* in, Grammar* out, int origin[]) {
+    if (!needs_rewrite(in)) return 0;
+    
+    memcpy(out, in, sizeof(*out));
+    work = out;
+    work_origin = origin;
+    for (int i = 0; i < out->prod_count; i++) origin[i] = i;
+    next.prod_count = 0;
+    
+    int rewrites = 0;
+    if (!remove_left_recursion(&rewrites) || !left_factor(&rewrites)) return -1;
+    return rewrites;
+}
@@ -23,6 +23,8 @@ HWND hInputEdit, hOutputEdit, hCompileBtn, hClearBtn, hGrammarCombo, hTabControl
 HWND hTabOutputs[4];
 Grammar current_grammar;
 char output_buffer[50000];
+ParseTree parse_tree;
+TraceLog parse_trace;
 
 // Function declarations
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
@@ -30,6 +32,7 @@ void CreateControls(HWND hwnd);
 void CompileInput();
 void ClearAll();
 void AppendOutput(const char* text);
+void AppendTrace(const char* input, Grammar* g);
 void SwitchTab(int tabIndex);
 
 // WinMain entry point
@@ -46,6 +49,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     wc.lpszClassName = "CompilerGUI";
     wc.hIcon = LoadIcon(NULL, IDI_APPLICATION);
     
+    trace_log_init(&parse_trace);
+    
     if (!RegisterClassEx(&wc)) {
         MessageBox(NULL, "Window Registration Failed!", "Error", MB_ICONERROR);
         return 0;
@@ -84,7 +89,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             CreateControls(hwnd);
             load_sample_grammar(&current_grammar, 3); // Load default grammar
             break;
-            
+        
         case WM_COMMAND:
             if (LOWORD(wParam) == ID_COMPILE_BTN) {
                 CompileInput();
@@ -98,7 +103,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                 SetWindowText(hOutputEdit, "Grammar loaded successfully!\r\n\r\nReady to compile.");
             }
             break;
-            
+        
         case WM_NOTIFY: {
             LPNMHDR pnmhdr = (LPNMHDR)lParam;
             if (pnmhdr->idFrom == ID_TAB_CONTROL && pnmhdr->code == TCN_SELCHANGE) {
@@ -107,7 +112,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             }
             break;
         }
-            
+        
         case WM_SIZE: {
             int width = LOWORD(lParam);
             int height = HIWORD(lParam);
@@ -126,11 +131,11 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             }
             break;
         }
-            
+        
         case WM_DESTROY:
             PostQuitMessage(0);
             break;
-            
+        
         default:
             return DefWindowProc(hwnd, uMsg, wParam, lParam);
     }
@@ -213,6 +218,25 @@ void AppendOutput(const char* text) {
     SendMessage(hOutputEdit, EM_REPLACESEL, 0, (LPARAM)text);
 }
 
+// Pretty-print the recorded parse trace of a parser working on `g` and any
+// syntax errors into output_buffer, converting line endings for the edit
+// control
+void AppendTrace(const char* input, Grammar* g) {
+    OutputBuffer text;
+    outbuf_init(&text);
+    format_parse_trace(&text, &parse_trace, g, input);
+    format_diagnostics(&text, NULL);
+    
+    size_t len = strlen(output_buffer);
+    const char* src = outbuf_cstr(&text);
+    for (; *src && len + 3 < sizeof(output_buffer); src++) {
+        if (*src == '\n') output_buffer[len++] = '\r';
+        output_buffer[len++] = *src;
+    }
+    output_buffer[len] = '\0';
+    outbuf_free(&text);
+}
+
 void SwitchTab(int tabIndex) {
     for (int i = 0; i < 4; i++) {
         ShowWindow(hTabOutputs[i], SW_HIDE);
@@ -270,9 +294,6 @@ void CompileInput() {
     strcat(output_buffer, "║                    LL PARSER (TOP-DOWN)                      ║\r\n");
     strcat(output_buffer, "╚══════════════════════════════════════════════════════════════╝\r\n\r\n");
     
-    // Redirect stdout to capture parsing output
-    freopen("temp_ll.txt", "w", stdout);
-    
     FirstFollowSet first_sets[MAX_SYMBOLS];
     FirstFollowSet follow_sets[MAX_SYMBOLS];
     
@@ -281,20 +302,9 @@ void CompileInput() {
     compute_follow_sets(&current_grammar, first_sets, follow_sets);
     build_ll_table(&current_grammar, first_sets, follow_sets);
     
-    bool ll_result = parse_ll(input);
-    
-    fclose(stdout);
-    freopen("CON", "w", stdout);
-    
-    // Read captured output
-    FILE* temp_file = fopen("temp_ll.txt", "r");
-    char line[500];
-    while (fgets(line, sizeof(line), temp_file)) {
-        strcat(output_buffer, line);
-        strcat(output_buffer, "\r");
-    }
-    fclose(temp_file);
-    remove("temp_ll.txt");
+    trace_log_reset(&parse_trace);
+    bool ll_result = parse_ll_tree(input, NULL, &parse_trace.sink);
+    AppendTrace(input, get_ll_grammar());
     
     strcat(output_buffer, "\r\n\r\n");
     strcat(output_buffer, "═══════════════════════════════════════════════════════════════\r\n");
@@ -315,21 +325,10 @@ void CompileInput() {
     strcat(output_buffer, "║                  LR PARSER (BOTTOM-UP)                       ║\r\n");
     strcat(output_buffer, "╚══════════════════════════════════════════════════════════════╝\r\n\r\n");
     
-    freopen("temp_lr.txt", "w", stdout);
-    
     init_lr_parser(&current_grammar);
-    bool lr_result = parse_lr(input);
-    
-    fclose(stdout);
-    freopen("CON", "w", stdout);
-    
-    temp_file = fopen("temp_lr.txt", "r");
-    while (fgets(line, sizeof(line), temp_file)) {
-        strcat(output_buffer, line);
-        strcat(output_buffer, "\r");
-    }
-    fclose(temp_file);
-    remove("temp_lr.txt");
+    trace_log_reset(&parse_trace);
+    bool lr_result = parse_lr_tree(input, &parse_tree, &parse_trace.sink);
+    AppendTrace(input, &current_grammar);
     
     strcat(output_buffer, "\r\n\r\n");
     strcat(output_buffer, "═══════════════════════════════════════════════════════════════\r\n");
@@ -350,14 +349,21 @@ void CompileInput() {
     strcat(output_buffer, "║                   ASSEMBLY CODE GENERATION                    ║\r\n");
     strcat(output_buffer, "╚══════════════════════════════════════════════════════════════╝\r\n\r\n");
     
-    generate_code_from_tokens();
+    if (!lr_result || !generate_code_from_tree(&parse_tree)) {
+        strcat(output_buffer, "No code generated: the input was rejected by the LR parser.\r\n");
+        SetWindowText(hTabOutputs[TAB_ASSEMBLY], output_buffer);
+        TabCtrl_SetCurSel(hTabControl, 0);
+        SwitchTab(0);
+        return;
+    }
     
     freopen("temp_tac.txt", "w", stdout);
     print_tac();
     fclose(stdout);
     freopen("CON", "w", stdout);
     
-    temp_file = fopen("temp_tac.txt", "r");
+    FILE* temp_file = fopen("temp_tac.txt", "r");
+    char line[500];
     while (fgets(line, sizeof(line), temp_file)) {
         strcat(output_buffer, line);
         strcat(output_buffer, "\r");
@@ -1,9 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "compiler.h"
 
-static const char* input_string = NULL;
-static int pos = 0;
-static int line = 1;
-static int column = 1;
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include <limits.h>
+
+// Scanner position, per thread so concurrent compiles do not share it
+static _Thread_local const char* input_string = NULL;
+static _Thread_local int pos = 0;
+static _Thread_local int line = 1;
+static _Thread_local int column = 1;
 
 void init_lexer(const char* input) {
     input_string = input;
@@ -24,81 +34,75 @@ static void skip_whitespace() {
     }
 }
 
-Token get_next_token() {
-    Token token;
-    token.line = line;
-    token.column = column;
-    memset(token.lexeme, 0, MAX_TOKEN_LEN);
-    
-    skip_whitespace();
+// Advance past the next token, which starts at pos after whitespace, and
+// return its type. The lexeme is input_string[*start .. pos); an EOF token
+// has none.
+static CompilerTokenType scan(int* start) {
+    *start = pos;
     
-    if (input_string[pos] == '\0') {
-        token.type = TOKEN_EOF;
-        strcpy(token.lexeme, "$");
-        return token;
-    }
+    char ch = input_string[pos];
+    if (ch == '\0') return TOKEN_EOF;
     
     // Identifiers and keywords
-    if (isalpha(input_string[pos]) || input_string[pos] == '_') {
-        int i = 0;
-        while ((isalnum(input_string[pos]) || input_string[pos] == '_') && i < MAX_TOKEN_LEN - 1) {
-            token.lexeme[i++] = input_string[pos++];
+    if (isalpha(ch) || ch == '_') {
+        while ((isalnum(input_string[pos]) || input_string[pos] == '_') && pos - *start < MAX_TOKEN_LEN - 1) {
+            pos++;
             column++;
         }
-        token.lexeme[i] = '\0';
-        token.type = TOKEN_ID;
-        return token;
+        return TOKEN_ID;
     }
     
     // Numbers
-    if (isdigit(input_string[pos])) {
-        int i = 0;
-        while (isdigit(input_string[pos]) && i < MAX_TOKEN_LEN - 1) {
-            token.lexeme[i++] = input_string[pos++];
+    if (isdigit(ch)) {
+        while (isdigit(input_string[pos]) && pos - *start < MAX_TOKEN_LEN - 1) {
+            pos++;
             column++;
         }
-        token.lexeme[i] = '\0';
-        token.type = TOKEN_NUMBER;
-        return token;
+        return TOKEN_NUMBER;
     }
     
     // Operators and symbols
-    char ch = input_string[pos];
-    token.lexeme[0] = ch;
-    token.lexeme[1] = '\0';
     pos++;
     column++;
     
     switch (ch) {
-        case '+':
-            token.type = TOKEN_PLUS;
-            break;
-        case '-':
-            token.type = TOKEN_MINUS;
-            break;
-        case '*':
-            token.type = TOKEN_MULTIPLY;
-            break;
-        case '/':
-            token.type = TOKEN_DIVIDE;
-            break;
-        case '(':
-            token.type = TOKEN_LPAREN;
-            break;
-        case ')':
-            token.type = TOKEN_RPAREN;
-            break;
-        case '=':
-            token.type = TOKEN_ASSIGN;
-            break;
-        case ';':
-            token.type = TOKEN_SEMICOLON;
-            break;
-        default:
-            token.type = TOKEN_UNKNOWN;
-            break;
+        case '+': return TOKEN_PLUS;
+        case '-': return TOKEN_MINUS;
+        case '*': return TOKEN_MULTIPLY;
+        case '/': return TOKEN_DIVIDE;
+        case '(': return TOKEN_LPAREN;
+        case ')': return TOKEN_RPAREN;
+        case '=': return TOKEN_ASSIGN;
+        case ';': return TOKEN_SEMICOLON;
+        default: return TOKEN_UNKNOWN;
+    }
+}
+
+static Token scan_token() {
+    Token token;
+    skip_whitespace();
+    token.line = line;
+    token.column = column;
+    
+    int start;
+    token.type = scan(&start);
+    if (token.type == TOKEN_EOF) {
+        memset(token.lexeme, 0, MAX_TOKEN_LEN);
+        strcpy(token.lexeme, "$");
+        return token;
     }
     
+    int length = pos - start;
+    memcpy(token.lexeme, input_string + start, (size_t)length);
+    memset(token.lexeme + length, 0, (size_t)(MAX_TOKEN_LEN - length));
+    return token;
+}
+
+Token get_next_token() {
+    int start = pos;
+    Token token = scan_token();
+    compiler_stats.tokens++;
+    compiler_stats.bytes_scanned += (uint64_t)(pos - start);
     return token;
 }
 
@@ -107,7 +111,7 @@ Token peek_token() {
     int saved_line = line;
     int saved_column = column;
     
-    Token token = get_next_token();
+    Token token = scan_token();
     
     pos = saved_pos;
     line = saved_line;
@@ -116,6 +120,221 @@ Token peek_token() {
     return token;
 }
 
+// ---------------------------------------------------------------------------
+// Whole-input lexing in chunks. The input is cut where a whitespace run
+// starts, which always ends a token, and each chunk is lexed on its own
+// thread with line and column counted from 1. The chunk bases then follow
+// from a prefix pass over where each chunk ended, and the spans are fixed
+// up and copied into the list in parallel. The result equals calling
+// get_next_token up to and including EOF.
+// ---------------------------------------------------------------------------
+
+#define LEX_MAX_THREADS 64
+#define LEX_MIN_CHUNK (64 * 1024)   // smaller inputs get fewer chunks
+
+typedef struct {
+    const char* input;
+    int start;
+    int end;                // start of the next chunk
+    bool last;              // runs to the end of the input, EOF included
+    TokenSpan* spans;
+    size_t count;
+    size_t cap;
+    int end_line;           // position reached at `end`, counted from 1
+    int end_column;
+    int base_line;          // position of `start` in the whole input
+    int base_column;
+    TokenSpan* out;         // where the fixed-up spans go
+    bool failed;
+} LexChunk;
+
+void span_list_init(TokenSpanList* list) {
+    list->spans = NULL;
+    list->count = 0;
+    list->cap = 0;
+}
+
+void span_list_free(TokenSpanList* list) {
+    free(list->spans);
+    span_list_init(list);
+}
+
+Token token_from_span(const char* input, const TokenSpan* span) {
+    Token token;
+    token.type = span->type;
+    token.line = span->line;
+    token.column = span->column;
+    memset(token.lexeme, 0, MAX_TOKEN_LEN);
+    if (span->type == TOKEN_EOF) strcpy(token.lexeme, "$");
+    else memcpy(token.lexeme, input + span->offset, (size_t)span->length);
+    return token;
+}
+
+static void* lex_chunk(void* arg) {
+    LexChunk* chunk = arg;
+    init_lexer(chunk->input);
+    pos = chunk->start;
+    
+    // A non-last chunk ends just before whitespace, so its last token ends
+    // exactly at `end`
+    while (chunk->last || pos < chunk->end) {
+        if (chunk->count == chunk->cap) {
+            size_t cap = chunk->cap ? chunk->cap * 2 : 1024;
+            TokenSpan* spans = realloc(chunk->spans, cap * sizeof(TokenSpan));
+            if (spans == NULL) {
+                chunk->failed = true;
+                break;
+            }
+            chunk->spans = spans;
+            chunk->cap = cap;
+        }
+        
+        TokenSpan* span = &chunk->spans[chunk->count++];
+        int start;
+        skip_whitespace();
+        span->line = line;
+        span->column = column;
+        span->type = scan(&start);
+        span->offset = (size_t)start;
+        span->length = pos - start;
+        if (span->type == TOKEN_EOF) break;
+    }
+    chunk->end_line = line;
+    chunk->end_column = column;
+    return NULL;
+}
+
+// Spans on a chunk's first line are offset by its base column, all of
+// them by its base line
+static void* place_chunk(void* arg) {
+    LexChunk* chunk = arg;
+    for (size_t i = 0; i < chunk->count; i++) {
+        TokenSpan span = chunk->spans[i];
+        if (span.line == 1) span.column += chunk->base_column - 1;
+        span.line += chunk->base_line - 1;
+        chunk->out[i] = span;
+    }
+    return NULL;
+}
+
+// Run `fn` on every chunk, chunk 0 on the calling thread. A chunk whose
+// thread cannot be started runs here too.
+static void run_chunks(LexChunk* chunks, int count, void* (*fn)(void*)) {
+#ifndef _WIN32
+    pthread_t threads[LEX_MAX_THREADS];
+    bool started[LEX_MAX_THREADS] = { false };
+    for (int i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, fn, &chunks[i]) == 0;
+    }
+    fn(&chunks[0]);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else fn(&chunks[i]);
+    }
+#else
+    for (int i = 0; i < count; i++) fn(&chunks[i]);
+#endif
+}
+
+// First position at or after `from` where a whitespace run starts, or `len`
+static int chunk_boundary(const char* input, int from, int len) {
+    for (int p = from; p < len; p++) {
+        if (isspace(input[p]) && !isspace(input[p - 1])) return p;
+    }
+    return len;
+}
+
+// Lex all of `input` into `out`, on up to `threads` threads (0 for one per
+// CPU; Windows builds always lex on the calling thread). `out` keeps its
+// capacity between calls. Returns false when memory runs out.
+bool lex_all_tokens(const char* input, int threads, TokenSpanList* out) {
+    PhaseTimer timer = phase_begin();
+    size_t length = strlen(input);
+    out->count = 0;
+    if (length > INT_MAX) return false;
+    int len = (int)length;
+
+#ifndef _WIN32
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    threads = 1;
+#endif
+    if (threads > len / LEX_MIN_CHUNK) threads = len / LEX_MIN_CHUNK;
+    if (threads > LEX_MAX_THREADS) threads = LEX_MAX_THREADS;
+    if (threads < 1) threads = 1;
+    
+    LexChunk chunks[LEX_MAX_THREADS];
+    int count = 0;
+    int start = 0;
+    while (start < len || count == 0) {
+        int end = len;
+        if (count < threads - 1) {
+            int nominal = (int)((int64_t)len * (count + 1) / threads);
+            end = chunk_boundary(input, nominal > start ? nominal : start + 1, len);
+        }
+        LexChunk* chunk = &chunks[count++];
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->input = input;
+        chunk->start = start;
+        chunk->end = end;
+        chunk->last = end >= len;
+        start = end;
+    }
+    
+    // The first chunk is lexed straight into the list, so with one chunk
+    // nothing is copied
+    chunks[0].spans = out->spans;
+    chunks[0].cap = out->cap;
+    run_chunks(chunks, count, lex_chunk);
+    out->spans = chunks[0].spans;
+    out->cap = chunks[0].cap;
+    chunks[0].spans = NULL;
+    
+    bool ok = true;
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (chunks[i].failed) ok = false;
+        total += chunks[i].count;
+    }
+    if (ok && total > out->cap) {
+        TokenSpan* spans = realloc(out->spans, total * sizeof(TokenSpan));
+        if (spans == NULL) {
+            ok = false;
+        } else {
+            out->spans = spans;
+            out->cap = total;
+        }
+    }
+    
+    if (ok) {
+        // Each chunk starts where the one before it ended
+        size_t offset = 0;
+        for (int i = 0; i < count; i++) {
+            LexChunk* chunk = &chunks[i];
+            if (i == 0) {
+                chunk->base_line = 1;
+                chunk->base_column = 1;
+            } else {
+                const LexChunk* prev = &chunks[i - 1];
+                chunk->base_line = prev->base_line + prev->end_line - 1;
+                chunk->base_column = prev->end_line == 1 ? prev->base_column + prev->end_column - 1
+                                                         : prev->end_column;
+            }
+            chunk->out = out->spans + offset;
+            offset += chunk->count;
+        }
+        // The first chunk is already in place, based at the start
+        if (count > 1) run_chunks(chunks + 1, count - 1, place_chunk);
+        out->count = total;
+        compiler_stats.tokens += total;
+        compiler_stats.bytes_scanned += length;
+    }
+    
+    for (int i = 0; i < count; i++) free(chunks[i].spans);
+    phase_end(PHASE_LEX, timer);
+    return ok;
+}
+
 const char* token_type_to_string(CompilerTokenType type) {
     switch (type) {
         case TOKEN_ID: return "IDENTIFIER";
@@ -134,28 +353,43 @@ const char* token_type_to_string(CompilerTokenType type) {
     }
 }
 
-void print_tokens() {
-    printf("\n=== LEXICAL ANALYSIS ===\n");
-    printf("%-15s %-20s %-10s %-10s\n", "TOKEN TYPE", "LEXEME", "LINE", "COLUMN");
-    printf("---------------------------------------------------------------\n");
+void format_tokens(OutputBuffer* out) {
+    outbuf_puts(out, "\n=== LEXICAL ANALYSIS ===\n");
+    outbuf_printf(out, "%-15s %-20s %-10s %-10s\n", "TOKEN TYPE", "LEXEME", "LINE", "COLUMN");
+    outbuf_puts(out, "---------------------------------------------------------------\n");
     
     int saved_pos = pos;
     int saved_line = line;
     int saved_column = column;
     
+    // Time a silent pass so the phase timer does not measure formatting
+    PhaseTimer timer = phase_begin();
+    init_lexer(input_string);
+    while (scan_token().type != TOKEN_EOF);
+    phase_end(PHASE_LEX, timer);
+    
     init_lexer(input_string);
     
     Token token;
     do {
         token = get_next_token();
-        printf("%-15s %-20s %-10d %-10d\n", 
-               token_type_to_string(token.type), 
-               token.lexeme, 
-               token.line, 
-               token.column);
+        outbuf_printf(out, "%-15s %-20s %-10d %-10d\n", 
+                      token_type_to_string(token.type), 
+                      token.lexeme, 
+                      token.line, 
+                      token.column);
     } while (token.type != TOKEN_EOF);
     
     pos = saved_pos;
     line = saved_line;
     column = saved_column;
 }
+
+void print_tokens() {
+    OutputBuffer out;
+    fflush(stdout);
+    outbuf_init_file(&out, stdout);
+    format_tokens(&out);
+    outbuf_flush(&out);
+    outbuf_free(&out);
+}
@@ -1,16 +1,46 @@
 #include "compiler.h"
 
 static Grammar* grammar = NULL;
-static FirstFollowSet first_sets[MAX_SYMBOLS];
-static FirstFollowSet follow_sets[MAX_SYMBOLS];
+static FirstFollowSet ll_first_sets[MAX_SYMBOLS];
+static FirstFollowSet ll_follow_sets[MAX_SYMBOLS];
 static LLTableEntry ll_table[MAX_SYMBOLS * MAX_SYMBOLS];
 static int ll_table_size = 0;
 
+// A left-recursive grammar, or one whose alternatives share a prefix, is
+// rewritten for the table (see transform_for_ll) and parsed in that form;
+// grammar then points here. ll_origin maps the rewritten productions back
+// to the caller's for print_ll_grammar. The FIRST/FOLLOW sets above are
+// those of the rewrite.
+static Grammar ll_grammar;
+static int ll_origin[MAX_PRODUCTIONS];
+static bool rewritten = false;
+
+// Integer form of the table for the parse loop. predict[A][a] is the
+// production for non-terminal index A on terminal id a, or -1; rhs_ids holds
+// each right-hand side as symbol ids, with ε productions having length 0.
+static int predict[MAX_SYMBOLS][MAX_SYMBOLS];
+static int rhs_ids[MAX_PRODUCTIONS][MAX_PRODUCTIONS];
+static int rhs_len[MAX_PRODUCTIONS];
+
+// Panic-mode synchronizing set: sync[A][a] when terminal a is in FOLLOW(A)
+static bool sync_set[MAX_SYMBOLS][MAX_SYMBOLS];
+
+// left_cycle[A][a] when expanding A on lookahead a comes back to A without
+// consuming input: left recursion the rewrite could not remove, such as
+// recursion hidden behind ε. The parser stops at such cells rather than
+// growing its stack for ever.
+static bool left_cycle[MAX_SYMBOLS][MAX_SYMBOLS];
+
+// Each thread parses on its own stack; capacity is kept between parses
+static _Thread_local ParseStack ll_stack;
+
 void init_ll_parser(Grammar* g) {
     grammar = g;
+    rewritten = false;
     ll_table_size = 0;
-    memset(first_sets, 0, sizeof(first_sets));
-    memset(follow_sets, 0, sizeof(follow_sets));
+    memset(predict, -1, sizeof(predict));
+    memset(ll_first_sets, 0, sizeof(ll_first_sets));
+    memset(ll_follow_sets, 0, sizeof(ll_follow_sets));
 }
 
 static inline bool has_epsilon(const char* symbol, const FirstFollowSet first_sets[], int count) {
@@ -52,288 +82,725 @@ static inline void add_to_follow(FirstFollowSet* set, const char* symbol) {
     }
 }
 
+// Dependency graph of the non-terminals for the FIRST and FOLLOW fixpoints,
+// condensed into strongly connected components. A set only depends on the
+// sets of the symbols it has edges to, so solving one component at a time
+// with its dependencies already final needs one pass for a component
+// without recursion and a short local fixpoint for the rest, whatever
+// order the grammar declares its rules in.
+typedef struct {
+    int edges[MAX_SYMBOLS][MAX_SYMBOLS];
+    int edge_count[MAX_SYMBOLS];
+    int component[MAX_SYMBOLS];     // component of each non-terminal
+    bool cyclic[MAX_SYMBOLS];       // component has a cycle, even a self-loop
+    int count;
+} SymbolGraph;
+
+// Symbols of each production as non-terminal indices, so the fixpoints
+// compare integers rather than names. Right-hand sides are looked up
+// lazily, as FIRST rarely looks past the first symbol.
+#define SYMBOL_TERMINAL (-1)
+#define SYMBOL_EPSILON (-2)
+#define SYMBOL_UNKNOWN (-3)
+#define SYMBOL_UNINDEXED (-4)
+
+static int lhs_index[MAX_PRODUCTIONS];
+static int rhs_index[MAX_PRODUCTIONS][MAX_PRODUCTIONS];
+
+// Work items of each component: productions for FIRST, right-hand side
+// occurrences (production, position) for FOLLOW. Component c owns items
+// start[c] .. start[c + 1] - 1.
+typedef struct {
+    int production;
+    int position;
+} WorkItem;
+
+static WorkItem work_items[MAX_PRODUCTIONS * MAX_PRODUCTIONS];
+static int work_start[MAX_SYMBOLS + 1];
+
+static int non_terminal_index(Grammar* g, const char* symbol) {
+    for (int i = 0; i < g->non_terminal_count; i++) {
+        if (strcmp(g->non_terminals[i], symbol) == 0) return i;
+    }
+    return -1;
+}
+
+static void index_productions(Grammar* g) {
+    for (int i = 0; i < g->prod_count; i++) {
+        lhs_index[i] = non_terminal_index(g, g->productions[i].lhs);
+        for (int r = 0; r < g->productions[i].rhs_count; r++) rhs_index[i][r] = SYMBOL_UNINDEXED;
+    }
+}
+
+static inline int rhs_symbol(Grammar* g, int i, int r) {
+    int k = rhs_index[i][r];
+    if (k != SYMBOL_UNINDEXED) return k;
+    
+    const char* symbol = g->productions[i].rhs[r];
+    k = symbol_id(symbol, g);
+    if (k >= g->terminal_count) k -= g->terminal_count;
+    else if (k >= 0) k = SYMBOL_TERMINAL;
+    else k = strcmp(symbol, "ε") == 0 ? SYMBOL_EPSILON : SYMBOL_UNKNOWN;
+    rhs_index[i][r] = k;
+    return k;
+}
+
+static void add_edge(SymbolGraph* graph, int from, int to) {
+    for (int i = 0; i < graph->edge_count[from]; i++) {
+        if (graph->edges[from][i] == to) return;
+    }
+    graph->edges[from][graph->edge_count[from]++] = to;
+}
+
+// Tarjan's algorithm. Components are numbered in the order they complete,
+// which puts every component after all the components it has edges to.
+typedef struct {
+    SymbolGraph* graph;
+    int index[MAX_SYMBOLS];
+    int low[MAX_SYMBOLS];
+    bool on_stack[MAX_SYMBOLS];
+    int stack[MAX_SYMBOLS];
+    int top;
+    int next_index;
+} TarjanState;
+
+static void strong_connect(TarjanState* t, int v) {
+    SymbolGraph* graph = t->graph;
+    t->index[v] = t->low[v] = t->next_index++;
+    t->stack[t->top++] = v;
+    t->on_stack[v] = true;
+    
+    for (int i = 0; i < graph->edge_count[v]; i++) {
+        int w = graph->edges[v][i];
+        if (t->index[w] < 0) {
+            strong_connect(t, w);
+            if (t->low[w] < t->low[v]) t->low[v] = t->low[w];
+        } else if (t->on_stack[w] && t->index[w] < t->low[v]) {
+            t->low[v] = t->index[w];
+        }
+    }
+    if (t->low[v] != t->index[v]) return;
+    
+    int c = graph->count++;
+    int w;
+    graph->cyclic[c] = false;
+    do {
+        w = t->stack[--t->top];
+        t->on_stack[w] = false;
+        graph->component[w] = c;
+        if (w != v) graph->cyclic[c] = true;
+    } while (w != v);
+    for (int i = 0; i < graph->edge_count[v] && !graph->cyclic[c]; i++) {
+        graph->cyclic[c] = graph->edges[v][i] == v;
+    }
+}
+
+static void find_components(SymbolGraph* graph, int n) {
+    static TarjanState t;
+    t.graph = graph;
+    t.top = 0;
+    t.next_index = 0;
+    graph->count = 0;
+    for (int v = 0; v < n; v++) {
+        t.index[v] = -1;
+        t.on_stack[v] = false;
+    }
+    for (int v = 0; v < n; v++) {
+        if (t.index[v] < 0) strong_connect(&t, v);
+    }
+}
+
+// Counting sort of `count` items into work_items by the component of
+// owner[i]
+static void group_by_component(const SymbolGraph* graph, const WorkItem* items, const int* owner, int count) {
+    memset(work_start, 0, sizeof(work_start));
+    for (int i = 0; i < count; i++) work_start[graph->component[owner[i]] + 1]++;
+    for (int c = 0; c < graph->count; c++) work_start[c + 1] += work_start[c];
+    
+    int fill[MAX_SYMBOLS];
+    memcpy(fill, work_start, sizeof(fill));
+    for (int i = 0; i < count; i++) work_items[fill[graph->component[owner[i]]]++] = items[i];
+}
+
+// Add FIRST of production i's right-hand side to FIRST of its LHS; true
+// when that set grew
+static bool update_first(Grammar* g, FirstFollowSet sets[], const bool* nullable, int i) {
+    Production* prod = &g->productions[i];
+    FirstFollowSet* lhs_set = &sets[lhs_index[i]];
+    
+    // FIRST of the longest nullable prefix of the RHS
+    int old_count = lhs_set->first_count;
+    bool all_nullable = true;
+    
+    for (int r = 0; r < prod->rhs_count; r++) {
+        int k = rhs_symbol(g, i, r);
+        
+        if (k == SYMBOL_EPSILON) {
+            continue;
+        } else if (k == SYMBOL_TERMINAL) {
+            add_to_first(lhs_set, prod->rhs[r]);
+            all_nullable = false;
+            break;
+        } else if (k == SYMBOL_UNKNOWN) {
+            all_nullable = false;
+            break;
+        }
+        
+        // Non-terminal
+        for (int f = 0; f < sets[k].first_count; f++) {
+            if (strcmp(sets[k].first[f], "ε") != 0) {
+                add_to_first(lhs_set, sets[k].first[f]);
+            }
+        }
+        if (!nullable[k]) {
+            all_nullable = false;
+            break;
+        }
+    }
+    
+    if (all_nullable) {
+        add_to_first(lhs_set, "ε");
+    }
+    return lhs_set->first_count != old_count;
+}
+
 void compute_first_sets(Grammar* g, FirstFollowSet sets[]) {
+    PhaseTimer timer = phase_begin();
+    static SymbolGraph graph;
+    static WorkItem items[MAX_PRODUCTIONS];
+    static int owner[MAX_PRODUCTIONS];
+    int n = g->non_terminal_count;
+    
     // Initialize first sets
-    for (int i = 0; i < g->non_terminal_count; i++) {
+    for (int i = 0; i < n; i++) {
         strcpy(sets[i].symbol, g->non_terminals[i]);
         sets[i].first_count = 0;
+        graph.edge_count[i] = 0;
     }
+    index_productions(g);
     
+    // Which symbols can derive ε decides how far into a RHS FIRST looks
+    bool nullable[MAX_SYMBOLS] = { false };
     bool changed = true;
     while (changed) {
         changed = false;
-        
         for (int i = 0; i < g->prod_count; i++) {
-            Production* prod = &g->productions[i];
+            int a = lhs_index[i];
+            if (a < 0 || nullable[a]) continue;
             
-            // Find the set for this LHS
-            FirstFollowSet* lhs_set = NULL;
-            for (int j = 0; j < g->non_terminal_count; j++) {
-                if (strcmp(sets[j].symbol, prod->lhs) == 0) {
-                    lhs_set = &sets[j];
-                    break;
-                }
+            bool all = true;
+            for (int r = 0; r < g->productions[i].rhs_count && all; r++) {
+                int k = rhs_symbol(g, i, r);
+                all = k == SYMBOL_EPSILON || (k >= 0 && nullable[k]);
             }
-            
-            if (lhs_set == NULL) continue;
-            
-            for (int r = 0; r < prod->rhs_count; r++) {
-                const char* rhs = prod->rhs[r];
-                int old_count = lhs_set->first_count;
-                
-                if (strcmp(rhs, "ε") == 0) {
-                    add_to_first(lhs_set, "ε");
-                } else if (is_terminal(rhs, g)) {
-                    add_to_first(lhs_set, rhs);
-                } else {
-                    // Non-terminal
-                    for (int j = 0; j < g->non_terminal_count; j++) {
-                        if (strcmp(sets[j].symbol, rhs) == 0) {
-                            for (int k = 0; k < sets[j].first_count; k++) {
-                                add_to_first(lhs_set, sets[j].first[k]);
-                            }
-                            break;
-                        }
-                    }
-                }
-                
-                if (lhs_set->first_count != old_count) {
-                    changed = true;
-                }
+            if (all) nullable[a] = changed = true;
+        }
+    }
+    
+    // FIRST(A) depends on FIRST(B) when A -> α B β with α nullable
+    int count = 0;
+    for (int i = 0; i < g->prod_count; i++) {
+        int a = lhs_index[i];
+        if (a < 0) continue;
+        for (int r = 0; r < g->productions[i].rhs_count; r++) {
+            int b = rhs_symbol(g, i, r);
+            if (b == SYMBOL_EPSILON) continue;
+            if (b < 0) break;
+            add_edge(&graph, a, b);
+            if (!nullable[b]) break;
+        }
+        items[count].production = i;
+        owner[count++] = a;
+    }
+    find_components(&graph, n);
+    group_by_component(&graph, items, owner, count);
+    
+    for (int c = 0; c < graph.count; c++) {
+        do {
+            changed = false;
+            compiler_stats.first_iterations++;
+            for (int w = work_start[c]; w < work_start[c + 1]; w++) {
+                if (update_first(g, sets, nullable, work_items[w].production)) changed = true;
+            }
+        } while (changed && graph.cyclic[c]);
+    }
+    
+    phase_end(PHASE_FIRST, timer);
+}
+
+// Add to FOLLOW of the symbol at position r of production i what follows
+// it there; true when that set grew
+static bool update_follow(Grammar* g, FirstFollowSet first_sets[], FirstFollowSet follow_sets[],
+                          const bool* nullable, int i, int r) {
+    Production* prod = &g->productions[i];
+    FirstFollowSet* symbol_follow = &follow_sets[rhs_index[i][r]];
+    int old_count = symbol_follow->follow_count;
+    
+    // If this is the last symbol or all following symbols can derive epsilon
+    bool add_lhs_follow = true;
+    
+    // Add FIRST of next symbols (excluding epsilon) to FOLLOW of current symbol
+    for (int k = r + 1; k < prod->rhs_count; k++) {
+        int next = rhs_symbol(g, i, k);
+        
+        if (next == SYMBOL_EPSILON) {
+            continue;
+        } else if (next == SYMBOL_TERMINAL) {
+            add_to_follow(symbol_follow, prod->rhs[k]);
+            add_lhs_follow = false;
+            break;
+        } else if (next == SYMBOL_UNKNOWN) {
+            add_lhs_follow = false;
+            break;
+        }
+        
+        // Add FIRST(next) - {epsilon}
+        for (int m = 0; m < first_sets[next].first_count; m++) {
+            if (strcmp(first_sets[next].first[m], "ε") != 0) {
+                add_to_follow(symbol_follow, first_sets[next].first[m]);
             }
         }
+        
+        // Later symbols only contribute while this one is nullable
+        if (!nullable[next]) {
+            add_lhs_follow = false;
+            break;
+        }
     }
+    
+    // Add FOLLOW(LHS) to FOLLOW(symbol)
+    int j = lhs_index[i];
+    if (add_lhs_follow && j >= 0) {
+        for (int k = 0; k < follow_sets[j].follow_count; k++) {
+            add_to_follow(symbol_follow, follow_sets[j].follow[k]);
+        }
+    }
+    return symbol_follow->follow_count != old_count;
 }
 
 void compute_follow_sets(Grammar* g, FirstFollowSet first_sets[], FirstFollowSet follow_sets[]) {
+    PhaseTimer timer = phase_begin();
+    static SymbolGraph graph;
+    static WorkItem items[MAX_PRODUCTIONS * MAX_PRODUCTIONS];
+    static int owner[MAX_PRODUCTIONS * MAX_PRODUCTIONS];
+    int n = g->non_terminal_count;
+    
     // Initialize follow sets
-    for (int i = 0; i < g->non_terminal_count; i++) {
+    bool nullable[MAX_SYMBOLS];
+    for (int i = 0; i < n; i++) {
         strcpy(follow_sets[i].symbol, g->non_terminals[i]);
         follow_sets[i].follow_count = 0;
+        nullable[i] = has_epsilon(g->non_terminals[i], first_sets, n);
+        graph.edge_count[i] = 0;
     }
+    index_productions(g);
     
     // Add $ to start symbol's follow set
+    int start = non_terminal_index(g, g->start_symbol);
+    if (start >= 0) add_to_follow(&follow_sets[start], "$");
+    
+    // FOLLOW(B) depends on FOLLOW(A) when A -> α B β with β nullable
+    int count = 0;
+    for (int i = 0; i < g->prod_count; i++) {
+        int a = lhs_index[i];
+        bool tail = a >= 0;
+        for (int r = g->productions[i].rhs_count - 1; r >= 0; r--) {
+            int b = rhs_symbol(g, i, r);
+            if (b == SYMBOL_EPSILON) continue;
+            if (b < 0) {
+                tail = false;
+                continue;
+            }
+            if (tail) add_edge(&graph, b, a);
+            tail = tail && nullable[b];
+            items[count].production = i;
+            items[count].position = r;
+            owner[count++] = b;
+        }
+    }
+    find_components(&graph, n);
+    group_by_component(&graph, items, owner, count);
+    
+    for (int c = 0; c < graph.count; c++) {
+        bool changed;
+        do {
+            changed = false;
+            compiler_stats.follow_iterations++;
+            for (int w = work_start[c]; w < work_start[c + 1]; w++) {
+                if (update_follow(g, first_sets, follow_sets, nullable, work_items[w].production, work_items[w].position)) {
+                    changed = true;
+                }
+            }
+        } while (changed && graph.cyclic[c]);
+    }
+    
+    phase_end(PHASE_FOLLOW, timer);
+}
+
+static void add_ll_entry(const char* non_terminal, const char* terminal, int production_index) {
+    if (ll_table_size < MAX_SYMBOLS * MAX_SYMBOLS) {
+        strcpy(ll_table[ll_table_size].non_terminal, non_terminal);
+        strcpy(ll_table[ll_table_size].terminal, terminal);
+        ll_table[ll_table_size].production_index = production_index;
+        ll_table_size++;
+    }
+}
+
+// Convert the string table to predict[][] and rhs_ids[][], and FOLLOW to
+// sync_set[][]. On a conflict the first entry wins, as it always has.
+static void build_predict_table(Grammar* g, FirstFollowSet follow_sets[]) {
+    memset(predict, -1, sizeof(predict));
+    memset(sync_set, 0, sizeof(sync_set));
+    for (int i = ll_table_size - 1; i >= 0; i--) {
+        int a = symbol_id(ll_table[i].non_terminal, g) - g->terminal_count;
+        int t = symbol_id(ll_table[i].terminal, g);
+        if (a >= 0 && t >= 0 && t < g->terminal_count) predict[a][t] = ll_table[i].production_index;
+    }
+    
+    for (int i = 0; i < g->prod_count; i++) {
+        Production* prod = &g->productions[i];
+        bool epsilon = prod->rhs_count == 0 || strcmp(prod->rhs[0], "ε") == 0;
+        rhs_len[i] = epsilon ? 0 : prod->rhs_count;
+        for (int r = 0; r < rhs_len[i]; r++) {
+            rhs_ids[i][r] = symbol_id(prod->rhs[r], g);
+        }
+    }
+    
     for (int i = 0; i < g->non_terminal_count; i++) {
-        if (strcmp(follow_sets[i].symbol, g->start_symbol) == 0) {
-            add_to_follow(&follow_sets[i], "$");
-            break;
+        int a = symbol_id(follow_sets[i].symbol, g) - g->terminal_count;
+        if (a < 0) continue;
+        for (int k = 0; k < follow_sets[i].follow_count; k++) {
+            int t = symbol_id(follow_sets[i].follow[k], g);
+            if (t >= 0 && t < g->terminal_count) sync_set[a][t] = true;
         }
     }
+}
+
+// For each lookahead a, follow the predicted expansions that consume no
+// input: A leads to the first symbol of its production's RHS, and on past
+// each symbol that the table expands to ε on a. A cell is a left cycle when
+// A leads back to itself.
+static void find_left_cycles(Grammar* g) {
+    int terminals = g->terminal_count;
+    int count = g->non_terminal_count;
+    memset(left_cycle, 0, sizeof(left_cycle));
     
-    bool changed = true;
-    while (changed) {
-        changed = false;
-        
-        for (int i = 0; i < g->prod_count; i++) {
-            Production* prod = &g->productions[i];
-            
-            for (int r = 0; r < prod->rhs_count; r++) {
-                const char* symbol = prod->rhs[r];
-                
-                if (!is_non_terminal(symbol, g)) continue;
-                
-                // Find follow set for this symbol
-                FirstFollowSet* symbol_follow = NULL;
-                for (int j = 0; j < g->non_terminal_count; j++) {
-                    if (strcmp(follow_sets[j].symbol, symbol) == 0) {
-                        symbol_follow = &follow_sets[j];
-                        break;
-                    }
+    for (int a = 0; a < terminals; a++) {
+        bool vanishes[MAX_SYMBOLS] = { false };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int n = 0; n < count; n++) {
+                int p = predict[n][a];
+                if (p < 0 || vanishes[n]) continue;
+                bool all = true;
+                for (int r = 0; r < rhs_len[p] && all; r++) {
+                    all = rhs_ids[p][r] >= terminals && vanishes[rhs_ids[p][r] - terminals];
                 }
-                
-                if (symbol_follow == NULL) continue;
-                
-                int old_count = symbol_follow->follow_count;
-                
-                // If this is the last symbol or all following symbols can derive epsilon
-                bool add_lhs_follow = true;
-                
-                // Add FIRST of next symbols (excluding epsilon) to FOLLOW of current symbol
-                for (int k = r + 1; k < prod->rhs_count; k++) {
-                    const char* next = prod->rhs[k];
-                    
-                    if (is_terminal(next, g)) {
-                        add_to_follow(symbol_follow, next);
-                        add_lhs_follow = false;
-                        break;
-                    } else {
-                        // Add FIRST(next) - {epsilon}
-                        for (int f = 0; f < g->non_terminal_count; f++) {
-                            if (strcmp(first_sets[f].symbol, next) == 0) {
-                                for (int m = 0; m < first_sets[f].first_count; m++) {
-                                    if (strcmp(first_sets[f].first[m], "ε") != 0) {
-                                        add_to_follow(symbol_follow, first_sets[f].first[m]);
-                                    }
-                                }
-                                
-                                if (!has_epsilon(next, first_sets, g->non_terminal_count)) {
-                                    add_lhs_follow = false;
-                                }
-                                break;
-                            }
-                        }
-                    }
+                if (all) {
+                    vanishes[n] = true;
+                    changed = true;
                 }
-                
-                // Add FOLLOW(LHS) to FOLLOW(symbol)
-                if (add_lhs_follow) {
-                    for (int j = 0; j < g->non_terminal_count; j++) {
-                        if (strcmp(follow_sets[j].symbol, prod->lhs) == 0) {
-                            for (int k = 0; k < follow_sets[j].follow_count; k++) {
-                                add_to_follow(symbol_follow, follow_sets[j].follow[k]);
-                            }
-                            break;
-                        }
+            }
+        }
+        
+        for (int n = 0; n < count; n++) {
+            if (predict[n][a] < 0) continue;
+            
+            // Depth-first search from n's successors
+            bool seen[MAX_SYMBOLS] = { false };
+            int pending[MAX_SYMBOLS];
+            int top = 0;
+            pending[top++] = n;
+            while (top > 0 && !left_cycle[n][a]) {
+                int m = pending[--top];
+                int p = predict[m][a];
+                if (p < 0) continue;
+                for (int r = 0; r < rhs_len[p]; r++) {
+                    int next = rhs_ids[p][r] - terminals;
+                    if (next < 0) break;
+                    if (next == n) left_cycle[n][a] = true;
+                    if (!seen[next]) {
+                        seen[next] = true;
+                        pending[top++] = next;
                     }
-                }
-                
-                if (symbol_follow->follow_count != old_count) {
-                    changed = true;
+                    if (!vanishes[next]) break;
                 }
             }
         }
     }
 }
 
+// The table is built for `g`, or for its LL rewrite when it has left
+// recursion or common prefixes; `first_sets` and `follow_sets` must be g's
+// and are only used in the first case.
 void build_ll_table(Grammar* g, FirstFollowSet first_sets[], FirstFollowSet follow_sets[]) {
+    grammar = g;
+    rewritten = transform_for_ll(g, &ll_grammar, ll_origin) > 0;
+    if (rewritten) {
+        g = grammar = &ll_grammar;
+        compute_first_sets(g, ll_first_sets);
+        compute_follow_sets(g, ll_first_sets, ll_follow_sets);
+        first_sets = ll_first_sets;
+        follow_sets = ll_follow_sets;
+    }
+    
+    PhaseTimer timer = phase_begin();
     ll_table_size = 0;
     
     for (int i = 0; i < g->prod_count; i++) {
         Production* prod = &g->productions[i];
+        bool nullable = true;
         
-        for (int r = 0; r < prod->rhs_count; r++) {
-            const char* first_symbol = prod->rhs[r];
+        // M[A, a] for every a in FIRST(RHS)
+        for (int r = 0; r < prod->rhs_count && nullable; r++) {
+            const char* symbol = prod->rhs[r];
             
-            if (strcmp(first_symbol, "ε") == 0) {
-                // Add to table for all terminals in FOLLOW(LHS)
-                for (int j = 0; j < g->non_terminal_count; j++) {
-                    if (strcmp(follow_sets[j].symbol, prod->lhs) == 0) {
-                        for (int k = 0; k < follow_sets[j].follow_count; k++) {
-                            if (ll_table_size < MAX_SYMBOLS * MAX_SYMBOLS) {
-                                strcpy(ll_table[ll_table_size].non_terminal, prod->lhs);
-                                strcpy(ll_table[ll_table_size].terminal, follow_sets[j].follow[k]);
-                                ll_table[ll_table_size].production_index = i;
-                                ll_table_size++;
-                            }
-                        }
-                        break;
-                    }
-                }
-            } else if (is_terminal(first_symbol, g)) {
-                if (ll_table_size < MAX_SYMBOLS * MAX_SYMBOLS) {
-                    strcpy(ll_table[ll_table_size].non_terminal, prod->lhs);
-                    strcpy(ll_table[ll_table_size].terminal, first_symbol);
-                    ll_table[ll_table_size].production_index = i;
-                    ll_table_size++;
-                }
+            if (strcmp(symbol, "ε") == 0) {
+                continue;
+            } else if (is_terminal(symbol, g)) {
+                add_ll_entry(prod->lhs, symbol, i);
+                nullable = false;
             } else {
-                // Non-terminal: add for all terminals in FIRST(first_symbol)
+                // Non-terminal: add for all terminals in FIRST(symbol)
                 for (int j = 0; j < g->non_terminal_count; j++) {
-                    if (strcmp(first_sets[j].symbol, first_symbol) == 0) {
+                    if (strcmp(first_sets[j].symbol, symbol) == 0) {
                         for (int k = 0; k < first_sets[j].first_count; k++) {
                             if (strcmp(first_sets[j].first[k], "ε") != 0) {
-                                if (ll_table_size < MAX_SYMBOLS * MAX_SYMBOLS) {
-                                    strcpy(ll_table[ll_table_size].non_terminal, prod->lhs);
-                                    strcpy(ll_table[ll_table_size].terminal, first_sets[j].first[k]);
-                                    ll_table[ll_table_size].production_index = i;
-                                    ll_table_size++;
-                                }
+                                add_ll_entry(prod->lhs, first_sets[j].first[k], i);
                             }
                         }
                         break;
                     }
                 }
+                nullable = has_epsilon(symbol, first_sets, g->non_terminal_count);
+            }
+        }
+        
+        // M[A, b] for every b in FOLLOW(A) when the RHS can derive epsilon
+        if (nullable) {
+            for (int j = 0; j < g->non_terminal_count; j++) {
+                if (strcmp(follow_sets[j].symbol, prod->lhs) == 0) {
+                    for (int k = 0; k < follow_sets[j].follow_count; k++) {
+                        add_ll_entry(prod->lhs, follow_sets[j].follow[k], i);
+                    }
+                    break;
+                }
             }
         }
     }
+    
+    build_predict_table(g, follow_sets);
+    find_left_cycles(g);
+    phase_end(PHASE_LL_TABLE, timer);
 }
 
-int find_production(const char* non_terminal, const char* terminal) {
-    for (int i = 0; i < ll_table_size; i++) {
-        if (strcmp(ll_table[i].non_terminal, non_terminal) == 0 &&
-            strcmp(ll_table[i].terminal, terminal) == 0) {
-            return ll_table[i].production_index;
-        }
+bool parse_ll(const char* input) {
+    return parse_ll_tree(input, NULL, NULL);
+}
+
+static void trace_ll(TraceSink* trace, int step, TraceAction action, TraceError error,
+                     int production, int symbol, int token) {
+    TraceEvent event = { step, TRACE_LL, (unsigned char)action, (unsigned char)error,
+                         production, -1, symbol, token, -1 };
+    trace->emit(trace, &event);
+}
+
+static void trace_recover(TraceSink* trace, int step, int symbol, int token, int depth) {
+    TraceEvent event = { step, TRACE_LL, TRACE_RECOVER, TRACE_ERROR_NONE, -1, -1, symbol, token, depth };
+    trace->emit(trace, &event);
+}
+
+// "unexpected X; expected ..." for an empty table cell of non-terminal `a`
+static void report_no_production(int a, const Token* token) {
+    const char* expected[MAX_SYMBOLS];
+    int count = 0;
+    char text[MAX_DIAGNOSTIC_LEN];
+    
+    for (int t = 0; t < grammar->terminal_count; t++) {
+        if (predict[a][t] >= 0) expected[count++] = grammar->terminals[t];
+    }
+    format_expected(text, sizeof(text), expected, count);
+    add_diagnostic(token, "unexpected %s while parsing %s; expected %s",
+                   describe_token(token), grammar->non_terminals[a], text);
+}
+
+// Terminal id of the lookahead token, or -1 when the grammar has none
+static int lookahead_id(const Token* token) {
+    const char* terminal = terminal_for_token(token, grammar);
+    for (int i = 0; i < grammar->terminal_count; i++) {
+        if (strcmp(grammar->terminals[i], terminal) == 0) return i;
     }
     return -1;
 }
 
-bool parse_ll(const char* input) {
+// Predictive parse of `input`. The stack holds symbol ids, so terminals
+// are the ids below terminal_count and each step is an integer compare or
+// one predict[][] lookup. When `tree` is non-NULL the parse tree is built
+// alongside: every stack entry carries the node it will become, and
+// expanding a non-terminal creates all of its children at once. Each step
+// is reported to `trace` when it is non-NULL.
+//
+// Syntax errors are recovered from in panic mode: a missing terminal is
+// popped as if it had been there, and a non-terminal with no production is
+// popped when the lookahead is in its FOLLOW set, otherwise the token is
+// skipped. Errors are reported once per recovery, up to the next match.
+static bool ll_parse(const char* input, ParseTree* tree, TraceSink* trace) {
     init_lexer(input);
     
-    char stack[MAX_STACK][MAX_TOKEN_LEN];
-    int stack_top = 0;
+    ParseStack* stack = &ll_stack;
+    int terminals = grammar->terminal_count;
+    int end = symbol_id("$", grammar);
+    int start = symbol_id(grammar->start_symbol, grammar);
+    int root = -1;
+    int step = 0;
+    int token_index = 0;
+    int errors = 0;
+    bool recovering = false;
+    
+    if (tree) {
+        parse_tree_reset(tree);
+        root = parse_tree_add_node(tree, start, -1);
+    }
     
     // Push $ and start symbol
-    strcpy(stack[stack_top++], "$");
-    strcpy(stack[stack_top++], grammar->start_symbol);
+    if (!parse_stack_reserve(stack, 2)) {
+        if (trace) trace_ll(trace, step, TRACE_ERROR, TRACE_ERROR_OVERFLOW, -1, start, token_index);
+        return false;
+    }
+    stack->top = 0;
+    stack->ids[stack->top] = end;
+    stack->nodes[stack->top++] = -1;
+    stack->ids[stack->top] = start;
+    stack->nodes[stack->top++] = root;
     
     Token current_token = get_next_token();
+    int lookahead = lookahead_id(&current_token);
     
-    printf("\n=== LL PARSING ===\n");
-    printf("%-30s %-30s %-30s\n", "STACK", "INPUT", "ACTION");
-    printf("--------------------------------------------------------------------------------------\n");
-    
-    while (stack_top > 0) {
-        // Print current state
-        printf("%-30s", "");
-        for (int i = stack_top - 1; i >= 0; i--) {
-            printf("%s ", stack[i]);
-        }
-        printf("\t%-30s", current_token.lexeme);
+    for (; stack->top > 0; step++) {
+        int top = stack->ids[stack->top - 1];
         
-        char* top = stack[stack_top - 1];
-        
-        if (strcmp(top, "$") == 0) {
+        if (top == end) {
             if (current_token.type == TOKEN_EOF) {
-                printf("ACCEPT\n");
-                return true;
+                if (errors > 0) return false;
+                if (trace) trace_ll(trace, step, TRACE_ACCEPT, TRACE_ERROR_NONE, -1, -1, token_index);
+                return tree ? parse_tree_finish(tree, root) : true;
             } else {
-                printf("ERROR: Unexpected input\n");
+                if (trace) trace_ll(trace, step, TRACE_ERROR, TRACE_ERROR_UNEXPECTED, -1, -1, token_index);
+                add_diagnostic(&current_token, "unexpected %s; expected end of input", describe_token(&current_token));
                 return false;
             }
         }
         
-        if (is_terminal(top, grammar) || strcmp(top, "$") == 0) {
-            if (strcmp(top, current_token.lexeme) == 0) {
-                printf("MATCH %s\n", top);
-                stack_top--;
+        if (top < terminals) {
+            if (top == lookahead) {
+                if (trace) trace_ll(trace, step, TRACE_MATCH, TRACE_ERROR_NONE, -1, top, token_index);
+                compiler_stats.matches++;
+                if (tree) parse_tree_set_token(tree, stack->nodes[stack->top - 1], &current_token);
+                stack->top--;
                 current_token = get_next_token();
+                lookahead = lookahead_id(&current_token);
+                token_index++;
+                recovering = false;
             } else {
-                printf("ERROR: Expected %s but got %s\n", top, current_token.lexeme);
-                return false;
+                if (trace) trace_ll(trace, step, TRACE_ERROR, TRACE_ERROR_MISMATCH, -1, top, token_index);
+                if (!recovering) {
+                    add_diagnostic(&current_token, "expected '%s' but found %s",
+                                   grammar->terminals[top], describe_token(&current_token));
+                    errors++;
+                    recovering = true;
+                }
+                
+                // A token the grammar does not know is skipped; otherwise
+                // the terminal is treated as missing
+                if (lookahead < 0) {
+                    if (trace) trace_recover(trace, step, -1, token_index, stack->top);
+                    current_token = get_next_token();
+                    lookahead = lookahead_id(&current_token);
+                    token_index++;
+                } else {
+                    stack->top--;
+                    if (trace) trace_recover(trace, step, top, token_index, stack->top);
+                }
             }
         } else {
             // Non-terminal
-            int prod_index = find_production(top, current_token.lexeme);
+            int prod_index = lookahead >= 0 ? predict[top - terminals][lookahead] : -1;
+            compiler_stats.ll_lookups++;
             
             if (prod_index == -1) {
-                printf("ERROR: No production for [%s, %s]\n", top, current_token.lexeme);
+                if (trace) trace_ll(trace, step, TRACE_ERROR, TRACE_ERROR_NO_PRODUCTION, -1, top, token_index);
+                if (!recovering) {
+                    report_no_production(top - terminals, &current_token);
+                    errors++;
+                    recovering = true;
+                }
+                
+                // Synchronize: give up on the non-terminal once the lookahead
+                // can follow it (always at end of input), else skip the token
+                if (lookahead == end || (lookahead >= 0 && sync_set[top - terminals][lookahead])) {
+                    stack->top--;
+                    if (trace) trace_recover(trace, step, top, token_index, stack->top);
+                } else {
+                    if (trace) trace_recover(trace, step, -1, token_index, stack->top);
+                    current_token = get_next_token();
+                    lookahead = lookahead_id(&current_token);
+                    token_index++;
+                }
+                continue;
+            }
+            
+            if (left_cycle[top - terminals][lookahead]) {
+                if (trace) trace_ll(trace, step, TRACE_ERROR, TRACE_ERROR_LEFT_RECURSION, prod_index, top, token_index);
+                add_diagnostic(&current_token, "left recursion: %s on %s never consumes input",
+                               grammar->non_terminals[top - terminals], describe_token(&current_token));
                 return false;
             }
             
-            Production* prod = &grammar->productions[prod_index];
-            printf("Use %s ->", prod->lhs);
-            for (int i = 0; i < prod->rhs_count; i++) {
-                printf(" %s", prod->rhs[i]);
+            int len = rhs_len[prod_index];
+            const int* rhs = rhs_ids[prod_index];
+            
+            if (!parse_stack_reserve(stack, stack->top - 1 + len)) {
+                if (trace) trace_ll(trace, step, TRACE_ERROR, TRACE_ERROR_OVERFLOW, prod_index, top, token_index);
+                return false;
             }
-            printf("\n");
+            if (trace) trace_ll(trace, step, TRACE_EXPAND, TRACE_ERROR_NONE, prod_index, top, token_index);
+            compiler_stats.expansions++;
             
-            stack_top--;
+            int parent = stack->nodes[--stack->top];
+            int children[MAX_PRODUCTIONS];
             
-            // Push RHS in reverse order (skip epsilon)
-            if (strcmp(prod->rhs[0], "ε") != 0) {
-                for (int i = prod->rhs_count - 1; i >= 0; i--) {
-                    strcpy(stack[stack_top++], prod->rhs[i]);
+            if (tree && parent >= 0) {
+                tree->build[parent].production = prod_index;
+                if (len > 0) {
+                    for (int i = 0; i < len; i++) {
+                        children[i] = parse_tree_add_node(tree, rhs[i], -1);
+                    }
+                    parse_tree_set_children(tree, parent, children, len);
                 }
             }
+            
+            // Push RHS in reverse order
+            for (int i = len - 1; i >= 0; i--) {
+                stack->ids[stack->top] = rhs[i];
+                stack->nodes[stack->top++] = tree && parent >= 0 ? children[i] : -1;
+            }
+            if (stack->top > compiler_stats.ll_max_depth) compiler_stats.ll_max_depth = stack->top;
         }
     }
     
-    printf("ERROR: Stack empty but input remaining\n");
+    if (trace) trace_ll(trace, step, TRACE_ERROR, TRACE_ERROR_STACK_EMPTY, -1, -1, token_index);
     return false;
 }
 
+bool parse_ll_tree(const char* input, ParseTree* tree, TraceSink* trace) {
+    PhaseTimer timer = phase_begin();
+    reset_diagnostics();
+    bool accepted = ll_parse(input, tree, trace);
+    phase_end(PHASE_LL_PARSE, timer);
+    return accepted;
+}
+
 void print_first_follow_sets(FirstFollowSet sets[], int count) {
     printf("\n=== FIRST SETS ===\n");
     for (int i = 0; i < count; i++) {
@@ -351,3 +818,31 @@ void print_first_follow_sets(FirstFollowSet sets[], int count) {
 int get_ll_table_size() {
     return ll_table_size;
 }
+
+// The grammar the LL parser works on, which parse traces must be
+// formatted with
+Grammar* get_ll_grammar() {
+    return grammar;
+}
+
+void print_ll_grammar() {
+    if (!rewritten) return;
+    
+    printf("\n=== GRAMMAR REWRITTEN FOR LL(1) ===\n");
+    for (int i = 0; i < grammar->prod_count; i++) {
+        Production* p = &grammar->productions[i];
+        char line[256];
+        int len = snprintf(line, sizeof(line), "%d. %s ->", i + 1, p->lhs);
+        for (int j = 0; j < p->rhs_count && len < (int)sizeof(line); j++) {
+            len += snprintf(line + len, sizeof(line) - (size_t)len, " %s", p->rhs[j]);
+        }
+        printf("%s", line);
+        if (ll_origin[i] >= 0) {
+            // Pad by display width; "ε" and primes are wider in bytes
+            int width = 0;
+            for (const char* c = line; *c; c++) width += (*c & 0xC0) != 0x80;
+            printf("%*s(from %d)", width < 28 ? 28 - width : 1, "", ll_origin[i] + 1);
+        }
+        printf("\n");
+    }
+}
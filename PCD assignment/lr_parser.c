@@ -5,16 +5,156 @@ static LRState states[MAX_STATES];
 static int state_count = 0;
 static LRTableEntry action_table[MAX_STATES][MAX_SYMBOLS];
 static int goto_table[MAX_STATES][MAX_SYMBOLS];
+static bool table_built = false;
+
+// Item sets are looked up by kernel, the items with the dot past the start,
+// which decides the rest of the set. kernel_hash[s] is state s's kernel
+// hash and state_slot an open-addressing table of states by that hash (-1
+// when free), so a GOTO target is found without comparing against every
+// state and is only closed when it is new.
+#define STATE_HASH_SIZE 256     // power of two, over twice MAX_STATES
+
+static uint64_t kernel_hash[MAX_STATES];
+static int state_slot[STATE_HASH_SIZE];
+
+// Column (terminal index, or terminal_count + non-terminal index) of the
+// symbol after the dot at each position, -1 at the end, and each
+// non-terminal's productions
+static int next_column[MAX_PRODUCTIONS + 1][MAX_PRODUCTIONS + 1];
+static int lhs_productions[MAX_SYMBOLS][MAX_PRODUCTIONS];
+static int lhs_production_count[MAX_SYMBOLS];
+static int conflict_count = 0;
+
+// Per-production reduce data for the parse loop: length popped and the
+// non-terminal index pushed
+static int reduce_len[MAX_PRODUCTIONS];
+static int reduce_lhs[MAX_PRODUCTIONS];
+
+// Each thread parses on its own stack; capacity is kept between parses
+static _Thread_local ParseStack lr_stack;
+
+// Every action of a conflicted cell, for the GLR parser. action_table keeps
+// the deterministic choice; conflict_list[s][t] is the first of the cell's
+// actions in conflict_actions, or -1 when the cell has at most one.
+#define MAX_CONFLICT_ACTIONS (MAX_STATES * MAX_SYMBOLS)
+
+typedef struct {
+    LRTableEntry entry;
+    int next;
+} ConflictAction;
+
+static ConflictAction conflict_actions[MAX_CONFLICT_ACTIONS];
+static int conflict_action_count = 0;
+static int conflict_list[MAX_STATES][MAX_SYMBOLS];
+static bool conflict_overflow = false;
+
+static FirstFollowSet lr_first_sets[MAX_SYMBOLS];
+static FirstFollowSet lr_follow_sets[MAX_SYMBOLS];
+
+// FOLLOW of each non-terminal as terminal columns, where reductions go
+static int follow_columns[MAX_SYMBOLS][MAX_SYMBOLS];
+static int follow_column_count[MAX_SYMBOLS];
+
+// Declared precedence (0 when none) of each terminal and of each production,
+// which takes its last terminal's. precedence_cell marks the cells a
+// shift/reduce conflict was settled in; a %nonassoc tie leaves them errors.
+static const PrecedenceDecl* terminal_prec[MAX_SYMBOLS];
+static int production_prec[MAX_PRODUCTIONS];
+static bool precedence_cell[MAX_STATES][MAX_SYMBOLS];
+static int resolved_count = 0;
+
+// Compressed tables for the deterministic parse loop. Actions are 16-bit
+// codes: 0 error, s + 1 shift to s, -(p + 1) reduce by p, where reducing
+// the augmented production accepts. Each state's most common reduction is
+// its default and is left out of its row, and the rows are overlaid in one
+// comb array: row s starts at action_base[s], and a slot belongs to s only
+// when action_check holds s. GOTO columns are packed the same way, with
+// the most common target of each non-terminal as its default. Cells a
+// %nonassoc declaration made errors are kept as explicit 0 entries, so the
+// default reduction cannot hide them. The combs are allocated only when
+// compression is on, sized for the grammar's rows and then trimmed to the
+// packed length.
+typedef int16_t PackedAction;
+
+static bool compact_mode = false;
+static bool compact_ready = false;
+static PackedAction action_default[MAX_STATES];
+static int16_t action_base[MAX_STATES];
+static PackedAction* action_comb = NULL;
+static int16_t* action_check = NULL;
+static int action_comb_length = 0;
+static int16_t goto_default[MAX_SYMBOLS];
+static int16_t goto_base[MAX_SYMBOLS];
+static int16_t* goto_comb = NULL;
+static int16_t* goto_check = NULL;
+static int goto_comb_length = 0;
+static int default_reductions = 0;
+
+// Lazy construction: the table starts with state 0 and a state's
+// transitions and reductions are filled in the first time a parse enters
+// it (expanded[s]). The states then differ in numbering from a full build.
+// Expanding writes the shared tables, so it is for single-threaded use.
+static bool lazy_mode = false;
+static bool expanded[MAX_STATES];
+static int end_column = -1;
 
 void init_lr_parser(Grammar* g) {
     grammar = g;
     state_count = 0;
-    memset(states, 0, sizeof(states));
-    memset(action_table, 0, sizeof(action_table));
-    memset(goto_table, -1, sizeof(goto_table));
+    table_built = false;
+    compact_ready = false;
+    conflict_count = 0;
+    resolved_count = 0;
+    conflict_action_count = 0;
+}
+
+// The augmented production S' -> S uses index prod_count
+static inline bool is_augmented(int prod_index) {
+    return prod_index == grammar->prod_count;
+}
+
+static inline int rhs_length(int prod_index) {
+    if (is_augmented(prod_index)) return 1;
+    Production* prod = &grammar->productions[prod_index];
+    if (prod->rhs_count == 1 && strcmp(prod->rhs[0], "ε") == 0) return 0;
+    return prod->rhs_count;
+}
+
+static inline const char* rhs_symbol(int prod_index, int pos) {
+    if (is_augmented(prod_index)) return grammar->start_symbol;
+    return grammar->productions[prod_index].rhs[pos];
+}
+
+static int terminal_index(const char* symbol) {
+    for (int i = 0; i < grammar->terminal_count; i++) {
+        if (strcmp(grammar->terminals[i], symbol) == 0) return i;
+    }
+    return -1;
+}
+
+static int non_terminal_index(const char* symbol) {
+    for (int i = 0; i < grammar->non_terminal_count; i++) {
+        if (strcmp(grammar->non_terminals[i], symbol) == 0) return i;
+    }
+    return -1;
+}
+
+static void print_augmented_lhs() {
+    // Prime the start symbol until the name is not already taken
+    char name[MAX_TOKEN_LEN + 8];
+    snprintf(name, sizeof(name), "%s'", grammar->start_symbol);
+    while (is_non_terminal(name, grammar) && strlen(name) < sizeof(name) - 1) {
+        strcat(name, "'");
+    }
+    printf("%s", name);
 }
 
 void print_production(int prod_index) {
+    if (is_augmented(prod_index)) {
+        print_augmented_lhs();
+        printf(" -> %s", grammar->start_symbol);
+        return;
+    }
     if (prod_index < 0 || prod_index >= grammar->prod_count) return;
     
     Production* prod = &grammar->productions[prod_index];
@@ -24,170 +164,1186 @@ void print_production(int prod_index) {
     }
 }
 
+static void print_item(LRItem item) {
+    if (is_augmented(item.production_index)) {
+        print_augmented_lhs();
+    } else {
+        printf("%s", grammar->productions[item.production_index].lhs);
+    }
+    printf(" ->");
+    
+    int len = rhs_length(item.production_index);
+    for (int i = 0; i < len; i++) {
+        if (i == item.dot_position) printf(" .");
+        printf(" %s", rhs_symbol(item.production_index, i));
+    }
+    if (item.dot_position == len) printf(" .");
+}
+
+static int compare_items(const void* a, const void* b) {
+    const LRItem* x = a;
+    const LRItem* y = b;
+    if (x->production_index != y->production_index) return x->production_index - y->production_index;
+    return x->dot_position - y->dot_position;
+}
+
+// Add [B -> . γ] for every non-terminal B right after a dot, then sort the
+// items so equal states compare equal with memcmp. Only kernel items have
+// the dot past the start (state 0's augmented item aside), so each B's
+// productions are added once and never duplicate an item already there.
+static bool closure(LRState* state) {
+    bool expanded[MAX_SYMBOLS] = { false };
+    for (int i = 0; i < state->item_count; i++) {
+        LRItem item = state->items[i];
+        int column = next_column[item.production_index][item.dot_position];
+        if (column < grammar->terminal_count) continue;
+        
+        int a = column - grammar->terminal_count;
+        if (expanded[a]) continue;
+        expanded[a] = true;
+        
+        if (state->item_count + lhs_production_count[a] > MAX_LR_ITEMS) return false;
+        for (int j = 0; j < lhs_production_count[a]; j++) {
+            state->items[state->item_count].production_index = lhs_productions[a][j];
+            state->items[state->item_count].dot_position = 0;
+            state->item_count++;
+        }
+    }
+    
+    qsort(state->items, (size_t)state->item_count, sizeof(LRItem), compare_items);
+    return true;
+}
+
+static inline bool is_kernel_item(LRItem item) {
+    return item.dot_position > 0 || is_augmented(item.production_index);
+}
+
+// Does `state` (closed and sorted) have exactly the sorted `kernel`?
+static bool has_kernel(const LRState* state, const LRItem* kernel, int count) {
+    int k = 0;
+    for (int i = 0; i < state->item_count; i++) {
+        if (!is_kernel_item(state->items[i])) continue;
+        if (k == count || compare_items(&state->items[i], &kernel[k]) != 0) return false;
+        k++;
+    }
+    return k == count;
+}
+
+// The state whose kernel is `kernel`, or -1; `*slot` is left at the free
+// slot the kernel would be added in
+static int find_state(const LRItem* kernel, int count, uint64_t hash, int* slot) {
+    int i = (int)(hash & (STATE_HASH_SIZE - 1));
+    while (state_slot[i] >= 0) {
+        int s = state_slot[i];
+        if (kernel_hash[s] == hash && has_kernel(&states[s], kernel, count)) return s;
+        i = (i + 1) & (STATE_HASH_SIZE - 1);
+    }
+    *slot = i;
+    return -1;
+}
+
+// Close `kernel` into a new state and clear its table rows. Returns the
+// state, or -1 past the limits. Rows past state_count are never read, so
+// only the rows of states that exist are cleared.
+static int add_state(const LRItem* kernel, int count, uint64_t hash, int slot) {
+    if (state_count >= MAX_STATES) return -1;
+    
+    LRState* state = &states[state_count];
+    memcpy(state->items, kernel, (size_t)count * sizeof(LRItem));
+    state->item_count = count;
+    if (!closure(state)) return -1;
+    
+    for (int j = 0; j < MAX_SYMBOLS; j++) {
+        action_table[state_count][j].action = ACTION_ERROR;
+        action_table[state_count][j].state = -1;
+    }
+    memset(goto_table[state_count], -1, sizeof(goto_table[state_count]));
+    memset(conflict_list[state_count], -1, sizeof(conflict_list[state_count]));
+    memset(precedence_cell[state_count], 0, sizeof(precedence_cell[state_count]));
+    
+    expanded[state_count] = false;
+    kernel_hash[state_count] = hash;
+    state_slot[slot] = state_count;
+    return state_count++;
+}
+
+// Symbol columns and per-non-terminal production lists for the item set
+// construction, so it compares integers rather than names
+static void index_items() {
+    int columns = grammar->terminal_count + grammar->non_terminal_count;
+    memset(lhs_production_count, 0, sizeof(lhs_production_count));
+    for (int p = 0; p <= grammar->prod_count; p++) {
+        int len = rhs_length(p);
+        for (int i = 0; i < len; i++) {
+            const char* symbol = rhs_symbol(p, i);
+            int column = terminal_index(symbol);
+            if (column < 0) {
+                column = non_terminal_index(symbol);
+                if (column >= 0) column += grammar->terminal_count;
+            }
+            next_column[p][i] = column < columns ? column : -1;
+        }
+        next_column[p][len] = -1;
+        
+        if (p == grammar->prod_count) continue;
+        int a = non_terminal_index(grammar->productions[p].lhs);
+        if (a >= 0) lhs_productions[a][lhs_production_count[a]++] = p;
+    }
+}
+
+static bool add_conflict_action(int state, int terminal, LRTableEntry entry) {
+    int* link = &conflict_list[state][terminal];
+    while (*link >= 0) {
+        const LRTableEntry* known = &conflict_actions[*link].entry;
+        if (known->action == entry.action && known->state == entry.state) return false;
+        link = &conflict_actions[*link].next;
+    }
+    if (conflict_action_count >= MAX_CONFLICT_ACTIONS) {
+        conflict_overflow = true;
+        return true;
+    }
+    
+    conflict_actions[conflict_action_count].entry = entry;
+    conflict_actions[conflict_action_count].next = -1;
+    *link = conflict_action_count++;
+    return true;
+}
+
+// Keep every action of a conflicted cell for the GLR parser. Returns false
+// when the cell already had this action.
+static bool record_conflict(int state, int terminal, LRActionType action, int target) {
+    LRTableEntry entry = { action, target };
+    if (conflict_list[state][terminal] < 0) add_conflict_action(state, terminal, action_table[state][terminal]);
+    return add_conflict_action(state, terminal, entry);
+}
+
+// Settle a shift/reduce conflict on `terminal` against `production` the
+// way yacc does: the tighter of the two wins, and on a tie the
+// associativity decides. Returns false when either has no precedence.
+static bool resolve_by_precedence(int state, int terminal, int shift_target, int production) {
+    const PrecedenceDecl* shift = terminal_prec[terminal];
+    int reduce = production_prec[production];
+    if (shift == NULL || reduce == 0) return false;
+    
+    LRTableEntry* entry = &action_table[state][terminal];
+    if (reduce > shift->level || (reduce == shift->level && shift->assoc == ASSOC_LEFT)) {
+        entry->action = ACTION_REDUCE;
+        entry->state = production;
+    } else if (reduce < shift->level || shift->assoc == ASSOC_RIGHT) {
+        entry->action = ACTION_SHIFT;
+        entry->state = shift_target;
+    } else {
+        entry->action = ACTION_ERROR;
+        entry->state = -1;
+    }
+    precedence_cell[state][terminal] = true;
+    resolved_count++;
+    return true;
+}
+
+static void set_action(int state, int terminal, LRActionType action, int target) {
+    LRTableEntry* entry = &action_table[state][terminal];
+    
+    // Already settled by precedence, including %nonassoc errors
+    if (precedence_cell[state][terminal]) return;
+    if (entry->action == ACTION_ERROR) {
+        entry->action = action;
+        entry->state = target;
+        return;
+    }
+    if (entry->action == action && entry->state == target) return;
+    
+    // A first shift/reduce clash on the cell may be settled by precedence,
+    // which is not a conflict and leaves GLR nothing to fork on
+    if (conflict_list[state][terminal] < 0) {
+        if (entry->action == ACTION_SHIFT && action == ACTION_REDUCE &&
+            resolve_by_precedence(state, terminal, entry->state, target)) return;
+        if (entry->action == ACTION_REDUCE && action == ACTION_SHIFT &&
+            resolve_by_precedence(state, terminal, target, entry->state)) return;
+    }
+    if (!record_conflict(state, terminal, action, target)) return;
+    
+    // Conflict: keep the shift over a reduce, and the earlier production
+    // in a reduce/reduce conflict
+    conflict_count++;
+    if (action == ACTION_SHIFT) {
+        entry->action = action;
+        entry->state = target;
+    } else if (action == ACTION_REDUCE && entry->action == ACTION_REDUCE && target < entry->state) {
+        entry->state = target;
+    }
+}
+
+static PackedAction pack_action(LRTableEntry entry) {
+    switch (entry.action) {
+        case ACTION_SHIFT: return (PackedAction)(entry.state + 1);
+        case ACTION_REDUCE: return (PackedAction)-(entry.state + 1);
+        case ACTION_ACCEPT: return (PackedAction)-(grammar->prod_count + 1);
+        default: return 0;
+    }
+}
+
+// Overlay one row on the comb at the lowest base where its stored columns
+// all land on free slots. The comb is extended to base + width so lookups
+// of any column stay in bounds. Returns the base, or -1 when full.
+static int place_row(int16_t* comb, int16_t* check, int capacity, int* length, int key,
+                     const int* columns, const int16_t* values, int count, int width) {
+    for (int base = 0; base + width <= capacity; base++) {
+        bool fits = true;
+        for (int i = 0; i < count && fits; i++) fits = check[base + columns[i]] < 0;
+        if (!fits) continue;
+        
+        for (int i = 0; i < count; i++) {
+            comb[base + columns[i]] = values[i];
+            check[base + columns[i]] = (int16_t)key;
+        }
+        if (base + width > *length) *length = base + width;
+        return base;
+    }
+    return -1;
+}
+
+static int row_counts[MAX_STATES];
+
+// Densest rows first pack tightest
+static int compare_row_counts(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    if (row_counts[x] != row_counts[y]) return row_counts[y] - row_counts[x];
+    return x - y;
+}
+
+static void free_compact_tables() {
+    free(action_comb);
+    free(action_check);
+    free(goto_comb);
+    free(goto_check);
+    action_comb = action_check = goto_comb = goto_check = NULL;
+}
+
+// Give back the unused tail of a comb and its check array
+static void trim_comb(int16_t** comb, int16_t** check, int length) {
+    size_t size = (size_t)(length > 0 ? length : 1) * sizeof(int16_t);
+    int16_t* p = realloc(*comb, size);
+    if (p) *comb = p;
+    p = realloc(*check, size);
+    if (p) *check = p;
+}
+
+static bool build_compact_tables() {
+    int columns[MAX_STATES];
+    int16_t values[MAX_STATES];
+    int order[MAX_STATES];
+    
+    // No row placed after the others can start past their combined width
+    int action_capacity = state_count * grammar->terminal_count;
+    int goto_capacity = grammar->non_terminal_count * state_count;
+    free_compact_tables();
+    action_comb = malloc((size_t)action_capacity * sizeof(PackedAction));
+    action_check = malloc((size_t)action_capacity * sizeof(int16_t));
+    goto_comb = malloc((size_t)goto_capacity * sizeof(int16_t));
+    goto_check = malloc((size_t)goto_capacity * sizeof(int16_t));
+    if (!action_comb || !action_check || !goto_comb || !goto_check) {
+        free_compact_tables();
+        return false;
+    }
+    memset(action_check, -1, (size_t)action_capacity * sizeof(int16_t));
+    memset(goto_check, -1, (size_t)goto_capacity * sizeof(int16_t));
+    action_comb_length = 0;
+    goto_comb_length = 0;
+    default_reductions = 0;
+    
+    // Default reduction of each state, and the entries left in its row
+    for (int s = 0; s < state_count; s++) {
+        int uses[MAX_PRODUCTIONS] = { 0 };
+        int best = -1;
+        for (int t = 0; t < grammar->terminal_count; t++) {
+            const LRTableEntry* e = &action_table[s][t];
+            if (e->action != ACTION_REDUCE) continue;
+            if (++uses[e->state] > (best < 0 ? 0 : uses[best])) best = e->state;
+        }
+        action_default[s] = best < 0 ? 0 : (PackedAction)-(best + 1);
+        if (best >= 0) default_reductions++;
+        
+        row_counts[s] = 0;
+        for (int t = 0; t < grammar->terminal_count; t++) {
+            PackedAction code = pack_action(action_table[s][t]);
+            if (code != action_default[s] && (code != 0 || precedence_cell[s][t])) row_counts[s]++;
+        }
+        order[s] = s;
+    }
+    qsort(order, (size_t)state_count, sizeof(int), compare_row_counts);
+    
+    for (int i = 0; i < state_count; i++) {
+        int s = order[i], count = 0;
+        for (int t = 0; t < grammar->terminal_count; t++) {
+            PackedAction code = pack_action(action_table[s][t]);
+            if (code == action_default[s] || (code == 0 && !precedence_cell[s][t])) continue;
+            columns[count] = t;
+            values[count++] = code;
+        }
+        int base = place_row(action_comb, action_check, action_capacity, &action_comb_length, s,
+                             columns, values, count, grammar->terminal_count);
+        if (base < 0) return false;
+        action_base[s] = (int16_t)base;
+    }
+    
+    // GOTO, one row per non-terminal indexed by state
+    for (int n = 0; n < grammar->non_terminal_count; n++) {
+        int best = -1, best_uses = 0;
+        for (int s = 0; s < state_count; s++) {
+            int target = goto_table[s][n], uses = 0;
+            if (target < 0) continue;
+            for (int r = 0; r < state_count; r++) uses += goto_table[r][n] == target;
+            if (uses > best_uses) {
+                best = target;
+                best_uses = uses;
+            }
+        }
+        goto_default[n] = (int16_t)best;
+        
+        int count = 0;
+        for (int s = 0; s < state_count; s++) {
+            if (goto_table[s][n] < 0 || goto_table[s][n] == best) continue;
+            columns[count] = s;
+            values[count++] = (int16_t)goto_table[s][n];
+        }
+        int base = place_row(goto_comb, goto_check, goto_capacity, &goto_comb_length, n,
+                             columns, values, count, state_count);
+        if (base < 0) return false;
+        goto_base[n] = (int16_t)base;
+    }
+    
+    trim_comb(&action_comb, &action_check, action_comb_length);
+    trim_comb(&goto_comb, &goto_check, goto_comb_length);
+    return true;
+}
+
+static inline LRTableEntry action_at(int state, int terminal) {
+    if (!compact_ready) return action_table[state][terminal];
+    
+    int slot = action_base[state] + terminal;
+    PackedAction code = action_check[slot] == state ? action_comb[slot] : action_default[state];
+    LRTableEntry entry = { ACTION_ERROR, -1 };
+    if (code > 0) {
+        entry.action = ACTION_SHIFT;
+        entry.state = code - 1;
+    } else if (code < 0) {
+        entry.state = -code - 1;
+        entry.action = is_augmented(entry.state) ? ACTION_ACCEPT : ACTION_REDUCE;
+    }
+    return entry;
+}
+
+static inline int goto_at(int state, int non_terminal) {
+    if (!compact_ready) return goto_table[state][non_terminal];
+    
+    int slot = goto_base[non_terminal] + state;
+    return goto_check[slot] == non_terminal ? goto_comb[slot] : goto_default[non_terminal];
+}
+
+// Use the compressed tables in the deterministic parse loop. They are built
+// with the next construct_lr_table. A default reduction may run before a
+// syntax error is noticed, so errors can be reported from a later state
+// (with a smaller expected set) than with the full tables.
+void set_lr_table_compression(bool enabled) {
+    compact_mode = enabled;
+}
+
+// Reset the tables to the initial state alone, with the per-grammar data
+// states are expanded from
+static bool begin_automaton() {
+    state_count = 0;
+    conflict_count = 0;
+    conflict_action_count = 0;
+    conflict_overflow = false;
+    resolved_count = 0;
+    
+    // Reductions are placed on FOLLOW(lhs). The sets are initialised by
+    // their computation, so the 1 MB of them is not cleared first.
+    compute_first_sets(grammar, lr_first_sets);
+    compute_follow_sets(grammar, lr_first_sets, lr_follow_sets);
+    
+    for (int a = 0; a < grammar->non_terminal_count; a++) {
+        follow_column_count[a] = 0;
+        for (int f = 0; f < lr_follow_sets[a].follow_count; f++) {
+            int t = terminal_index(lr_follow_sets[a].follow[f]);
+            if (t >= 0) follow_columns[a][follow_column_count[a]++] = t;
+        }
+    }
+    end_column = terminal_index("$");
+    
+    for (int t = 0; t < grammar->terminal_count; t++) {
+        terminal_prec[t] = find_precedence(grammar, grammar->terminals[t]);
+    }
+    for (int p = 0; p < grammar->prod_count; p++) {
+        reduce_len[p] = rhs_length(p);
+        reduce_lhs[p] = non_terminal_index(grammar->productions[p].lhs);
+        
+        production_prec[p] = 0;
+        for (int i = reduce_len[p] - 1; i >= 0; i--) {
+            int t = terminal_index(rhs_symbol(p, i));
+            if (t >= 0 && terminal_prec[t] != NULL) {
+                production_prec[p] = terminal_prec[t]->level;
+                break;
+            }
+        }
+    }
+    
+    index_items();
+    memset(state_slot, -1, sizeof(state_slot));
+    
+    LRItem start = { grammar->prod_count, 0 };
+    int slot;
+    uint64_t hash = hash_bytes(FNV_OFFSET_BASIS, &start, sizeof(start));
+    find_state(&start, 1, hash, &slot);
+    if (add_state(&start, 1, hash, slot) < 0) return false;
+    return true;
+}
+
+// Fill in state s: its shifts and GOTOs, adding the states they lead to,
+// and its reductions. Returns false past the table limits.
+static bool expand_state(int s) {
+    // The GOTO kernels in one pass: the items are bucketed by the symbol
+    // after the dot, which keeps each bucket sorted
+    static LRItem kernels[MAX_LR_ITEMS];
+    int bucket_start[2 * MAX_SYMBOLS + 1] = { 0 };
+    int columns = grammar->terminal_count + grammar->non_terminal_count;
+    for (int i = 0; i < states[s].item_count; i++) {
+        LRItem item = states[s].items[i];
+        int column = next_column[item.production_index][item.dot_position];
+        if (column >= 0) bucket_start[column + 1]++;
+    }
+    for (int k = 0; k < columns; k++) bucket_start[k + 1] += bucket_start[k];
+    
+    int fill[2 * MAX_SYMBOLS];
+    memcpy(fill, bucket_start, sizeof(fill));
+    for (int i = 0; i < states[s].item_count; i++) {
+        LRItem item = states[s].items[i];
+        int column = next_column[item.production_index][item.dot_position];
+        if (column < 0) continue;
+        item.dot_position++;
+        kernels[fill[column]++] = item;
+    }
+    
+    // Transitions on terminals, then on non-terminals
+    for (int k = 0; k < columns; k++) {
+        const LRItem* kernel = &kernels[bucket_start[k]];
+        int count = bucket_start[k + 1] - bucket_start[k];
+        if (count == 0) continue;
+        
+        int slot;
+        uint64_t hash = hash_bytes(FNV_OFFSET_BASIS, kernel, (size_t)count * sizeof(LRItem));
+        int target = find_state(kernel, count, hash, &slot);
+        if (target == -1) {
+            target = add_state(kernel, count, hash, slot);
+            if (target == -1) return false;
+        }
+        
+        if (k < grammar->terminal_count) {
+            set_action(s, k, ACTION_SHIFT, target);
+        } else {
+            goto_table[s][k - grammar->terminal_count] = target;
+        }
+    }
+    
+    // Completed items
+    for (int i = 0; i < states[s].item_count; i++) {
+        LRItem item = states[s].items[i];
+        if (next_column[item.production_index][item.dot_position] >= 0) continue;
+        if (item.dot_position != rhs_length(item.production_index)) continue;
+        
+        if (is_augmented(item.production_index)) {
+            set_action(s, end_column, ACTION_ACCEPT, 0);
+            continue;
+        }
+        
+        int lhs = reduce_lhs[item.production_index];
+        for (int f = 0; lhs >= 0 && f < follow_column_count[lhs]; f++) {
+            set_action(s, follow_columns[lhs][f], ACTION_REDUCE, item.production_index);
+        }
+    }
+    
+    expanded[s] = true;
+    return true;
+}
+
+static inline bool ensure_state(int s) {
+    return expanded[s] || expand_state(s);
+}
+
+// Expand every state not expanded yet, breadth first from the lowest.
+// This runs on one thread. Expanding the frontier on worker threads has
+// not been done: with at most MAX_STATES states, the whole build costs
+// about as much as starting the threads, and MinGW builds have none.
+static bool complete_automaton() {
+    for (int s = 0; s < state_count; s++) {
+        if (!ensure_state(s)) return false;
+    }
+    return true;
+}
+
+// Build the canonical LR(0) collection and the SLR(1) ACTION/GOTO tables,
+// or in lazy mode just the initial state. Compressed tables need every
+// row, so they always get the full build.
+static bool build_lr_automaton() {
+    if (!begin_automaton()) return false;
+    if (!lazy_mode || compact_mode) {
+        if (!complete_automaton()) return false;
+    }
+    
+    compact_ready = compact_mode && build_compact_tables();
+    table_built = true;
+    return true;
+}
+
+// Build LR states the first time a parse enters them instead of all up
+// front, from the next init_lr_parser on. Printing the table or items and
+// GLR parsing still complete the automaton. Ignored with compressed tables.
+void set_lr_lazy_construction(bool enabled) {
+    lazy_mode = enabled;
+}
+
+// Built once per init_lr_parser; later calls return immediately. The
+// phase time includes the FIRST/FOLLOW computation the table needs.
+bool construct_lr_table() {
+    if (table_built) return true;
+    
+    PhaseTimer timer = phase_begin();
+    bool ok = build_lr_automaton();
+    phase_end(PHASE_LR_TABLE, timer);
+    return ok;
+}
+
+// The table with every state, for printing and GLR parsing
+static bool construct_full_table() {
+    return construct_lr_table() && complete_automaton();
+}
+
 void build_lr_items(Grammar* g) {
-    // For simplicity, we'll implement a basic SLR parser
-    // This is a simplified version - a full implementation would need closure and goto operations
+    grammar = g;
+    
     printf("\n=== LR(0) ITEMS ===\n");
-    printf("Note: This is a simplified SLR parser implementation\n\n");
+    if (!construct_full_table()) {
+        printf("ERROR: Grammar exceeds the LR table limits\n");
+        return;
+    }
     
-    for (int i = 0; i < g->prod_count; i++) {
-        printf("I%d: ", i);
-        print_production(i);
-        printf("\n");
+    for (int s = 0; s < state_count; s++) {
+        printf("I%d:\n", s);
+        for (int i = 0; i < states[s].item_count; i++) {
+            printf("    ");
+            print_item(states[s].items[i]);
+            printf("\n");
+        }
     }
 }
 
 void build_lr_table(Grammar* g) {
-    (void)g;  // Suppress unused parameter warning
+    grammar = g;
     
-    // Initialize action table with ERROR
-    for (int i = 0; i < MAX_STATES; i++) {
-        for (int j = 0; j < MAX_SYMBOLS; j++) {
-            action_table[i][j].action = ACTION_ERROR;
-            action_table[i][j].state = -1;
-        }
+    if (!construct_full_table()) {
+        printf("\nERROR: Grammar exceeds the LR table limits\n");
+        return;
     }
-    
-    printf("\n=== LR PARSING TABLE ===\n");
-    printf("This is a simplified SLR implementation\n");
-    printf("For demonstration purposes, using a basic shift-reduce strategy\n\n");
+    print_lr_table();
 }
 
 bool parse_lr(const char* input) {
+    return parse_lr_tree(input, NULL, NULL);
+}
+
+static void trace_lr(TraceSink* trace, int step, TraceAction action, TraceError error,
+                     int production, int state, int symbol, int token) {
+    TraceEvent event = { step, TRACE_LR, (unsigned char)action, (unsigned char)error,
+                         production, state, symbol, token, -1 };
+    trace->emit(trace, &event);
+}
+
+static void trace_recover(TraceSink* trace, int step, int state, int symbol, int token, int depth) {
+    TraceEvent event = { step, TRACE_LR, TRACE_RECOVER, TRACE_ERROR_NONE, -1, state, symbol, token, depth };
+    trace->emit(trace, &event);
+}
+
+// "unexpected X; expected ..." listing the terminals `state` has an action on
+static void report_unexpected(int state, const Token* token) {
+    const char* expected[MAX_SYMBOLS];
+    int count = 0;
+    char text[MAX_DIAGNOSTIC_LEN];
+    
+    for (int t = 0; t < grammar->terminal_count; t++) {
+        if (action_table[state][t].action != ACTION_ERROR) expected[count++] = grammar->terminals[t];
+    }
+    format_expected(text, sizeof(text), expected, count);
+    add_diagnostic(token, "unexpected %s; expected %s", describe_token(token), text);
+}
+
+// Find the shallowest stack depth whose top state has a GOTO on some
+// non-terminal A after which `lookahead` can be parsed: the input is then
+// taken to contain a (broken) A there. Returns false when there is none.
+static bool find_recovery(const ParseStack* stack, int lookahead, int* depth, int* non_terminal) {
+    if (lookahead < 0) return false;
+    
+    for (int d = stack->top; d >= 1; d--) {
+        int state = stack->ids[d - 1];
+        for (int a = 0; a < grammar->non_terminal_count; a++) {
+            int target = goto_table[state][a];
+            if (target >= 0 && ensure_state(target) && action_table[target][lookahead].action != ACTION_ERROR) {
+                *depth = d;
+                *non_terminal = a;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// A parse that needs more states or conflict entries than the tables hold
+// fails with a diagnostic at `token`, so the message reaches the caller's
+// output (a server client, say) along with any syntax errors
+static void report_table_limits(const Token* token) {
+    add_diagnostic(token, "grammar exceeds the LR table limits");
+}
+
+// Table-driven SLR(1) parse of `input`. When `tree` is non-NULL every shift
+// creates a leaf and every reduction creates the parent of the popped nodes.
+// Each step is reported to `trace` when it is non-NULL.
+//
+// On a syntax error the stack is popped back to a state that can resume
+// with the lookahead after a GOTO on some non-terminal (see find_recovery);
+// when none can, the token is skipped. A recovery is tried once per token,
+// and errors are reported once per recovery, up to the next shift.
+static bool lr_parse(const char* input, ParseTree* tree, TraceSink* trace) {
     init_lexer(input);
+    if (!construct_lr_table()) {
+        Token first = peek_token();
+        report_table_limits(&first);
+        return false;
+    }
     
-    typedef struct {
-        int state;
-        char symbol[MAX_TOKEN_LEN];
-    } StackItem;
+    if (tree) parse_tree_reset(tree);
     
-    StackItem stack[MAX_STACK];
-    int stack_top = 0;
+    ParseStack* stack = &lr_stack;
+    int token_index = 0;
+    int errors = 0;
+    bool recovering = false;
+    int resumed_at = -1;    // token index of the last recovery
     
     // Push initial state
-    stack[stack_top].state = 0;
-    strcpy(stack[stack_top].symbol, "$");
-    stack_top++;
+    if (!parse_stack_reserve(stack, 1)) {
+        if (trace) trace_lr(trace, 0, TRACE_ERROR, TRACE_ERROR_OVERFLOW, -1, 0, -1, token_index);
+        return false;
+    }
+    stack->top = 0;
+    stack->ids[stack->top] = 0;
+    stack->nodes[stack->top++] = -1;
     
     Token current_token = get_next_token();
+    int lookahead = terminal_index(terminal_for_token(&current_token, grammar));
     
-    printf("\n=== LR PARSING (Simplified SLR) ===\n");
-    printf("%-40s %-20s %-30s\n", "STACK", "INPUT", "ACTION");
-    printf("--------------------------------------------------------------------------------------\n");
-    
-    char input_buffer[MAX_TOKEN_LEN * 10] = "";
-    strcpy(input_buffer, current_token.lexeme);
-    
-    int step = 0;
-    while (step++ < 100) {  // Prevent infinite loop
-        // Print stack
-        printf("%-40s", "");
-        for (int i = 0; i < stack_top; i++) {
-            printf("%s ", stack[i].symbol);
+    for (int step = 0; ; step++) {
+        int state = stack->ids[stack->top - 1];
+        if (!ensure_state(state)) {
+            report_table_limits(&current_token);
+            if (trace) trace_lr(trace, step, TRACE_ERROR, TRACE_ERROR_OVERFLOW, -1, state, lookahead, token_index);
+            return false;
         }
-        printf("\t%-20s\t", current_token.lexeme);
+        LRTableEntry entry = { ACTION_ERROR, -1 };
+        if (lookahead >= 0) entry = action_at(state, lookahead);
+        compiler_stats.lr_lookups++;
         
-        // Simple shift-reduce logic for demonstration
-        if (current_token.type == TOKEN_EOF) {
-            if (stack_top == 2 && is_non_terminal(stack[1].symbol, grammar)) {
-                printf("ACCEPT\n");
-                return true;
-            } else if (stack_top > 2) {
-                // Reduce
-                bool reduced = false;
-                
-                // Try to find a matching production
-                for (int i = 0; i < grammar->prod_count; i++) {
-                    Production* prod = &grammar->productions[i];
-                    int match_len = prod->rhs_count;
-                    
-                    if (strcmp(prod->rhs[0], "ε") == 0) continue;
-                    
-                    if (stack_top >= match_len + 1) {
-                        bool match = true;
-                        for (int j = 0; j < match_len; j++) {
-                            if (strcmp(stack[stack_top - match_len + j].symbol, prod->rhs[j]) != 0) {
-                                match = false;
-                                break;
-                            }
-                        }
-                        
-                        if (match) {
-                            printf("REDUCE by ");
-                            print_production(i);
-                            printf("\n");
-                            
-                            stack_top -= match_len;
-                            strcpy(stack[stack_top].symbol, prod->lhs);
-                            stack[stack_top].state = stack_top;
-                            stack_top++;
-                            reduced = true;
-                            break;
-                        }
-                    }
+        switch (entry.action) {
+            case ACTION_SHIFT: {
+                if (!parse_stack_reserve(stack, stack->top + 1)) {
+                    if (trace) trace_lr(trace, step, TRACE_ERROR, TRACE_ERROR_OVERFLOW, -1, state, lookahead, token_index);
+                    return false;
                 }
+                if (trace) trace_lr(trace, step, TRACE_SHIFT, TRACE_ERROR_NONE, -1, entry.state, lookahead, token_index);
+                stack->nodes[stack->top] = tree ? parse_tree_add_leaf(tree, lookahead, &current_token) : -1;
+                stack->ids[stack->top++] = entry.state;
+                compiler_stats.shifts++;
+                recovering = false;
+                if (stack->top > compiler_stats.lr_max_depth) compiler_stats.lr_max_depth = stack->top;
+                current_token = get_next_token();
+                lookahead = terminal_index(terminal_for_token(&current_token, grammar));
+                token_index++;
+                break;
+            }
+            
+            case ACTION_REDUCE: {
+                int prod_index = entry.state;
+                int len = reduce_len[prod_index];
+                int lhs = reduce_lhs[prod_index];
                 
-                if (!reduced) {
-                    printf("ERROR: Cannot reduce\n");
+                stack->top -= len;
+                int target = goto_at(stack->ids[stack->top - 1], lhs);
+                compiler_stats.lr_lookups++;
+                compiler_stats.reduces++;
+                if (target < 0) {
+                    if (trace) trace_lr(trace, step, TRACE_ERROR, TRACE_ERROR_NO_GOTO, prod_index, state, -1, token_index);
+                    return false;
+                }
+                // An ε reduction grows the stack
+                if (!parse_stack_reserve(stack, stack->top + 1)) {
+                    if (trace) trace_lr(trace, step, TRACE_ERROR, TRACE_ERROR_OVERFLOW, prod_index, state, -1, token_index);
                     return false;
                 }
-            } else {
-                printf("ERROR: Invalid stack state\n");
-                return false;
+                if (trace) {
+                    trace_lr(trace, step, TRACE_REDUCE, TRACE_ERROR_NONE, prod_index, target,
+                             grammar->terminal_count + lhs, token_index);
+                }
+                
+                int node = -1;
+                if (tree) {
+                    node = parse_tree_add_node(tree, grammar->terminal_count + lhs, prod_index);
+                    parse_tree_set_children(tree, node, stack->nodes + stack->top, len);
+                }
+                stack->nodes[stack->top] = node;
+                stack->ids[stack->top++] = target;
+                if (stack->top > compiler_stats.lr_max_depth) compiler_stats.lr_max_depth = stack->top;
+                break;
             }
-        } else {
-            // Shift
-            printf("SHIFT %s\n", current_token.lexeme);
-            strcpy(stack[stack_top].symbol, current_token.lexeme);
-            stack[stack_top].state = stack_top;
-            stack_top++;
-            current_token = get_next_token();
             
-            // After shift, try reduce
-            for (int i = 0; i < grammar->prod_count; i++) {
-                Production* prod = &grammar->productions[i];
-                int match_len = prod->rhs_count;
+            case ACTION_ACCEPT:
+                if (errors > 0) return false;
+                if (trace) trace_lr(trace, step, TRACE_ACCEPT, TRACE_ERROR_NONE, -1, state, lookahead, token_index);
+                return tree ? parse_tree_finish(tree, stack->nodes[stack->top - 1]) : true;
+            
+            default: {
+                if (trace) trace_lr(trace, step, TRACE_ERROR, TRACE_ERROR_UNEXPECTED, -1, state, lookahead, token_index);
+                if (!recovering) {
+                    report_unexpected(state, &current_token);
+                    errors++;
+                    recovering = true;
+                }
                 
-                if (strcmp(prod->rhs[0], "ε") == 0) continue;
+                int depth, a;
+                if (token_index != resumed_at && find_recovery(stack, lookahead, &depth, &a)) {
+                    int target = goto_table[stack->ids[depth - 1]][a];
+                    stack->top = depth;
+                    if (!parse_stack_reserve(stack, stack->top + 1)) return false;
+                    stack->nodes[stack->top] = -1;
+                    stack->ids[stack->top++] = target;
+                    resumed_at = token_index;
+                    if (trace) trace_recover(trace, step, target, grammar->terminal_count + a, token_index, stack->top);
+                    break;
+                }
                 
-                if (stack_top >= match_len + 1) {
-                    bool match = true;
-                    for (int j = 0; j < match_len; j++) {
-                        if (strcmp(stack[stack_top - match_len + j].symbol, prod->rhs[j]) != 0) {
-                            match = false;
-                            break;
-                        }
+                if (current_token.type == TOKEN_EOF) return false;
+                if (trace) trace_recover(trace, step, state, -1, token_index, stack->top);
+                current_token = get_next_token();
+                lookahead = terminal_index(terminal_for_token(&current_token, grammar));
+                token_index++;
+                break;
+            }
+        }
+    }
+}
+
+bool parse_lr_tree(const char* input, ParseTree* tree, TraceSink* trace) {
+    PhaseTimer timer = phase_begin();
+    reset_diagnostics();
+    bool accepted = lr_parse(input, tree, trace);
+    phase_end(PHASE_LR_PARSE, timer);
+    return accepted;
+}
+
+// Free this thread's parse stack, for worker threads about to exit
+void free_lr_stack() {
+    parse_stack_free(&lr_stack);
+}
+
+// ---------------------------------------------------------------------------
+// Generalized LR. Where a table cell has several actions the parser forks:
+// all stacks live in one graph-structured stack (GSS) whose nodes are
+// (state, input position) pairs and whose edges point to the node below,
+// labelled with the forest node for the symbol between them. Stacks that
+// reach the same state at the same position are merged, and identical
+// sub-parses are shared in the parse forest. With a single stack top and a
+// single action per cell this is a plain LR step on a one-edge chain, so
+// the cost of nondeterminism is paid only where the grammar is ambiguous.
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int state;
+    int level;      // input position
+    int edges;      // first edge, -1 for the bottom node
+    bool inner;     // another node at this level has an edge to it
+} GssNode;
+
+typedef struct {
+    int from;
+    int to;         // node below
+    int label;      // forest node for the symbol on this edge
+    int next;
+} GssEdge;
+
+// Per-level hash of forest nodes, keyed by (symbol, start), and of the
+// edges added by reductions, keyed by (-1 - from, to). Slots are stamped per
+// level, so moving on needs no clearing.
+typedef struct {
+    unsigned stamp;
+    int a;
+    int b;
+    int value;
+} LevelSlot;
+
+typedef struct {
+    GssNode* nodes;
+    int node_count;
+    int node_cap;
+    GssEdge* edges;
+    int edge_count;
+    int edge_cap;
+    LevelSlot* slots;
+    int slot_cap;
+    int slot_used;
+    unsigned stamp;     // current level's stamp, never reused
+    int* pending;       // new edges below already reduced nodes
+    int pending_count;
+    int pending_cap;
+    ParseForest* forest;
+    int level;
+    int level_start;    // first GSS node at `level`
+    int processing;     // node whose reductions are being done
+    bool redo;          // a pass has to be repeated
+    bool failed;
+} GlrStack;
+
+static _Thread_local GlrStack gss;
+
+// Actions of cell [state, terminal], all of them when it is conflicted
+static int cell_actions(int state, int terminal, LRTableEntry* out) {
+    if (terminal < 0) return 0;
+    
+    int count = 0;
+    int i = conflict_list[state][terminal];
+    if (i < 0) {
+        if (action_table[state][terminal].action != ACTION_ERROR) out[count++] = action_table[state][terminal];
+        return count;
+    }
+    for (; i >= 0; i = conflict_actions[i].next) {
+        out[count++] = conflict_actions[i].entry;
+    }
+    return count;
+}
+
+static int gss_add_node(int state, int level) {
+    if (!grow_array(&gss.failed, (void**)&gss.nodes, &gss.node_cap, gss.node_count + 1, sizeof(GssNode))) return -1;
+    gss.nodes[gss.node_count].state = state;
+    gss.nodes[gss.node_count].level = level;
+    gss.nodes[gss.node_count].edges = -1;
+    gss.nodes[gss.node_count].inner = false;
+    return gss.node_count++;
+}
+
+// Node in `state` among those from `from` on; one per state per level
+static int gss_find_node(int state, int from) {
+    for (int v = from; v < gss.node_count; v++) {
+        if (gss.nodes[v].state == state) return v;
+    }
+    return -1;
+}
+
+static int gss_add_edge(int from, int to, int label) {
+    if (!grow_array(&gss.failed, (void**)&gss.edges, &gss.edge_cap, gss.edge_count + 1, sizeof(GssEdge))) return -1;
+    gss.edges[gss.edge_count].from = from;
+    gss.edges[gss.edge_count].to = to;
+    gss.edges[gss.edge_count].label = label;
+    gss.edges[gss.edge_count].next = gss.nodes[from].edges;
+    gss.nodes[from].edges = gss.edge_count;
+    return gss.edge_count++;
+}
+
+static inline unsigned slot_hash(int a, int b) {
+    return (unsigned)a * 2654435761u ^ (unsigned)b * 40503u;
+}
+
+static void level_slots_insert(int a, int b, int value) {
+    unsigned mask = (unsigned)gss.slot_cap - 1;
+    unsigned i = slot_hash(a, b) & mask;
+    while (gss.slots[i].stamp == gss.stamp) i = (i + 1) & mask;
+    gss.slots[i].stamp = gss.stamp;
+    gss.slots[i].a = a;
+    gss.slots[i].b = b;
+    gss.slots[i].value = value;
+    gss.slot_used++;
+}
+
+static int level_lookup(int a, int b) {
+    if (gss.slot_cap == 0) return -1;
+    
+    unsigned mask = (unsigned)gss.slot_cap - 1;
+    for (unsigned i = slot_hash(a, b) & mask; gss.slots[i].stamp == gss.stamp; i = (i + 1) & mask) {
+        if (gss.slots[i].a == a && gss.slots[i].b == b) return gss.slots[i].value;
+    }
+    return -1;
+}
+
+// Keep the table at most half full, rehashing this level's entries
+static bool level_reserve() {
+    if ((gss.slot_used + 1) * 2 <= gss.slot_cap) return true;
+    
+    int cap = gss.slot_cap ? gss.slot_cap * 2 : 64;
+    LevelSlot* old = gss.slots;
+    int old_cap = gss.slot_cap;
+    LevelSlot* slots = malloc((size_t)cap * sizeof(LevelSlot));
+    if (slots == NULL) {
+        gss.failed = true;
+        return false;
+    }
+    for (int i = 0; i < cap; i++) slots[i].stamp = 0;
+    gss.slots = slots;
+    gss.slot_cap = cap;
+    gss.slot_used = 0;
+    for (int i = 0; i < old_cap; i++) {
+        if (old[i].stamp == gss.stamp) level_slots_insert(old[i].a, old[i].b, old[i].value);
+    }
+    free(old);
+    return true;
+}
+
+// The forest node for `symbol` over [start, level), created on first use
+static int level_forest_node(int symbol, int start) {
+    int node = level_lookup(symbol, start);
+    if (node >= 0 || !level_reserve()) return node;
+    
+    node = forest_add_node(gss.forest, symbol, start, gss.level);
+    if (node >= 0) level_slots_insert(symbol, start, node);
+    return node;
+}
+
+// Reduce by `production` along the path of GSS edges ending at `w`, whose
+// labels are the production's children in order
+static void glr_reduce(int w, int production, const int* children, int count) {
+    int lhs = reduce_lhs[production];
+    int target = goto_table[gss.nodes[w].state][lhs];
+    if (target < 0) return;
+    compiler_stats.reduces++;
+    compiler_stats.lr_lookups++;
+    
+    int label = level_forest_node(grammar->terminal_count + lhs, gss.nodes[w].level);
+    if (label < 0) return;
+    forest_add_packed(gss.forest, label, production, children, count);
+    
+    int u = gss_find_node(target, gss.level_start);
+    if (u < 0) {
+        u = gss_add_node(target, gss.level);
+        if (u < 0) return;
+    } else if (level_lookup(-1 - u, w) >= 0) {
+        return;
+    }
+    if (!level_reserve()) return;
+    int e = gss_add_edge(u, w, label);
+    if (e < 0) return;
+    level_slots_insert(-1 - u, w, e);
+    if (gss.nodes[w].level == gss.level) gss.nodes[w].inner = true;
+    
+    // Reductions already done from u did not see the new edge. Paths that
+    // start at u are redone through it alone; a path from a node above u
+    // can only come from an ε-reduction, and then the whole pass is redone.
+    if (u <= gss.processing) {
+        if (gss.nodes[u].inner) {
+            gss.redo = true;
+        } else if (grow_array(&gss.failed, (void**)&gss.pending, &gss.pending_cap,
+                              gss.pending_count + 1, sizeof(int))) {
+            gss.pending[gss.pending_count++] = e;
+        }
+    }
+}
+
+// Enumerate every path of `len` edges down from `v`. `labels` is filled from
+// the right, since the first edge carries the production's last symbol.
+static void glr_reduce_paths(int v, int production, int len, int depth, int* labels) {
+    if (depth == len) {
+        glr_reduce(v, production, labels, len);
+        return;
+    }
+    for (int e = gss.nodes[v].edges; e >= 0; e = gss.edges[e].next) {
+        labels[len - 1 - depth] = gss.edges[e].label;
+        glr_reduce_paths(gss.edges[e].to, production, len, depth + 1, labels);
+    }
+}
+
+// Report the lookahead with the terminals any live stack could have used
+static void report_glr_error(const Token* token) {
+    const char* expected[MAX_SYMBOLS];
+    int count = 0;
+    char text[MAX_DIAGNOSTIC_LEN];
+    LRTableEntry actions[MAX_PRODUCTIONS + 2];
+    
+    for (int t = 0; t < grammar->terminal_count; t++) {
+        for (int v = gss.level_start; v < gss.node_count; v++) {
+            if (cell_actions(gss.nodes[v].state, t, actions) > 0) {
+                expected[count++] = grammar->terminals[t];
+                break;
+            }
+        }
+    }
+    format_expected(text, sizeof(text), expected, count);
+    add_diagnostic(token, "unexpected %s; expected %s", describe_token(token), text);
+}
+
+static bool glr_parse(const char* input, ParseForest* forest) {
+    parse_forest_reset(forest);
+    init_lexer(input);
+    if (!construct_full_table() || conflict_overflow) {
+        Token first = peek_token();
+        report_table_limits(&first);
+        return false;
+    }
+    
+    gss.node_count = 0;
+    gss.edge_count = 0;
+    gss.forest = forest;
+    gss.level_start = 0;
+    gss.failed = false;
+    if (gss_add_node(0, 0) < 0) return false;
+    
+    LRTableEntry actions[MAX_PRODUCTIONS + 2];
+    int labels[MAX_PRODUCTIONS];
+    
+    for (int level = 0; ; level++) {
+        Token token = get_next_token();
+        int lookahead = terminal_index(terminal_for_token(&token, grammar));
+        gss.level = level;
+        gss.stamp++;
+        gss.slot_used = 0;
+        
+        // Reductions. New edges below already reduced nodes are handled
+        // as they come; a whole pass is repeated only after ε-reductions.
+        do {
+            gss.redo = false;
+            gss.pending_count = 0;
+            gss.processing = gss.level_start - 1;
+            for (int v = gss.level_start; !gss.failed; ) {
+                if (gss.pending_count > 0) {
+                    GssEdge edge = gss.edges[gss.pending[--gss.pending_count]];
+                    int count = cell_actions(gss.nodes[edge.from].state, lookahead, actions);
+                    for (int i = 0; i < count; i++) {
+                        if (actions[i].action != ACTION_REDUCE) continue;
+                        int production = actions[i].state;
+                        int len = reduce_len[production];
+                        if (len == 0) continue;
+                        labels[len - 1] = edge.label;
+                        glr_reduce_paths(edge.to, production, len, 1, labels);
                     }
-                    
-                    if (match) {
-                        // Print stack before reduce
-                        printf("%-40s", "");
-                        for (int k = 0; k < stack_top; k++) {
-                            printf("%s ", stack[k].symbol);
-                        }
-                        printf("\t%-20s\t", current_token.lexeme);
-                        printf("REDUCE by ");
-                        print_production(i);
-                        printf("\n");
-                        
-                        stack_top -= match_len;
-                        strcpy(stack[stack_top].symbol, prod->lhs);
-                        stack[stack_top].state = stack_top;
-                        stack_top++;
-                        break;
+                    continue;
+                }
+                if (v >= gss.node_count) break;
+                
+                gss.processing = v;
+                int count = cell_actions(gss.nodes[v].state, lookahead, actions);
+                compiler_stats.lr_lookups++;
+                for (int i = 0; i < count; i++) {
+                    if (actions[i].action != ACTION_REDUCE) continue;
+                    int production = actions[i].state;
+                    glr_reduce_paths(v, production, reduce_len[production], 0, labels);
+                }
+                v++;
+            }
+        } while (gss.redo && !gss.failed);
+        
+        int heads = gss.node_count - gss.level_start;
+        if (heads > compiler_stats.lr_max_depth) compiler_stats.lr_max_depth = heads;
+        if (gss.failed || forest->failed) return false;
+        
+        if (token.type == TOKEN_EOF) {
+            // The accepting node sits on the bottom node, and the edge
+            // between them holds the start symbol over the whole input
+            for (int v = gss.level_start; v < gss.node_count && forest->root < 0; v++) {
+                int count = cell_actions(gss.nodes[v].state, lookahead, actions);
+                for (int i = 0; i < count; i++) {
+                    if (actions[i].action != ACTION_ACCEPT) continue;
+                    for (int e = gss.nodes[v].edges; e >= 0; e = gss.edges[e].next) {
+                        if (gss.edges[e].to == 0) forest->root = gss.edges[e].label;
                     }
                 }
             }
+            if (forest->root < 0) report_glr_error(&token);
+            return forest->root >= 0;
         }
+        
+        // Shifts: every stack that can take the token moves to the next level
+        int next_start = gss.node_count;
+        int leaf = lookahead >= 0 ? forest_add_token(forest, lookahead, &token, level) : -1;
+        for (int v = gss.level_start; v < next_start && leaf >= 0; v++) {
+            int count = cell_actions(gss.nodes[v].state, lookahead, actions);
+            for (int i = 0; i < count; i++) {
+                if (actions[i].action != ACTION_SHIFT) continue;
+                int u = gss_find_node(actions[i].state, next_start);
+                if (u < 0) u = gss_add_node(actions[i].state, level + 1);
+                if (u < 0) return false;
+                gss_add_edge(u, v, leaf);
+                compiler_stats.shifts++;
+            }
+        }
+        
+        if (gss.node_count == next_start) {
+            report_glr_error(&token);
+            return false;
+        }
+        gss.level_start = next_start;
     }
-    
-    printf("ERROR: Parsing limit exceeded\n");
-    return false;
+}
+
+// Generalized LR parse of `input` into `forest`. Accepts every input the
+// grammar derives, whatever conflicts its SLR(1) table has; the forest then
+// holds all derivations. Syntax errors are reported to the diagnostics
+// list, without recovery.
+bool parse_glr(const char* input, ParseForest* forest) {
+    PhaseTimer timer = phase_begin();
+    reset_diagnostics();
+    bool accepted = glr_parse(input, forest);
+    phase_end(PHASE_GLR_PARSE, timer);
+    return accepted;
 }
 
 void print_lr_table() {
     printf("\n=== LR ACTION/GOTO TABLE ===\n");
-    printf("State\t| ACTION\t| GOTO\n");
-    printf("----------------------------------------\n");
-    printf("(Simplified SLR parser - dynamic table construction)\n");
+    printf("%-8s", "State");
+    for (int t = 0; t < grammar->terminal_count; t++) {
+        printf("%-8s", grammar->terminals[t]);
+    }
+    printf("| ");
+    for (int n = 0; n < grammar->non_terminal_count; n++) {
+        printf("%-6s", grammar->non_terminals[n]);
+    }
+    printf("\n");
+    printf("----------------------------------------------------------------------------\n");
+    
+    for (int s = 0; s < state_count; s++) {
+        printf("%-8d", s);
+        for (int t = 0; t < grammar->terminal_count; t++) {
+            char cell[16] = "";
+            LRTableEntry entry = action_table[s][t];
+            if (entry.action == ACTION_SHIFT) snprintf(cell, sizeof(cell), "s%d", entry.state);
+            else if (entry.action == ACTION_REDUCE) snprintf(cell, sizeof(cell), "r%d", entry.state + 1);
+            else if (entry.action == ACTION_ACCEPT) strcpy(cell, "acc");
+            printf("%-8s", cell);
+        }
+        printf("| ");
+        for (int n = 0; n < grammar->non_terminal_count; n++) {
+            if (goto_table[s][n] >= 0) printf("%-6d", goto_table[s][n]);
+            else printf("%-6s", "");
+        }
+        printf("\n");
+    }
+    
+    printf("\nStates: %d", state_count);
+    if (compact_ready) {
+        size_t full = (size_t)state_count * grammar->terminal_count * sizeof(LRTableEntry) +
+                      (size_t)state_count * grammar->non_terminal_count * sizeof(int);
+        size_t packed = (size_t)action_comb_length * (sizeof(PackedAction) + sizeof(int16_t)) +
+                        (size_t)state_count * (sizeof(PackedAction) + sizeof(int16_t)) +
+                        (size_t)goto_comb_length * 2 * sizeof(int16_t) +
+                        (size_t)grammar->non_terminal_count * 2 * sizeof(int16_t);
+        printf("   Compressed: %zu of %zu bytes, %d default reductions", packed, full, default_reductions);
+    }
+    if (resolved_count > 0) {
+        printf("   Settled by precedence: %d", resolved_count);
+    }
+    if (conflict_count > 0) {
+        printf("   Conflicts: %d (grammar is not SLR(1); shift preferred)", conflict_count);
+    }
+    printf("\n");
 }
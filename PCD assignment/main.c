@@ -1,4 +1,5 @@
 #include "compiler.h"
+#include "codegen.h"
 
 void print_header() {
     printf("\n");
@@ -23,6 +24,12 @@ void print_menu() {
     printf("║  7. Build LR Items                                            ║\n");
     printf("║  8. Parse with LR Parser                                      ║\n");
     printf("║  9. Run Complete Analysis (Lexer + LL + LR)                   ║\n");
+    printf("║ 10. Generate Assembly File (.asm)                             ║\n");
+    printf("║ 11. Evaluate Expression (JIT)                                 ║\n");
+    printf("║ 12. Generate ELF Object File (.o)                             ║\n");
+    printf("║ 13. Show Performance Counters                                 ║\n");
+    printf("║ 14. GLR Parse (Ambiguous Grammars)                            ║\n");
+    printf("║ 15. Pratt Parse (Operator Precedence)                         ║\n");
     printf("║  0. Exit                                                      ║\n");
     printf("╚═══════════════════════════════════════════════════════════════╝\n");
     printf("\nEnter your choice: ");
@@ -49,11 +56,69 @@ void print_grammar_menu() {
     printf("║     T -> F T'                                                 ║\n");
     printf("║     T' -> * F T' | ε                                          ║\n");
     printf("║     F -> ( E ) | id                                           ║\n");
+    printf("║                                                               ║\n");
+    printf("║  4. Synthetic Grammar (generated from a seed)                 ║\n");
+    printf("║     N non-terminals, M productions, LL(1) or LALR(1) shape    ║\n");
+    printf("║                                                               ║\n");
+    printf("║  5. Grammar File (one \"A -> x y | z\" rule per line)           ║\n");
     printf("╚═══════════════════════════════════════════════════════════════╝\n");
     printf("\nEnter your choice: ");
 }
 
-int main() {
+// Prompt for generator parameters and fill `g` with a synthetic grammar,
+// then show one random sentence of it
+static void load_synthetic_grammar(Grammar* g) {
+    GrammarGenOptions opt;
+    grammar_gen_defaults(&opt);
+    
+    int shape = 1;
+    unsigned long long seed = 1;
+    printf("\nShape (1 = LL(1), 2 = LALR(1)): ");
+    scanf("%d", &shape);
+    printf("Non-terminals (max %d): ", MAX_SYMBOLS);
+    scanf("%d", &opt.non_terminals);
+    printf("Productions (max %d): ", MAX_PRODUCTIONS);
+    scanf("%d", &opt.productions);
+    printf("Seed: ");
+    scanf("%llu", &seed);
+    getchar();
+    
+    opt.shape = shape == 2 ? GRAMMAR_SHAPE_LALR1 : GRAMMAR_SHAPE_LL1;
+    opt.seed = seed;
+    generate_grammar(g, &opt);
+    
+    OutputBuffer sentence;
+    outbuf_init(&sentence);
+    uint64_t sentence_seed = seed;
+    if (generate_sentence(g, 20, 32, &sentence_seed, &sentence) >= 0) {
+        printf("\nSample sentence: %s\n", outbuf_cstr(&sentence));
+    }
+    outbuf_free(&sentence);
+}
+
+// Read an expression, parse it with the LR parser and generate TAC from
+// the resulting parse tree
+static bool read_and_compile(Grammar* grammar, char* input, int size) {
+    static ParseTree tree;
+    
+    printf("\nEnter expression to compile: ");
+    fgets(input, size, stdin);
+    input[strcspn(input, "\n")] = 0;
+    
+    init_lr_parser(grammar);
+    if (!parse_lr_tree(input, &tree, NULL) || !generate_code_from_tree(&tree)) {
+        print_diagnostics();
+        printf("\n✗ Input rejected, no code generated\n");
+        return false;
+    }
+    print_tac();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // Any argument selects the non-interactive driver
+    if (argc > 1) return run_cli(argc, argv);
+    
     Grammar grammar;
     FirstFollowSet first_sets[MAX_SYMBOLS];
     FirstFollowSet follow_sets[MAX_SYMBOLS];
@@ -64,6 +129,10 @@ int main() {
     int choice;
     char input[1000];
     
+    // Parse steps are recorded here and printed after each parse
+    TraceLog trace;
+    trace_log_init(&trace);
+    
     print_header();
     
     while (1) {
@@ -78,7 +147,21 @@ int main() {
                 scanf("%d", &grammar_choice);
                 getchar();
                 
-                load_sample_grammar(&grammar, grammar_choice);
+                if (grammar_choice == 4) {
+                    load_synthetic_grammar(&grammar);
+                } else if (grammar_choice == 5) {
+                    char error[256];
+                    printf("\nGrammar file: ");
+                    fgets(input, sizeof(input), stdin);
+                    input[strcspn(input, "\n")] = 0;
+                    if (!load_grammar_file(&grammar, input, error, sizeof(error))) {
+                        printf("\n✗ %s\n", error);
+                        grammar_loaded = false;
+                        break;
+                    }
+                } else {
+                    load_sample_grammar(&grammar, grammar_choice);
+                }
                 grammar_loaded = true;
                 first_follow_computed = false;
                 ll_table_built = false;
@@ -149,6 +232,7 @@ int main() {
                 
                 build_ll_table(&grammar, first_sets, follow_sets);
                 ll_table_built = true;
+                print_ll_grammar();
                 
                 printf("\n=== LL PARSING TABLE ===\n");
                 printf("%-15s", "Non-Terminal");
@@ -183,7 +267,10 @@ int main() {
                 fgets(input, sizeof(input), stdin);
                 input[strcspn(input, "\n")] = 0;
                 
-                bool result = parse_ll(input);
+                trace_log_reset(&trace);
+                bool result = parse_ll_tree(input, NULL, &trace.sink);
+                print_parse_trace(&trace, get_ll_grammar(), input);
+                print_diagnostics();
                 
                 if (result) {
                     printf("\n✓ INPUT ACCEPTED BY LL PARSER\n");
@@ -217,7 +304,10 @@ int main() {
                 fgets(input, sizeof(input), stdin);
                 input[strcspn(input, "\n")] = 0;
                 
-                bool result = parse_lr(input);
+                trace_log_reset(&trace);
+                bool result = parse_lr_tree(input, NULL, &trace.sink);
+                print_parse_trace(&trace, &grammar, input);
+                print_diagnostics();
                 
                 if (result) {
                     printf("\n✓ INPUT ACCEPTED BY LR PARSER\n");
@@ -242,6 +332,8 @@ int main() {
                 printf("║              COMPLETE COMPILATION ANALYSIS                    ║\n");
                 printf("╚═══════════════════════════════════════════════════════════════╝\n");
                 
+                reset_compiler_stats();
+                
                 // Lexical Analysis
                 init_lexer(input);
                 print_tokens();
@@ -255,11 +347,23 @@ int main() {
                     ll_table_built = true;
                 }
                 
-                bool ll_result = parse_ll(input);
+                trace_log_reset(&trace);
+                bool ll_result = parse_ll_tree(input, NULL, &trace.sink);
+                print_parse_trace(&trace, get_ll_grammar(), input);
+                print_diagnostics();
                 
-                // LR Parsing
+                // LR Parsing, building the parse tree for code generation
+                static ParseTree tree;
                 init_lr_parser(&grammar);
-                bool lr_result = parse_lr(input);
+                trace_log_reset(&trace);
+                bool lr_result = parse_lr_tree(input, &tree, &trace.sink);
+                print_parse_trace(&trace, &grammar, input);
+                print_diagnostics();
+                
+                if (lr_result) {
+                    print_parse_tree(&tree, &grammar);
+                    if (generate_code_from_tree(&tree)) print_tac();
+                }
                 
                 printf("\n");
                 printf("╔═══════════════════════════════════════════════════════════════╗\n");
@@ -269,6 +373,130 @@ int main() {
                 printf("║  LL Parser:          %-40s ║\n", ll_result ? "ACCEPTED ✓" : "REJECTED ✗");
                 printf("║  LR Parser:          %-40s ║\n", lr_result ? "ACCEPTED ✓" : "REJECTED ✗");
                 printf("╚═══════════════════════════════════════════════════════════════╝\n");
+                print_compiler_stats();
+                break;
+            }
+            
+            case 10: {
+                if (!grammar_loaded) {
+                    printf("\n✗ Please load a grammar first!\n");
+                    break;
+                }
+                if (!read_and_compile(&grammar, input, sizeof(input))) break;
+                
+                printf("\nEnter output file name (e.g. output.asm): ");
+                fgets(input, sizeof(input), stdin);
+                input[strcspn(input, "\n")] = 0;
+                
+                if (write_assembly_file(input)) {
+                    printf("\n✓ Assembly written to %s\n", input);
+                } else {
+                    printf("\n✗ Could not write %s\n", input);
+                }
+                break;
+            }
+            
+            case 11: {
+                if (!grammar_loaded) {
+                    printf("\n✗ Please load a grammar first!\n");
+                    break;
+                }
+                if (!read_and_compile(&grammar, input, sizeof(input))) break;
+                
+                static TACProgram program;
+                JitCode jit;
+                if (!lower_tac(&program) || !jit_compile(&program, &jit)) {
+                    printf("\n✗ JIT compilation is not available for this program\n");
+                    break;
+                }
+                
+                int64_t values[MAX_SYMBOLS] = {0};
+                for (int i = 0; i < program.var_count; i++) {
+                    printf("Value of %s: ", program.variables[i]);
+                    long long value = 0;
+                    if (scanf("%lld", &value) != 1) value = 0;
+                    values[i] = value;
+                }
+                getchar();
+                
+                printf("\n✓ Result: %lld\n", (long long)jit.function(values));
+                jit_release(&jit);
+                break;
+            }
+            
+            case 12: {
+                if (!grammar_loaded) {
+                    printf("\n✗ Please load a grammar first!\n");
+                    break;
+                }
+                if (!read_and_compile(&grammar, input, sizeof(input))) break;
+                
+                printf("\nEnter output file name (e.g. output.o): ");
+                fgets(input, sizeof(input), stdin);
+                input[strcspn(input, "\n")] = 0;
+                
+                static TACProgram object_program;
+                if (lower_tac(&object_program) && write_elf_object(input, &object_program, true)) {
+                    printf("\n✓ Object written to %s (link with: ld %s)\n", input, input);
+                } else {
+                    printf("\n✗ Could not write %s\n", input);
+                }
+                break;
+            }
+            
+            case 13:
+                print_compiler_stats();
+                break;
+            
+            case 14: {
+                if (!grammar_loaded) {
+                    printf("\n✗ Please load a grammar first!\n");
+                    break;
+                }
+                
+                init_lr_parser(&grammar);
+                
+                printf("\nEnter input string to parse: ");
+                fgets(input, sizeof(input), stdin);
+                input[strcspn(input, "\n")] = 0;
+                
+                static ParseForest forest;
+                bool result = parse_glr(input, &forest);
+                if (result) print_parse_forest(&forest, &grammar);
+                print_diagnostics();
+                
+                if (result) {
+                    printf("\n✓ INPUT ACCEPTED BY GLR PARSER\n");
+                } else {
+                    printf("\n✗ INPUT REJECTED BY GLR PARSER\n");
+                }
+                break;
+            }
+            
+            case 15: {
+                if (!grammar_loaded) {
+                    printf("\n✗ Please load a grammar first!\n");
+                    break;
+                }
+                
+                bool ready = build_pratt_table(&grammar);
+                print_pratt_table();
+                if (!ready) break;
+                
+                printf("\nEnter input string to parse: ");
+                fgets(input, sizeof(input), stdin);
+                input[strcspn(input, "\n")] = 0;
+                
+                static ParseTree pratt_tree;
+                bool result = parse_pratt_tree(input, &pratt_tree);
+                if (result) print_parse_tree(&pratt_tree, &grammar);
+                print_diagnostics();
+                
+                if (result) {
+                    printf("\n✓ INPUT ACCEPTED BY PRATT PARSER\n");
+                } else {
+                    printf("\n✗ INPUT REJECTED BY PRATT PARSER\n");
+                }
                 break;
             }
             
@@ -278,6 +506,7 @@ int main() {
                 printf("║              Thank you for using the compiler!                ║\n");
                 printf("╚═══════════════════════════════════════════════════════════════╝\n");
                 printf("\n");
+                trace_log_free(&trace);
                 return 0;
             
             default:
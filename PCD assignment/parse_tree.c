@@ -0,0 +1,486 @@
+#include "compiler.h"
+
+void parse_tree_init(ParseTree* tree) {
+    memset(tree, 0, sizeof(*tree));
+}
+
+void parse_tree_reset(ParseTree* tree) {
+    tree->node_count = 0;
+    tree->token_count = 0;
+    tree->build_count = 0;
+    tree->link_count = 0;
+    tree->failed = false;
+}
+
+void parse_tree_free(ParseTree* tree) {
+    free(tree->nodes);
+    free(tree->tokens);
+    free(tree->build);
+    free(tree->links);
+    free(tree->stack);
+    parse_tree_init(tree);
+}
+
+// Grow `*array` so it holds at least `needed` elements of `size` bytes,
+// doubling from 64. On allocation failure `*failed` is set and the array is
+// left as it was.
+bool grow_array(bool* failed, void** array, int* cap, int needed, size_t size) {
+    if (needed <= *cap) return true;
+    
+    int new_cap = *cap ? *cap : 64;
+    while (new_cap < needed) new_cap *= 2;
+    
+    void* grown = realloc(*array, (size_t)new_cap * size);
+    if (grown == NULL) {
+        *failed = true;
+        return false;
+    }
+    *array = grown;
+    *cap = new_cap;
+    return true;
+}
+
+static int new_build_node(ParseTree* tree, int symbol, int production, int token) {
+    if (!grow_array(&tree->failed, (void**)&tree->build, &tree->build_cap, tree->build_count + 1, sizeof(ParseBuildNode))) {
+        return -1;
+    }
+    ParseBuildNode* node = &tree->build[tree->build_count];
+    node->symbol = symbol;
+    node->production = production;
+    node->token = token;
+    node->first_link = 0;
+    node->child_count = 0;
+    return tree->build_count++;
+}
+
+static int add_token(ParseTree* tree, const Token* token) {
+    if (!grow_array(&tree->failed, (void**)&tree->tokens, &tree->token_cap, tree->token_count + 1, sizeof(Token))) {
+        return -1;
+    }
+    tree->tokens[tree->token_count] = *token;
+    return tree->token_count++;
+}
+
+int parse_tree_add_leaf(ParseTree* tree, int symbol, const Token* token) {
+    int index = add_token(tree, token);
+    return index < 0 ? -1 : new_build_node(tree, symbol, -1, index);
+}
+
+// Attach the matched token to a leaf created ahead of time (top-down parsers)
+void parse_tree_set_token(ParseTree* tree, int node, const Token* token) {
+    if (node < 0) return;
+    tree->build[node].token = add_token(tree, token);
+}
+
+int parse_tree_add_node(ParseTree* tree, int symbol, int production) {
+    return new_build_node(tree, symbol, production, -1);
+}
+
+void parse_tree_set_children(ParseTree* tree, int node, const int* children, int count) {
+    if (node < 0 || tree->failed) return;
+    if (!grow_array(&tree->failed, (void**)&tree->links, &tree->link_cap, tree->link_count + count, sizeof(int))) return;
+    
+    memcpy(tree->links + tree->link_count, children, (size_t)count * sizeof(int));
+    tree->build[node].first_link = tree->link_count;
+    tree->build[node].child_count = count;
+    tree->link_count += count;
+}
+
+// Lay the built tree out in preorder. Both passes are iterative, so deep
+// trees (long right-recursive tails, say) cannot overflow the C stack.
+bool parse_tree_finish(ParseTree* tree, int root) {
+    if (tree->failed || root < 0) return false;
+    if (!grow_array(&tree->failed, (void**)&tree->nodes, &tree->node_cap, tree->build_count, sizeof(ParseNode))) return false;
+    
+    // Explicit DFS stack, kept in the tree like the other buffers
+    if (!grow_array(&tree->failed, (void**)&tree->stack, &tree->stack_cap, tree->build_count + 1, sizeof(int))) {
+        return false;
+    }
+    int* stack = tree->stack;
+    
+    int top = 0;
+    tree->node_count = 0;
+    stack[top++] = root;
+    while (top > 0) {
+        ParseBuildNode* b = &tree->build[stack[--top]];
+        ParseNode* n = &tree->nodes[tree->node_count++];
+        n->symbol = b->symbol;
+        n->production = b->production;
+        n->token = b->token;
+        n->child_count = b->child_count;
+        n->size = 1;
+        
+        for (int i = b->child_count - 1; i >= 0; i--) {
+            stack[top++] = tree->links[b->first_link + i];
+        }
+    }
+    
+    // Children follow their parent, so one backward pass yields sizes
+    for (int i = tree->node_count - 1; i >= 0; i--) {
+        ParseNode* n = &tree->nodes[i];
+        int child = i + 1;
+        for (int c = 0; c < n->child_count; c++) {
+            n->size += tree->nodes[child].size;
+            child += tree->nodes[child].size;
+        }
+    }
+    
+    return true;
+}
+
+// Make room for at least `needed` entries. Returns false when out of memory;
+// the stack is left as it was.
+bool parse_stack_reserve(ParseStack* stack, int needed) {
+    if (needed <= stack->cap) return true;
+    
+    int new_cap = stack->cap ? stack->cap : 64;
+    while (new_cap < needed) new_cap *= 2;
+    
+    int* ids = realloc(stack->ids, (size_t)new_cap * sizeof(int));
+    if (ids == NULL) return false;
+    stack->ids = ids;
+    int* nodes = realloc(stack->nodes, (size_t)new_cap * sizeof(int));
+    if (nodes == NULL) return false;
+    stack->nodes = nodes;
+    stack->cap = new_cap;
+    return true;
+}
+
+void parse_stack_free(ParseStack* stack) {
+    free(stack->ids);
+    free(stack->nodes);
+    memset(stack, 0, sizeof(*stack));
+}
+
+void print_parse_tree(const ParseTree* tree, Grammar* g) {
+    printf("\n=== PARSE TREE ===\n");
+    
+    // Depth of each node follows from the subtree ranges of its ancestors
+    int* ends = malloc((size_t)(tree->node_count + 1) * sizeof(int));
+    if (ends == NULL) return;
+    
+    int depth = 0;
+    for (int i = 0; i < tree->node_count; i++) {
+        while (depth > 0 && ends[depth - 1] <= i) depth--;
+        
+        const ParseNode* n = &tree->nodes[i];
+        printf("%*s%s", depth * 2, "", symbol_name(n->symbol, g));
+        if (n->token >= 0) {
+            printf("  [%s]", tree->tokens[n->token].lexeme);
+        } else if (n->child_count == 0) {
+            printf("  [ε]");
+        }
+        printf("\n");
+        
+        ends[depth++] = i + n->size;
+    }
+    free(ends);
+}
+
+void parse_forest_init(ParseForest* forest) {
+    memset(forest, 0, sizeof(*forest));
+    forest->root = -1;
+}
+
+void parse_forest_reset(ParseForest* forest) {
+    forest->node_count = 0;
+    forest->packed_count = 0;
+    forest->child_count = 0;
+    forest->token_count = 0;
+    forest->root = -1;
+    forest->failed = false;
+}
+
+void parse_forest_free(ParseForest* forest) {
+    free(forest->nodes);
+    free(forest->packed);
+    free(forest->children);
+    free(forest->tokens);
+    parse_forest_init(forest);
+}
+
+static int new_forest_node(ParseForest* forest, int symbol, int start, int end, int token) {
+    if (!grow_array(&forest->failed, (void**)&forest->nodes, &forest->node_cap, forest->node_count + 1, sizeof(ForestNode))) {
+        return -1;
+    }
+    ForestNode* node = &forest->nodes[forest->node_count];
+    node->symbol = symbol;
+    node->start = start;
+    node->end = end;
+    node->token = token;
+    node->packed = -1;
+    return forest->node_count++;
+}
+
+// Terminal node for the token at input position `position`
+int forest_add_token(ParseForest* forest, int symbol, const Token* token, int position) {
+    if (!grow_array(&forest->failed, (void**)&forest->tokens, &forest->token_cap, forest->token_count + 1, sizeof(Token))) {
+        return -1;
+    }
+    forest->tokens[forest->token_count] = *token;
+    return new_forest_node(forest, symbol, position, position + 1, forest->token_count++);
+}
+
+// Non-terminal node for `symbol` over [start, end), with no derivations
+// yet. Callers keep nodes unique per symbol and span.
+int forest_add_node(ParseForest* forest, int symbol, int start, int end) {
+    return new_forest_node(forest, symbol, start, end, -1);
+}
+
+// Add one derivation of `node`. Returns false when the forest already had
+// it, or on allocation failure.
+bool forest_add_packed(ParseForest* forest, int node, int production, const int* children, int count) {
+    if (node < 0) return false;
+    
+    int last = -1;
+    for (int p = forest->nodes[node].packed; p >= 0; p = forest->packed[p].next) {
+        const ForestPacked* k = &forest->packed[p];
+        if (k->production == production && k->child_count == count &&
+            (count == 0 || memcmp(forest->children + k->first_child, children, (size_t)count * sizeof(int)) == 0)) {
+            return false;
+        }
+        last = p;
+    }
+    
+    if (!grow_array(&forest->failed, (void**)&forest->children, &forest->child_cap,
+                 forest->child_count + count, sizeof(int)) ||
+        !grow_array(&forest->failed, (void**)&forest->packed, &forest->packed_cap,
+                 forest->packed_count + 1, sizeof(ForestPacked))) {
+        return false;
+    }
+    if (count > 0) memcpy(forest->children + forest->child_count, children, (size_t)count * sizeof(int));
+    
+    // Appended, so the first derivation found stays first
+    ForestPacked* k = &forest->packed[forest->packed_count];
+    k->production = production;
+    k->first_child = forest->child_count;
+    k->child_count = count;
+    k->next = -1;
+    if (last >= 0) forest->packed[last].next = forest->packed_count;
+    else forest->nodes[node].packed = forest->packed_count;
+    
+    forest->child_count += count;
+    forest->packed_count++;
+    return true;
+}
+
+static uint64_t saturating_add(uint64_t a, uint64_t b) {
+    return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
+
+static uint64_t saturating_mul(uint64_t a, uint64_t b) {
+    return a != 0 && b > UINT64_MAX / a ? UINT64_MAX : a * b;
+}
+
+// Number of distinct parse trees in the forest. Saturates at UINT64_MAX,
+// which also stands for the infinitely many of a cyclic grammar. The walk
+// is iterative, so deep forests cannot overflow the C stack.
+uint64_t count_derivations(const ParseForest* forest) {
+    if (forest->root < 0) return 0;
+    
+    int n = forest->node_count;
+    uint64_t* count = malloc((size_t)n * sizeof(uint64_t));
+    unsigned char* state = calloc((size_t)n, 1);       // 0 new, 1 open, 2 done
+    int* stack = malloc((size_t)(forest->child_count + n + 1) * sizeof(int));
+    if (count == NULL || state == NULL || stack == NULL) {
+        free(count);
+        free(state);
+        free(stack);
+        return 0;
+    }
+    
+    int top = 0;
+    stack[top++] = forest->root;
+    while (top > 0) {
+        int v = stack[--top];
+        
+        if (v < 0) {
+            // All children are done now, except ancestors (a cycle)
+            v = ~v;
+            uint64_t total = forest->nodes[v].packed < 0 ? 1 : 0;
+            for (int p = forest->nodes[v].packed; p >= 0; p = forest->packed[p].next) {
+                const ForestPacked* k = &forest->packed[p];
+                uint64_t product = 1;
+                for (int c = 0; c < k->child_count; c++) {
+                    int child = forest->children[k->first_child + c];
+                    product = saturating_mul(product, state[child] == 2 ? count[child] : UINT64_MAX);
+                }
+                total = saturating_add(total, product);
+            }
+            count[v] = total;
+            state[v] = 2;
+            continue;
+        }
+        
+        if (state[v] != 0) continue;
+        state[v] = 1;
+        stack[top++] = ~v;
+        for (int p = forest->nodes[v].packed; p >= 0; p = forest->packed[p].next) {
+            const ForestPacked* k = &forest->packed[p];
+            for (int c = 0; c < k->child_count; c++) {
+                int child = forest->children[k->first_child + c];
+                if (state[child] == 0) stack[top++] = child;
+            }
+        }
+    }
+    
+    uint64_t total = count[forest->root];
+    free(count);
+    free(state);
+    free(stack);
+    return total;
+}
+
+// Extract one parse tree: for every node, the first derivation found to be
+// finite. Nodes are settled in rounds until nothing changes, so cycles are
+// never followed. Returns false when the forest has no finite derivation.
+bool forest_to_tree(const ParseForest* forest, ParseTree* tree) {
+    parse_tree_reset(tree);
+    if (forest->root < 0 || forest->failed) return false;
+    
+    // best[v]: packed node chosen for v, -1 while unsettled, -2 for terminals
+    int* best = malloc((size_t)forest->node_count * sizeof(int));
+    if (best == NULL) return false;
+    for (int v = 0; v < forest->node_count; v++) {
+        best[v] = forest->nodes[v].token >= 0 ? -2 : -1;
+    }
+    
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int v = 0; v < forest->node_count; v++) {
+            if (best[v] != -1) continue;
+            for (int p = forest->nodes[v].packed; p >= 0 && best[v] == -1; p = forest->packed[p].next) {
+                const ForestPacked* k = &forest->packed[p];
+                bool settled = true;
+                for (int c = 0; c < k->child_count && settled; c++) {
+                    settled = best[forest->children[k->first_child + c]] != -1;
+                }
+                if (settled) {
+                    best[v] = p;
+                    changed = true;
+                }
+            }
+        }
+    }
+    
+    int root = forest->root;
+    if (best[root] < 0) {
+        free(best);
+        return false;
+    }
+    
+    // Pending (forest node, tree node) pairs. Shared forest nodes such as ε
+    // spans may occur more than once in the tree.
+    ParseStack pending = { 0 };
+    int tree_root = parse_tree_add_node(tree, forest->nodes[root].symbol, forest->packed[best[root]].production);
+    bool ok = tree_root >= 0 && parse_stack_reserve(&pending, 1);
+    if (ok) {
+        pending.ids[0] = root;
+        pending.nodes[0] = tree_root;
+        pending.top = 1;
+    }
+    
+    while (ok && pending.top > 0) {
+        pending.top--;
+        int v = pending.ids[pending.top];
+        int parent = pending.nodes[pending.top];
+        const ForestPacked* k = &forest->packed[best[v]];
+        int children[MAX_PRODUCTIONS];
+        
+        if (k->child_count > MAX_PRODUCTIONS || !parse_stack_reserve(&pending, pending.top + k->child_count)) {
+            ok = false;
+            break;
+        }
+        for (int c = 0; c < k->child_count; c++) {
+            int child = forest->children[k->first_child + c];
+            const ForestNode* node = &forest->nodes[child];
+            if (node->token >= 0) {
+                children[c] = parse_tree_add_leaf(tree, node->symbol, &forest->tokens[node->token]);
+            } else {
+                children[c] = parse_tree_add_node(tree, node->symbol, forest->packed[best[child]].production);
+                pending.ids[pending.top] = child;
+                pending.nodes[pending.top++] = children[c];
+            }
+        }
+        parse_tree_set_children(tree, parent, children, k->child_count);
+    }
+    
+    parse_stack_free(&pending);
+    free(best);
+    return ok && parse_tree_finish(tree, tree_root);
+}
+
+static void format_forest_symbol(OutputBuffer* out, const ParseForest* forest, int v, Grammar* g) {
+    const ForestNode* node = &forest->nodes[v];
+    if (node->token >= 0) {
+        outbuf_printf(out, " %s", forest->tokens[node->token].lexeme);
+    } else {
+        outbuf_printf(out, " %s[%d,%d)", symbol_name(node->symbol, g), node->start, node->end);
+    }
+}
+
+// One line per non-terminal node reachable from the root, root first,
+// listing each packed derivation. Spans are token positions [start, end).
+void format_parse_forest(OutputBuffer* out, const ParseForest* forest, Grammar* g) {
+    if (forest->root < 0) return;
+    
+    uint64_t derivations = count_derivations(forest);
+    outbuf_puts(out, "\n=== PARSE FOREST ===\n");
+    if (derivations == UINT64_MAX) outbuf_puts(out, "Derivations: too many to count\n");
+    else outbuf_printf(out, "Derivations: %llu\n", (unsigned long long)derivations);
+    
+    // Mark the nodes reachable from the root
+    bool* reachable = calloc((size_t)forest->node_count, sizeof(bool));
+    int* stack = malloc((size_t)(forest->node_count + 1) * sizeof(int));
+    if (reachable == NULL || stack == NULL) {
+        free(reachable);
+        free(stack);
+        return;
+    }
+    int top = 0;
+    stack[top++] = forest->root;
+    reachable[forest->root] = true;
+    while (top > 0) {
+        int v = stack[--top];
+        for (int p = forest->nodes[v].packed; p >= 0; p = forest->packed[p].next) {
+            const ForestPacked* k = &forest->packed[p];
+            for (int c = 0; c < k->child_count; c++) {
+                int child = forest->children[k->first_child + c];
+                if (!reachable[child]) {
+                    reachable[child] = true;
+                    stack[top++] = child;
+                }
+            }
+        }
+    }
+    
+    for (int i = -1; i < forest->node_count; i++) {
+        int v = i < 0 ? forest->root : i;
+        if (!reachable[v] || forest->nodes[v].token >= 0 || (i >= 0 && v == forest->root)) continue;
+        
+        const ForestNode* node = &forest->nodes[v];
+        outbuf_printf(out, "%s[%d,%d) ::=", symbol_name(node->symbol, g), node->start, node->end);
+        for (int p = node->packed; p >= 0; p = forest->packed[p].next) {
+            const ForestPacked* k = &forest->packed[p];
+            if (p != node->packed) outbuf_puts(out, "\n    |");
+            for (int c = 0; c < k->child_count; c++) {
+                format_forest_symbol(out, forest, forest->children[k->first_child + c], g);
+            }
+            if (k->child_count == 0) outbuf_puts(out, " ε");
+        }
+        outbuf_puts(out, "\n");
+    }
+    
+    free(reachable);
+    free(stack);
+}
+
+void print_parse_forest(const ParseForest* forest, Grammar* g) {
+    OutputBuffer out;
+    fflush(stdout);
+    outbuf_init_file(&out, stdout);
+    format_parse_forest(&out, forest, g);
+    outbuf_flush(&out);
+    outbuf_free(&out);
+}
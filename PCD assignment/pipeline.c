@@ -0,0 +1,120 @@
+#include "compiler.h"
+#include "codegen.h"
+
+void compile_context_init(CompileContext* ctx) {
+    parse_tree_init(&ctx->tree);
+    parse_forest_init(&ctx->forest);
+    trace_log_init(&ctx->trace);
+    outbuf_init(&ctx->output);
+    outbuf_init(&ctx->assembly);
+}
+
+void compile_context_free(CompileContext* ctx) {
+    parse_tree_free(&ctx->tree);
+    parse_forest_free(&ctx->forest);
+    trace_log_free(&ctx->trace);
+    outbuf_free(&ctx->output);
+    outbuf_free(&ctx->assembly);
+}
+
+static void report(OutputBuffer* out, const char* name, const char* parser, bool accepted) {
+    if (name) outbuf_printf(out, "%s: ", name);
+    outbuf_printf(out, "%s %s\n", parser, accepted ? "ACCEPTED" : "REJECTED");
+}
+
+// Run the selected phases over `text`, writing tokens, parse results,
+// traces and TAC to `out`. Code is generated whenever a COMPILE_CODEGEN
+// phase is selected; writing assembly or objects from it is left to the
+// caller. `name` prefixes the summary lines and may be NULL.
+CompileStatus compile_source(Grammar* g, const char* name, const char* text, int phases,
+                             CompileTrace trace, CompileContext* ctx, OutputBuffer* out) {
+    TraceSink* sink = trace == COMPILE_TRACE_STEPS ? &ctx->trace.sink : NULL;
+    CompileStatus status = COMPILE_OK;
+    
+    if (phases & COMPILE_LEX) {
+        init_lexer(text);
+        format_tokens(out);
+    }
+    
+    if (phases & COMPILE_LL) {
+        trace_log_reset(&ctx->trace);
+        bool accepted = parse_ll_tree(text, NULL, sink);
+        if (sink) format_parse_trace(out, &ctx->trace, get_ll_grammar(), text);
+        if (trace != COMPILE_TRACE_NONE) {
+            format_diagnostics(out, name);
+            report(out, name, "LL", accepted);
+        }
+        if (!accepted) status = COMPILE_REJECTED;
+    }
+    
+    // Code comes from the Pratt tree when that parser is selected, then from
+    // GLR's first derivation; the LR parser only runs for code when neither is
+    bool pratt = (phases & COMPILE_PRATT) != 0;
+    bool glr = (phases & COMPILE_GLR) != 0;
+    bool pratt_accepted = false;
+    if (pratt) {
+        pratt_accepted = parse_pratt_tree(text, &ctx->tree);
+        if (trace != COMPILE_TRACE_NONE) {
+            format_diagnostics(out, name);
+            report(out, name, "Pratt", pratt_accepted);
+        }
+        if (!pratt_accepted) status = COMPILE_REJECTED;
+    }
+    
+    if (glr) {
+        bool accepted = parse_glr(text, &ctx->forest);
+        if (sink && accepted) format_parse_forest(out, &ctx->forest, g);
+        if (trace != COMPILE_TRACE_NONE) {
+            format_diagnostics(out, name);
+            report(out, name, "GLR", accepted);
+        }
+        if (!accepted) status = COMPILE_REJECTED;
+    }
+    
+    if ((phases & COMPILE_LR) || ((phases & COMPILE_CODEGEN) && !glr && !pratt)) {
+        trace_log_reset(&ctx->trace);
+        bool accepted = parse_lr_tree(text, pratt ? NULL : &ctx->tree, sink);
+        if (sink) format_parse_trace(out, &ctx->trace, g, text);
+        if (trace != COMPILE_TRACE_NONE) {
+            format_diagnostics(out, name);
+            report(out, name, "LR", accepted);
+        }
+        if (!accepted) return COMPILE_REJECTED;
+    }
+    if (!(phases & COMPILE_CODEGEN)) return status;
+    if (pratt ? !pratt_accepted : glr && ctx->forest.root < 0) return COMPILE_REJECTED;
+    
+    if ((glr && !pratt && !forest_to_tree(&ctx->forest, &ctx->tree)) || !generate_code_from_tree(&ctx->tree)) {
+        if (name) outbuf_printf(out, "%s: ", name);
+        outbuf_puts(out, "no code generated\n");
+        return COMPILE_REJECTED;
+    }
+    if (phases & COMPILE_TAC) format_tac(out);
+    return status;
+}
+
+// compile_source behind the result cache. The text output ends up in
+// ctx->output and, with COMPILE_ASM, the assembly in ctx->assembly. A hit
+// does no lexing, parsing or code generation at all. Object output needs
+// the code generator's state, so COMPILE_OBJ requests always compile.
+// `cache` may be NULL.
+CompileStatus compile_cached(CompileCache* cache, Grammar* g, uint64_t grammar_hash, const char* name,
+                             const char* text, int phases, CompileTrace trace, CompileContext* ctx) {
+    CompileStatus status;
+    outbuf_reset(&ctx->output);
+    outbuf_reset(&ctx->assembly);
+    
+    bool cacheable = cache != NULL && !(phases & COMPILE_OBJ);
+    if (cacheable && cache_lookup(cache, grammar_hash, name, text, phases, trace,
+                                  &ctx->output, &ctx->assembly, &status)) {
+        return status;
+    }
+    
+    status = compile_source(g, name, text, phases, trace, ctx, &ctx->output);
+    if (status == COMPILE_OK && (phases & COMPILE_ASM)) emit_assembly(&ctx->assembly);
+    
+    if (cacheable && !ctx->output.failed && !ctx->assembly.failed) {
+        cache_store(cache, grammar_hash, name, text, phases, trace, status, &ctx->output, &ctx->assembly);
+    }
+    return status;
+}
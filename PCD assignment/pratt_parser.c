@@ -0,0 +1,403 @@
+// Pratt (operator-precedence) parser for expression grammars. Binding
+// powers are read off the grammar's precedence levels, so an input is
+// parsed with one loop iteration per token: an operand never walks the
+// E -> T -> F chain, and no E'/T' tail is expanded and popped per level.
+// The tree it builds has one node per operator and per group, which is all
+// the code generator looks at.
+#include "compiler.h"
+
+typedef enum {
+    PRATT_NONE,
+    PRATT_OPERAND,      // primary terminal such as id
+    PRATT_INFIX,        // binary operator
+    PRATT_OPEN,         // opening terminal of a group such as ( E )
+    PRATT_CLOSE
+} PrattRole;
+
+static Grammar* grammar = NULL;
+static bool pratt_ready = false;
+static int end_terminal = -1;
+
+// Per terminal index. An infix operator of precedence level i (0 binds
+// loosest) has left power 2i + 1 and right power 2i + 2, or 2i + 1 when it
+// is right-associative. For infix operators and groups, node_symbol and
+// node_production label the tree node built for them.
+static unsigned char role[MAX_SYMBOLS];
+static int left_bp[MAX_SYMBOLS];
+static int right_bp[MAX_SYMBOLS];
+static int node_symbol[MAX_SYMBOLS];
+static int node_production[MAX_SYMBOLS];
+static int close_of[MAX_SYMBOLS];       // group close terminal per open terminal
+static int level_of[MAX_SYMBOLS];
+static bool nonassoc[MAX_SYMBOLS];      // %nonassoc: no chaining within the level
+
+// Operators and open groups waiting for their right operand. An operator
+// entry sits on a STACK_OPERAND entry holding its left operand, and an open
+// group on a STACK_ENCLOSING entry holding the open terminal of the group
+// around it. Capacity is kept between parses.
+static _Thread_local ParseStack pratt_stack;
+
+#define STACK_OPERAND (-1)
+#define STACK_ENCLOSING (-2)
+
+static int terminal_index(const char* symbol) {
+    for (int i = 0; i < grammar->terminal_count; i++) {
+        if (strcmp(grammar->terminals[i], symbol) == 0) return i;
+    }
+    return -1;
+}
+
+// A terminal has one role; only a close may be shared between groups
+static bool set_role(int terminal, PrattRole r) {
+    if (terminal < 0) return false;
+    if (role[terminal] != PRATT_NONE) return role[terminal] == r && r == PRATT_CLOSE;
+    role[terminal] = (unsigned char)r;
+    return true;
+}
+
+static bool add_infix(const char* op, int level, bool right_assoc, const char* lhs, int production) {
+    int t = terminal_index(op);
+    if (!set_role(t, PRATT_INFIX)) return false;
+    left_bp[t] = 2 * level + 1;
+    right_bp[t] = right_assoc ? 2 * level + 1 : 2 * level + 2;
+    node_symbol[t] = symbol_id(lhs, grammar);
+    node_production[t] = production;
+    level_of[t] = level;
+    return true;
+}
+
+// T -> op B T | ε, the tail left behind by removing left recursion from
+// A -> A op B | B. Its operators are left-associative at A's level.
+static bool add_tail_operators(const char* lhs, const char* tail, const char* next, int level) {
+    int ops = 0;
+    for (int i = 0; i < grammar->prod_count; i++) {
+        const Production* p = &grammar->productions[i];
+        if (strcmp(p->lhs, tail) != 0) continue;
+        if (p->rhs_count == 1 && strcmp(p->rhs[0], "ε") == 0) continue;
+        if (p->rhs_count != 3 || !is_terminal(p->rhs[0], grammar) ||
+            strcmp(p->rhs[1], next) != 0 || strcmp(p->rhs[2], tail) != 0) {
+            return false;
+        }
+        if (!add_infix(p->rhs[0], level, false, lhs, i)) return false;
+        ops++;
+    }
+    return ops > 0;
+}
+
+// A primary alternative: an operand terminal or a group "open S close"
+// around the start symbol
+static bool add_primary(int production) {
+    const Production* p = &grammar->productions[production];
+    if (p->rhs_count == 1 && is_terminal(p->rhs[0], grammar)) {
+        return set_role(terminal_index(p->rhs[0]), PRATT_OPERAND);
+    }
+    if (p->rhs_count == 3 && is_terminal(p->rhs[0], grammar) &&
+        strcmp(p->rhs[1], grammar->start_symbol) == 0 && is_terminal(p->rhs[2], grammar)) {
+        int open = terminal_index(p->rhs[0]);
+        int close = terminal_index(p->rhs[2]);
+        if (open == close || !set_role(open, PRATT_OPEN) || !set_role(close, PRATT_CLOSE)) return false;
+        close_of[open] = close;
+        node_symbol[open] = symbol_id(p->lhs, grammar);
+        node_production[open] = production;
+        return true;
+    }
+    return false;
+}
+
+// Primary level: every alternative is a primary
+static bool add_primaries(const char* lhs) {
+    for (int i = 0; i < grammar->prod_count; i++) {
+        if (strcmp(grammar->productions[i].lhs, lhs) == 0 && !add_primary(i)) return false;
+    }
+    return true;
+}
+
+// Walk the precedence levels down from the start symbol. A level is
+//   A -> A op B | ... | B       left-associative operators
+//   A -> B op A | ... | B       right-associative operators
+//   A -> B T                    with T an operator tail (see above)
+//   A -> B                      a level without operators
+// and the walk ends at the primary level.
+static bool read_levels() {
+    const char* a = grammar->start_symbol;
+    
+    for (int level = 0; level <= grammar->non_terminal_count; level++) {
+        const char* next = NULL;
+        const char* tail = NULL;
+        int total = 0, units = 0, left = 0, right = 0, other = 0;
+        
+        for (int i = 0; i < grammar->prod_count; i++) {
+            const Production* p = &grammar->productions[i];
+            if (strcmp(p->lhs, a) != 0) continue;
+            total++;
+            
+            const char* operand = NULL;
+            if (p->rhs_count == 1 && is_non_terminal(p->rhs[0], grammar)) {
+                operand = p->rhs[0];
+                units++;
+            } else if (p->rhs_count == 3 && strcmp(p->rhs[0], a) == 0 && is_terminal(p->rhs[1], grammar) &&
+                       is_non_terminal(p->rhs[2], grammar) && strcmp(p->rhs[2], a) != 0) {
+                operand = p->rhs[2];
+                left++;
+            } else if (p->rhs_count == 3 && strcmp(p->rhs[2], a) == 0 && is_terminal(p->rhs[1], grammar) &&
+                       is_non_terminal(p->rhs[0], grammar) && strcmp(p->rhs[0], a) != 0) {
+                operand = p->rhs[0];
+                right++;
+            } else if (p->rhs_count == 2 && is_non_terminal(p->rhs[0], grammar) &&
+                       is_non_terminal(p->rhs[1], grammar)) {
+                operand = p->rhs[0];
+                tail = p->rhs[1];
+            } else {
+                other++;
+            }
+            if (operand != NULL) {
+                if (next != NULL && strcmp(next, operand) != 0) return false;
+                next = operand;
+            }
+        }
+        
+        if (total == 0) return false;
+        if (other > 0) return other == total && add_primaries(a);
+        
+        if (tail != NULL) {
+            if (total != 1 || !add_tail_operators(a, tail, next, level)) return false;
+        } else if (units != 1 || (left > 0 && right > 0)) {
+            return false;
+        } else {
+            for (int i = 0; i < grammar->prod_count; i++) {
+                const Production* p = &grammar->productions[i];
+                if (strcmp(p->lhs, a) != 0 || p->rhs_count != 3) continue;
+                if (!add_infix(p->rhs[1], level, right > 0, a, i)) return false;
+            }
+        }
+        a = next;
+    }
+    return false;  // the levels loop back on themselves
+}
+
+// A flat grammar S -> S op S | ... | primaries whose operators all have
+// %left/%right/%nonassoc declarations; the declared levels are the
+// precedence levels
+static bool read_declarations() {
+    const char* s = grammar->start_symbol;
+    int ops = 0;
+    
+    for (int i = 0; i < grammar->prod_count; i++) {
+        const Production* p = &grammar->productions[i];
+        if (strcmp(p->lhs, s) != 0) continue;
+        
+        if (p->rhs_count == 3 && strcmp(p->rhs[0], s) == 0 && strcmp(p->rhs[2], s) == 0) {
+            const PrecedenceDecl* d = find_precedence(grammar, p->rhs[1]);
+            if (d == NULL || !add_infix(p->rhs[1], d->level - 1, d->assoc == ASSOC_RIGHT, s, i)) return false;
+            nonassoc[terminal_index(p->rhs[1])] = d->assoc == ASSOC_NONASSOC;
+            ops++;
+        } else if (!add_primary(i)) {
+            return false;
+        }
+    }
+    return ops > 0;
+}
+
+static void reset_table() {
+    memset(role, PRATT_NONE, sizeof(role));
+    memset(close_of, -1, sizeof(close_of));
+    memset(level_of, -1, sizeof(level_of));
+    memset(nonassoc, 0, sizeof(nonassoc));
+}
+
+// Derive the binding-power table from `g`'s precedence declarations or,
+// failing that, its levels. Returns false when the grammar is not an
+// operator-precedence expression grammar; parse_pratt then rejects every
+// input.
+bool build_pratt_table(Grammar* g) {
+    grammar = g;
+    end_terminal = terminal_index("$");
+    reset_table();
+    pratt_ready = g->precedence_count > 0 && read_declarations();
+    if (!pratt_ready) {
+        reset_table();
+        pratt_ready = read_levels();
+    }
+    pratt_ready = pratt_ready && end_terminal >= 0;
+    return pratt_ready;
+}
+
+void print_pratt_table() {
+    printf("\n=== PRATT BINDING POWERS ===\n");
+    if (!pratt_ready) {
+        printf("Grammar has no operator-precedence form\n");
+        return;
+    }
+    
+    printf("%-10s %-6s %-10s %-10s %s\n", "Operator", "Level", "Left BP", "Right BP", "Assoc");
+    printf("----------------------------------------------\n");
+    for (int level = 0; level < MAX_SYMBOLS; level++) {
+        for (int t = 0; t < grammar->terminal_count; t++) {
+            if (role[t] != PRATT_INFIX || level_of[t] != level) continue;
+            printf("%-10s %-6d %-10d %-10d %s\n", grammar->terminals[t], level, left_bp[t], right_bp[t],
+                   nonassoc[t] ? "none" : left_bp[t] == right_bp[t] ? "right" : "left");
+        }
+    }
+    
+    printf("\nOperands:");
+    for (int t = 0; t < grammar->terminal_count; t++) {
+        if (role[t] == PRATT_OPERAND) printf(" %s", grammar->terminals[t]);
+    }
+    printf("\nGroups:  ");
+    for (int t = 0; t < grammar->terminal_count; t++) {
+        if (role[t] == PRATT_OPEN) printf(" %s ... %s", grammar->terminals[t], grammar->terminals[close_of[t]]);
+    }
+    printf("\n");
+}
+
+// Report the lookahead with the terminals that could have come instead: an
+// operand or group when one is due, otherwise an operator, the innermost
+// group's close or the end of input
+static void report_unexpected(const Token* token, bool want_operand, int open) {
+    const char* expected[MAX_SYMBOLS];
+    int count = 0;
+    char text[MAX_DIAGNOSTIC_LEN];
+    
+    for (int t = 0; t < grammar->terminal_count; t++) {
+        bool ok = want_operand ? role[t] == PRATT_OPERAND || role[t] == PRATT_OPEN
+                               : role[t] == PRATT_INFIX || (open >= 0 ? t == close_of[open] : t == end_terminal);
+        if (ok) expected[count++] = grammar->terminals[t];
+    }
+    format_expected(text, sizeof(text), expected, count);
+    add_diagnostic(token, "unexpected %s; expected %s", describe_token(token), text);
+}
+
+// Replace "operand op" on top of the stack and the operand `right` by
+// one operator node
+static int reduce_operator(ParseTree* tree, ParseStack* stack, int right) {
+    int op = stack->ids[stack->top - 1];
+    int children[3] = { stack->nodes[stack->top - 2], stack->nodes[stack->top - 1], right };
+    stack->top -= 2;
+    compiler_stats.pratt_reduces++;
+    if (tree == NULL) return -1;
+    
+    int node = parse_tree_add_node(tree, node_symbol[op], node_production[op]);
+    parse_tree_set_children(tree, node, children, 3);
+    return node;
+}
+
+// Precedence climbing on an explicit stack, so neither long operator
+// chains nor deep nesting use C stack. Stops at the first syntax error.
+static bool pratt_parse(const char* input, ParseTree* tree) {
+    if (!pratt_ready) {
+        printf("\nERROR: Grammar has no operator-precedence form\n");
+        return false;
+    }
+    
+    init_lexer(input);
+    if (tree) parse_tree_reset(tree);
+    
+    ParseStack* stack = &pratt_stack;
+    stack->top = 0;
+    bool want_operand = true;
+    int operand = -1;       // tree node of the last complete operand
+    int open = -1;          // open terminal of the innermost group
+    
+    while (true) {
+        Token token = get_next_token();
+        int t = terminal_index(terminal_for_token(&token, grammar));
+        int r = t >= 0 ? role[t] : PRATT_NONE;
+        
+        if (want_operand) {
+            if (r != PRATT_OPERAND && r != PRATT_OPEN) {
+                report_unexpected(&token, true, open);
+                return false;
+            }
+            int leaf = tree ? parse_tree_add_leaf(tree, t, &token) : -1;
+            if (r == PRATT_OPERAND) {
+                operand = leaf;
+                want_operand = false;
+                continue;
+            }
+            if (!parse_stack_reserve(stack, stack->top + 2)) {
+                printf("\nERROR: Out of memory for the parse stack\n");
+                return false;
+            }
+            stack->ids[stack->top] = STACK_ENCLOSING;
+            stack->nodes[stack->top++] = open;
+            stack->ids[stack->top] = t;
+            stack->nodes[stack->top++] = leaf;
+            if (stack->top > compiler_stats.pratt_max_depth) compiler_stats.pratt_max_depth = stack->top;
+            open = t;
+            continue;
+        }
+        
+        if (r == PRATT_INFIX) {
+            // Operators that bind tighter than this one take the operand
+            while (stack->top > 0 && role[stack->ids[stack->top - 1]] == PRATT_INFIX &&
+                   left_bp[t] < right_bp[stack->ids[stack->top - 1]]) {
+                int op = stack->ids[stack->top - 1];
+                if (nonassoc[t] && level_of[op] == level_of[t]) {
+                    add_diagnostic(&token, "%s is non-associative and cannot follow '%s'",
+                                   describe_token(&token), grammar->terminals[op]);
+                    return false;
+                }
+                operand = reduce_operator(tree, stack, operand);
+            }
+            if (!parse_stack_reserve(stack, stack->top + 2)) {
+                printf("\nERROR: Out of memory for the parse stack\n");
+                return false;
+            }
+            stack->ids[stack->top] = STACK_OPERAND;
+            stack->nodes[stack->top++] = operand;
+            stack->ids[stack->top] = t;
+            stack->nodes[stack->top++] = tree ? parse_tree_add_leaf(tree, t, &token) : -1;
+            if (stack->top > compiler_stats.pratt_max_depth) compiler_stats.pratt_max_depth = stack->top;
+            want_operand = true;
+            continue;
+        }
+        
+        if ((open >= 0 && t == close_of[open]) || (open < 0 && t == end_terminal)) {
+            while (stack->top > 0 && role[stack->ids[stack->top - 1]] == PRATT_INFIX) {
+                operand = reduce_operator(tree, stack, operand);
+            }
+            if (open < 0) {
+                if (tree == NULL) return true;
+                if (!parse_tree_finish(tree, operand)) {
+                    printf("\nERROR: Out of memory for the parse tree\n");
+                    return false;
+                }
+                return true;
+            }
+            
+            // Close the group around the operand
+            int children[3] = { stack->nodes[stack->top - 1], operand, -1 };
+            if (tree) {
+                children[2] = parse_tree_add_leaf(tree, t, &token);
+                operand = parse_tree_add_node(tree, node_symbol[open], node_production[open]);
+                parse_tree_set_children(tree, operand, children, 3);
+            }
+            open = stack->nodes[stack->top - 2];
+            stack->top -= 2;
+            continue;
+        }
+        
+        report_unexpected(&token, false, open);
+        return false;
+    }
+}
+
+bool parse_pratt(const char* input) {
+    return parse_pratt_tree(input, NULL);
+}
+
+// Parse `input` with the Pratt parser, building `tree` unless it is NULL.
+// There is no error recovery: the first syntax error is reported to the
+// diagnostics list and the input rejected.
+bool parse_pratt_tree(const char* input, ParseTree* tree) {
+    PhaseTimer timer = phase_begin();
+    reset_diagnostics();
+    bool accepted = pratt_parse(input, tree);
+    phase_end(PHASE_PRATT_PARSE, timer);
+    return accepted;
+}
+
+// Free this thread's parse stack, for worker threads about to exit
+void free_pratt_stack() {
+    parse_stack_free(&pratt_stack);
+}
@@ -0,0 +1,500 @@
+// Compile server. The grammar and its LL/LR tables are built once; a pool
+// of worker threads then serves requests from clients connected over a
+// Unix domain socket. The main thread polls every connection and reads
+// requests as they arrive, and only whole requests are queued to the
+// workers, so an idle client holds a connection slot but never a worker.
+// The tables are read-only while serving, and all per-compile state
+// (lexer, code generator, counters) is thread-local.
+#define _POSIX_C_SOURCE 200809L
+
+#include "compiler.h"
+#include "codegen.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define SERVER_MAX_THREADS 64
+#define SERVER_MAX_CLIENTS 1024
+#define SERVER_BACKLOG 128
+#define SERVER_POLL_MS 200
+#define SERVER_IDLE_MS 60000        // a connection with no request in flight
+#define SERVER_SEND_TIMEOUT_S 10    // a client that stops reading its reply
+
+// A connection. The poller reads its next request into `message` (4-byte
+// length, then the body) while `busy` is false; from when the request is
+// queued until the worker reports back, the worker owns it.
+typedef struct {
+    int fd;             // -1 for a free slot
+    char* message;
+    size_t len;
+    size_t cap;
+    bool busy;
+    uint64_t last_active_ms;
+} Client;
+
+// Whole requests waiting for a worker, as client slots. Each client has at
+// most one request in flight, so the queue never fills.
+typedef struct {
+    int slots[SERVER_MAX_CLIENTS];
+    int head;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+} RequestQueue;
+
+static Grammar* server_grammar;
+static uint64_t server_grammar_hash;
+static CompileCache* server_cache;
+static bool server_lr_ready;
+static bool server_pratt_ready;
+static FirstFollowSet server_first_sets[MAX_SYMBOLS];
+static FirstFollowSet server_follow_sets[MAX_SYMBOLS];
+static Client clients[SERVER_MAX_CLIENTS];
+static RequestQueue queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER
+};
+// Workers write the slot of each finished request here, negated when the
+// reply could not be sent, to wake the poller
+static int done_pipe[2] = { -1, -1 };
+// Set from the signal handler, read by every worker
+static _Atomic int stopping = 0;
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static bool read_all(int fd, void* data, size_t n) {
+    char* p = data;
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= (size_t)got;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void* data, size_t n) {
+    const char* p = data;
+    while (n > 0) {
+        ssize_t sent = send(fd, p, n, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        n -= (size_t)sent;
+    }
+    return true;
+}
+
+static void put_length(unsigned char* p, uint32_t n) {
+    p[0] = (unsigned char)(n >> 24);
+    p[1] = (unsigned char)(n >> 16);
+    p[2] = (unsigned char)(n >> 8);
+    p[3] = (unsigned char)n;
+}
+
+static uint32_t get_length(const unsigned char* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t now_ms() {
+    return stats_now_ns() / 1000000;
+}
+
+// Compile one request body into `reply`, which already holds room for the
+// length and status bytes
+static CompileStatus handle_request(const char* body, CompileContext* ctx, OutputBuffer* reply) {
+    int phases = (unsigned char)body[0];
+    CompileTrace trace = (CompileTrace)body[1];
+    const char* text = body + 2;
+    if (trace > COMPILE_TRACE_STEPS) trace = COMPILE_TRACE_SUMMARY;
+    
+    bool needs_lr = (phases & (COMPILE_LR | COMPILE_GLR)) || ((phases & COMPILE_CODEGEN) && !(phases & COMPILE_PRATT));
+    if (needs_lr && !server_lr_ready) {
+        outbuf_puts(reply, "ERROR: Grammar exceeds the LR table limits\n");
+        return COMPILE_ERROR;
+    }
+    if ((phases & COMPILE_PRATT) && !server_pratt_ready) {
+        outbuf_puts(reply, "ERROR: Grammar has no operator-precedence form\n");
+        return COMPILE_ERROR;
+    }
+    if (phases & COMPILE_OBJ) {
+        outbuf_puts(reply, "ERROR: Object output is not available from the server\n");
+        return COMPILE_ERROR;
+    }
+    
+    CompileStatus status = compile_cached(server_cache, server_grammar, server_grammar_hash, NULL,
+                                          text, phases, trace, ctx);
+    outbuf_write(reply, ctx->output.data, ctx->output.len);
+    outbuf_write(reply, ctx->assembly.data, ctx->assembly.len);
+    return status;
+}
+
+// Compile the client's request and send the reply
+static bool serve_request(Client* client, CompileContext* ctx, OutputBuffer* reply) {
+    // Length and status are filled in once the output is complete
+    outbuf_reset(reply);
+    outbuf_write(reply, "\0\0\0\0\0", 5);
+    CompileStatus status = handle_request(client->message + 4, ctx, reply);
+    if (reply->failed) return false;
+    
+    put_length((unsigned char*)reply->data, (uint32_t)(reply->len - 4));
+    reply->data[4] = (char)status;
+    return write_all(client->fd, reply->data, reply->len);
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    CompileContext ctx;
+    OutputBuffer reply;
+    compile_context_init(&ctx);
+    outbuf_init(&reply);
+    
+    while (true) {
+        pthread_mutex_lock(&queue.lock);
+        while (queue.count == 0 && !stopping) pthread_cond_wait(&queue.not_empty, &queue.lock);
+        if (queue.count == 0) {
+            pthread_mutex_unlock(&queue.lock);
+            break;
+        }
+        int slot = queue.slots[queue.head];
+        queue.head = (queue.head + 1) % SERVER_MAX_CLIENTS;
+        queue.count--;
+        pthread_mutex_unlock(&queue.lock);
+        
+        // Slot numbers are offset by one so that a failure can be negated
+        int done = serve_request(&clients[slot], &ctx, &reply) ? slot + 1 : -(slot + 1);
+        if (write(done_pipe[1], &done, sizeof(done)) < 0) {
+            // Only fails once the poller has gone; nothing to wake
+        }
+    }
+    
+    outbuf_free(&reply);
+    compile_context_free(&ctx);
+    return NULL;
+}
+
+static void enqueue_request(int slot) {
+    pthread_mutex_lock(&queue.lock);
+    queue.slots[(queue.head + queue.count) % SERVER_MAX_CLIENTS] = slot;
+    queue.count++;
+    pthread_cond_signal(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+}
+
+static void close_client(Client* client) {
+    close(client->fd);
+    free(client->message);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+}
+
+static void accept_client(int listener) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) return;
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) continue;
+        struct timeval timeout = { SERVER_SEND_TIMEOUT_S, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        clients[i].fd = fd;
+        clients[i].last_active_ms = now_ms();
+        return;
+    }
+    close(fd);
+}
+
+// Read what has arrived of the client's next request. Returns false when
+// the connection is finished: closed by the client, or a malformed length.
+static bool read_client(int slot) {
+    Client* client = &clients[slot];
+    size_t want = 4;
+    if (client->len >= 4) {
+        uint32_t length = get_length((unsigned char*)client->message);
+        if (length < 2 || length > SERVER_MAX_MESSAGE) return false;
+        want = 4 + (size_t)length;
+    }
+    if (want + 1 > client->cap) {
+        size_t cap = want + 1 < 64 ? 64 : want + 1;
+        char* grown = realloc(client->message, cap);
+        if (grown == NULL) return false;
+        client->message = grown;
+        client->cap = cap;
+    }
+    
+    ssize_t got = recv(client->fd, client->message + client->len, want - client->len, MSG_DONTWAIT);
+    if (got < 0) return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+    if (got == 0) return false;
+    client->len += (size_t)got;
+    client->last_active_ms = now_ms();
+    
+    // The length is complete: read on for the body next time round
+    if (client->len == 4) return true;
+    if (client->len == want) {
+        client->message[want] = '\0';
+        client->busy = true;
+        enqueue_request(slot);
+    }
+    return true;
+}
+
+// Workers report finished requests on the pipe; those connections are
+// polled for the next request again, or closed if the reply failed
+static void collect_replies() {
+    int done;
+    while (read(done_pipe[0], &done, sizeof(done)) == (ssize_t)sizeof(done)) {
+        Client* client = &clients[(done < 0 ? -done : done) - 1];
+        client->busy = false;
+        client->len = 0;
+        client->last_active_ms = now_ms();
+        if (done < 0) close_client(client);
+    }
+}
+
+// Poll the listener, the workers' pipe and every connection that is
+// between requests, until the server stops
+static void poll_clients(int listener) {
+    static struct pollfd fds[SERVER_MAX_CLIENTS + 2];
+    static int slots[SERVER_MAX_CLIENTS + 2];
+    
+    while (!stopping) {
+        int count = 0, open = 0;
+        uint64_t now = now_ms();
+        fds[count++] = (struct pollfd){ done_pipe[0], POLLIN, 0 };
+        for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0) continue;
+            open++;
+            if (clients[i].busy) continue;
+            if (now - clients[i].last_active_ms > SERVER_IDLE_MS) {
+                close_client(&clients[i]);
+                open--;
+                continue;
+            }
+            slots[count] = i;
+            fds[count++] = (struct pollfd){ clients[i].fd, POLLIN, 0 };
+        }
+        // At the connection cap, new clients wait in the listen backlog
+        int listen_index = -1;
+        if (open < SERVER_MAX_CLIENTS) {
+            listen_index = count;
+            fds[count++] = (struct pollfd){ listener, POLLIN, 0 };
+        }
+        
+        int ready = poll(fds, (nfds_t)count, SERVER_POLL_MS);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+        
+        if (fds[0].revents & POLLIN) collect_replies();
+        for (int k = 1; k < count; k++) {
+            if (k == listen_index || !fds[k].revents) continue;
+            Client* client = &clients[slots[k]];
+            if (client->fd < 0 || client->busy) continue;
+            if (!read_client(slots[k])) close_client(client);
+        }
+        if (listen_index >= 0 && (fds[listen_index].revents & POLLIN)) accept_client(listener);
+    }
+}
+
+static bool socket_address(const char* path, struct sockaddr_un* addr) {
+    if (strlen(path) >= sizeof(addr->sun_path)) return false;
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+static int open_listener(const char* path) {
+    struct sockaddr_un addr;
+    if (!socket_address(path, &addr)) {
+        fprintf(stderr, "compiler: socket path too long: %s\n", path);
+        return -1;
+    }
+    
+    struct stat st;
+    if (lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "compiler: %s exists and is not a socket\n", path);
+        return -1;
+    }
+    
+    // A socket file nobody answers on is left over from a previous run
+    int probe = server_connect(path);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "compiler: a server is already listening on %s\n", path);
+        return -1;
+    }
+    unlink(path);
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SERVER_BACKLOG) != 0) {
+        fprintf(stderr, "compiler: cannot listen on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Build the tables and serve until SIGINT or SIGTERM. `cache` may be NULL.
+int run_server(Grammar* g, CompileCache* cache, const char* socket_path, int threads) {
+    server_grammar = g;
+    server_grammar_hash = grammar_hash(g);
+    server_cache = cache;
+    init_ll_parser(g);
+    compute_first_sets(g, server_first_sets);
+    compute_follow_sets(g, server_first_sets, server_follow_sets);
+    build_ll_table(g, server_first_sets, server_follow_sets);
+    init_lr_parser(g);
+    server_lr_ready = construct_lr_table();
+    server_pratt_ready = build_pratt_table(g);
+    
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    if (threads > SERVER_MAX_THREADS) threads = SERVER_MAX_THREADS;
+    
+    int listener = open_listener(socket_path);
+    if (listener < 0) return COMPILE_ERROR;
+    if (pipe(done_pipe) != 0 || fcntl(done_pipe[0], F_SETFL, O_NONBLOCK) != 0) {
+        close(listener);
+        unlink(socket_path);
+        return COMPILE_ERROR;
+    }
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++) clients[i].fd = -1;
+    
+    // Workers inherit a mask without SIGINT/SIGTERM, so the signals
+    // interrupt poll() in this thread
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    
+    sigset_t stop_signals, saved_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &saved_mask);
+    
+    pthread_t workers[SERVER_MAX_THREADS];
+    int started = 0;
+    while (started < threads && pthread_create(&workers[started], NULL, worker_main, NULL) == 0) started++;
+    pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+    
+    fprintf(stderr, "compiler: serving on %s with %d threads%s\n", socket_path, started,
+            server_lr_ready ? "" : " (LR phases unavailable: grammar exceeds the LR table limits)");
+    
+    if (started > 0) poll_clients(listener);
+    
+    // Workers finish the requests already queued, then exit
+    pthread_mutex_lock(&queue.lock);
+    stopping = 1;
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) close_client(&clients[i]);
+    }
+    close(done_pipe[0]);
+    close(done_pipe[1]);
+    
+    close(listener);
+    unlink(socket_path);
+    if (cache) print_cache_stats(cache);
+    return started > 0 ? COMPILE_OK : COMPILE_ERROR;
+}
+
+int server_connect(const char* socket_path) {
+    struct sockaddr_un addr;
+    if (!socket_address(socket_path, &addr)) return -1;
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Send one compile request and append the reply's output text to `reply`
+bool server_request(int fd, int phases, CompileTrace trace, const char* text,
+                    OutputBuffer* reply, CompileStatus* status) {
+    size_t text_len = strlen(text);
+    if (text_len + 2 > SERVER_MAX_MESSAGE) return false;
+    
+    unsigned char header[6];
+    put_length(header, (uint32_t)(text_len + 2));
+    header[4] = (unsigned char)phases;
+    header[5] = (unsigned char)trace;
+    if (!write_all(fd, header, sizeof(header)) || !write_all(fd, text, text_len)) return false;
+    
+    unsigned char reply_header[5];
+    if (!read_all(fd, reply_header, sizeof(reply_header))) return false;
+    uint32_t length = get_length(reply_header);
+    if (length < 1 || length > SERVER_MAX_MESSAGE) return false;
+    *status = (CompileStatus)reply_header[4];
+    
+    char chunk[4096];
+    for (uint32_t left = length - 1; left > 0; ) {
+        size_t n = left < sizeof(chunk) ? left : sizeof(chunk);
+        if (!read_all(fd, chunk, n)) return false;
+        outbuf_write(reply, chunk, n);
+        left -= (uint32_t)n;
+    }
+    return !reply->failed;
+}
+
+void server_disconnect(int fd) {
+    close(fd);
+}
+
+#else
+
+// Unix domain sockets are not used on Windows builds
+int run_server(Grammar* g, CompileCache* cache, const char* socket_path, int threads) {
+    (void)g;
+    (void)cache;
+    (void)threads;
+    fprintf(stderr, "compiler: cannot serve on %s: server mode needs a POSIX system\n", socket_path);
+    return COMPILE_ERROR;
+}
+
+int server_connect(const char* socket_path) {
+    (void)socket_path;
+    return -1;
+}
+
+bool server_request(int fd, int phases, CompileTrace trace, const char* text,
+                    OutputBuffer* reply, CompileStatus* status) {
+    (void)fd;
+    (void)phases;
+    (void)trace;
+    (void)text;
+    (void)reply;
+    (void)status;
+    return false;
+}
+
+void server_disconnect(int fd) {
+    (void)fd;
+}
+
+#endif
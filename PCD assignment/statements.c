@@ -0,0 +1,327 @@
+// Statement streams. An input of "x = expr;" and "expr;" statements is
+// lexed whole, cut at the semicolons outside parentheses, and the
+// statements are parsed and compiled to TAC on worker threads. Each worker
+// parses with its own thread-local lexer, stack, diagnostics and code
+// generator, and only reads the shared tables. The per-statement code is
+// merged in input order with the temporaries renumbered, so the listing
+// does not depend on the number of threads.
+#define _POSIX_C_SOURCE 200809L
+
+#include "compiler.h"
+#include "codegen.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define STATEMENT_MAX_THREADS 64
+
+// The expression text of a statement is input[start .. end), from its first
+// token up to the semicolon, so statement-local line 1 column 1 is that
+// token's position (base_line, base_column).
+typedef struct {
+    int start;
+    int end;
+    int base_line;
+    int base_column;
+    int target;         // span of the assigned variable, -1 for none
+    bool accepted;
+    int first_tac;      // its code is the worker's tac[first_tac .. + tac_count)
+    int tac_count;
+    int temp_count;
+    int tac_base;       // instruction and temporary numbers in the merged code
+    int temp_base;
+} Statement;
+
+typedef struct {
+    const char* name;
+    const char* input;
+    const TokenSpanList* spans;
+    bool pratt;
+    bool report;        // diagnostics are written, as at any trace but none
+    Statement* statements;
+    int first;          // statements[first .. last)
+    int last;
+    char* text;         // NUL-terminated copy of one statement
+    size_t text_cap;
+    ParseTree tree;
+    TAC* tac;
+    int tac_count;
+    int tac_cap;
+    OutputBuffer errors;
+    OutputBuffer code;
+    bool spawned;       // ran on a thread of its own
+    CompilerStats stats;
+    bool failed;
+} StatementWorker;
+
+// Diagnostics of the last parse, moved from statement-local to input
+// positions
+static void format_statement_errors(StatementWorker* w, const Statement* s) {
+    const DiagnosticList* list = get_diagnostics();
+    for (int i = 0; i < list->count; i++) {
+        const Diagnostic* d = &list->items[i];
+        int line = s->base_line + d->line - 1;
+        int column = d->line == 1 ? s->base_column + d->column - 1 : d->column;
+        outbuf_printf(&w->errors, "%s:%d:%d: error: %s\n", w->name, line, column, d->message);
+    }
+    if (list->total > list->count) {
+        outbuf_printf(&w->errors, "%s: %d more errors not shown\n", w->name, list->total - list->count);
+    }
+}
+
+static bool keep_tac(StatementWorker* w, const TAC* instr) {
+    if (w->tac_count == w->tac_cap) {
+        int cap = w->tac_cap ? w->tac_cap * 2 : 256;
+        TAC* grown = realloc(w->tac, (size_t)cap * sizeof(TAC));
+        if (grown == NULL) return false;
+        w->tac = grown;
+        w->tac_cap = cap;
+    }
+    w->tac[w->tac_count++] = *instr;
+    return true;
+}
+
+static bool compile_statement(StatementWorker* w, Statement* s) {
+    size_t len = (size_t)(s->end - s->start);
+    if (len + 1 > w->text_cap) {
+        char* grown = realloc(w->text, len + 1);
+        if (grown == NULL) return false;
+        w->text = grown;
+        w->text_cap = len + 1;
+    }
+    memcpy(w->text, w->input + s->start, len);
+    w->text[len] = '\0';
+    
+    s->first_tac = w->tac_count;
+    s->accepted = w->pratt ? parse_pratt_tree(w->text, &w->tree) : parse_lr_tree(w->text, &w->tree, NULL);
+    if (w->report) format_statement_errors(w, s);
+    if (!s->accepted) return true;
+    
+    if (!generate_code_from_tree(&w->tree)) {
+        outbuf_printf(&w->errors, "%s:%d:%d: no code generated\n", w->name, s->base_line, s->base_column);
+        s->accepted = false;
+        return true;
+    }
+    
+    const CodeGenerator* gen = get_code_generator();
+    for (int i = 0; i < gen->instr_count; i++) {
+        if (!keep_tac(w, &gen->instructions[i])) return false;
+    }
+    if (s->target >= 0) {
+        const TokenSpan* target = &w->spans->spans[s->target];
+        TAC assign;
+        memset(&assign, 0, sizeof(assign));
+        strcpy(assign.op, "=");
+        strcpy(assign.arg1, gen->instructions[gen->instr_count - 1].result);
+        snprintf(assign.result, sizeof(assign.result), "%.*s", target->length, w->input + target->offset);
+        if (!keep_tac(w, &assign)) return false;
+    }
+    s->tac_count = w->tac_count - s->first_tac;
+    s->temp_count = gen->temp_count;
+    return true;
+}
+
+static void* parse_statements(void* arg) {
+    StatementWorker* w = arg;
+    for (int i = w->first; i < w->last && !w->failed; i++) {
+        if (!compile_statement(w, &w->statements[i])) w->failed = true;
+    }
+    if (w->spawned) {
+        w->stats = compiler_stats;
+        if (w->pratt) free_pratt_stack();
+        else free_lr_stack();
+    }
+    return NULL;
+}
+
+// A temporary "%tN" of new_temp(), renumbered from `base`
+static const char* renumber(const char* name, int base, char* buffer, size_t size) {
+    if (!is_temp_name(name)) return name;
+    snprintf(buffer, size, "%%t%d", base + atoi(name + 2));
+    return buffer;
+}
+
+static void* format_statements(void* arg) {
+    StatementWorker* w = arg;
+    char result[24], arg1[24], arg2[24];
+    for (int i = w->first; i < w->last; i++) {
+        const Statement* s = &w->statements[i];
+        for (int k = 0; k < s->tac_count; k++) {
+            const TAC* instr = &w->tac[s->first_tac + k];
+            outbuf_printf(&w->code, "%d: %s = ", s->tac_base + k,
+                          renumber(instr->result, s->temp_base, result, sizeof(result)));
+            if (strcmp(instr->op, "=") == 0) {
+                outbuf_printf(&w->code, "%s\n", renumber(instr->arg1, s->temp_base, arg1, sizeof(arg1)));
+            } else {
+                outbuf_printf(&w->code, "%s %s %s\n", renumber(instr->arg1, s->temp_base, arg1, sizeof(arg1)),
+                              instr->op, renumber(instr->arg2, s->temp_base, arg2, sizeof(arg2)));
+            }
+        }
+    }
+    return NULL;
+}
+
+// Run `fn` on every worker, the first on the calling thread. A worker whose
+// thread cannot be started runs here too.
+static void run_workers(StatementWorker* workers, int count, void* (*fn)(void*)) {
+#ifndef _WIN32
+    pthread_t threads[STATEMENT_MAX_THREADS];
+    for (int i = 1; i < count; i++) {
+        workers[i].spawned = true;
+        if (pthread_create(&threads[i], NULL, fn, &workers[i]) != 0) workers[i].spawned = false;
+    }
+    fn(&workers[0]);
+    for (int i = 1; i < count; i++) {
+        if (workers[i].spawned) pthread_join(threads[i], NULL);
+        else fn(&workers[i]);
+    }
+#else
+    for (int i = 0; i < count; i++) fn(&workers[i]);
+#endif
+}
+
+// Cut the spans at the semicolons outside parentheses. Statements without
+// tokens are dropped. Returns the statement count, or -1 out of memory.
+static int split_statements(const TokenSpanList* spans, Statement** out) {
+    int cap = 64, count = 0;
+    Statement* list = malloc((size_t)cap * sizeof(Statement));
+    if (list == NULL) return -1;
+    
+    int depth = 0;
+    size_t first = 0;
+    for (size_t i = 0; i < spans->count; i++) {
+        const TokenSpan* span = &spans->spans[i];
+        if (span->type == TOKEN_LPAREN) depth++;
+        if (span->type == TOKEN_RPAREN) depth--;
+        if (span->type != TOKEN_EOF && (span->type != TOKEN_SEMICOLON || depth > 0)) continue;
+        
+        if (i > first) {
+            if (count == cap) {
+                cap *= 2;
+                Statement* grown = realloc(list, (size_t)cap * sizeof(Statement));
+                if (grown == NULL) {
+                    free(list);
+                    return -1;
+                }
+                list = grown;
+            }
+            
+            // "x = ..." assigns; the expression then starts after the '='
+            Statement* s = &list[count++];
+            memset(s, 0, sizeof(*s));
+            s->target = -1;
+            size_t expr = first;
+            if (i - first >= 2 && spans->spans[first].type == TOKEN_ID &&
+                spans->spans[first + 1].type == TOKEN_ASSIGN) {
+                s->target = (int)first;
+                expr = first + 2;
+            }
+            s->start = (int)spans->spans[expr].offset;
+            s->end = (int)span->offset;
+            s->base_line = spans->spans[expr].line;
+            s->base_column = spans->spans[expr].column;
+        }
+        first = i + 1;
+        depth = 0;
+    }
+    
+    *out = list;
+    return count;
+}
+
+// Compile `text` as a stream of statements on up to `threads` threads (0
+// for one per CPU; Windows builds use the calling thread). Code comes from
+// the Pratt parser when COMPILE_PRATT is set, whose table must already be
+// built, and from the LR parser otherwise, whose table is completed here
+// and so must not be lazy. The TAC listing is written when every statement
+// is accepted and COMPILE_TAC is set.
+CompileStatus compile_statements(const char* name, const char* text, int phases, CompileTrace trace,
+                                 int threads, OutputBuffer* out) {
+    bool pratt = (phases & COMPILE_PRATT) != 0;
+    if (!pratt && !construct_lr_table()) return COMPILE_ERROR;
+    if (name == NULL) name = "<input>";
+    
+    TokenSpanList spans;
+    span_list_init(&spans);
+    Statement* statements = NULL;
+    int count = lex_all_tokens(text, threads, &spans) ? split_statements(&spans, &statements) : -1;
+    if (count < 0) {
+        span_list_free(&spans);
+        return COMPILE_ERROR;
+    }
+
+#ifndef _WIN32
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    threads = 1;
+#endif
+    if (threads > count) threads = count;
+    if (threads > STATEMENT_MAX_THREADS) threads = STATEMENT_MAX_THREADS;
+    if (threads < 1) threads = 1;
+    
+    // Contiguous runs of statements with about the same number of tokens
+    StatementWorker workers[STATEMENT_MAX_THREADS];
+    size_t tokens = spans.count;
+    int next = 0;
+    for (int i = 0; i < threads; i++) {
+        StatementWorker* w = &workers[i];
+        memset(w, 0, sizeof(*w));
+        w->name = name;
+        w->input = text;
+        w->spans = &spans;
+        w->pratt = pratt;
+        w->report = trace != COMPILE_TRACE_NONE;
+        w->statements = statements;
+        parse_tree_init(&w->tree);
+        outbuf_init(&w->errors);
+        outbuf_init(&w->code);
+        
+        size_t goal = tokens * (size_t)(i + 1) / (size_t)threads;
+        w->first = next;
+        while (next < count && (i == threads - 1 || (size_t)statements[next].end < spans.spans[goal - 1].offset)) {
+            next++;
+        }
+        w->last = next;
+    }
+    
+    run_workers(workers, threads, parse_statements);
+    
+    CompileStatus status = COMPILE_OK;
+    int instructions = 0, temps = 0, rejected = 0;
+    for (int i = 0; i < threads; i++) {
+        if (workers[i].failed) status = COMPILE_ERROR;
+        if (workers[i].spawned) add_compiler_stats(&workers[i].stats);
+        outbuf_write(out, workers[i].errors.data, workers[i].errors.len);
+    }
+    for (int i = 0; i < count; i++) {
+        if (!statements[i].accepted) rejected++;
+        statements[i].tac_base = instructions;
+        statements[i].temp_base = temps;
+        instructions += statements[i].tac_count;
+        temps += statements[i].temp_count;
+    }
+    if (status == COMPILE_OK && rejected > 0) status = COMPILE_REJECTED;
+    
+    if (trace != COMPILE_TRACE_NONE) {
+        outbuf_printf(out, "%s: %d statements, %d rejected: %s %s\n", name, count, rejected,
+                      pratt ? "Pratt" : "LR", status == COMPILE_OK ? "ACCEPTED" : "REJECTED");
+    }
+    if (status == COMPILE_OK && (phases & COMPILE_TAC)) {
+        run_workers(workers, threads, format_statements);
+        outbuf_puts(out, "\n=== THREE-ADDRESS CODE ===\n");
+        for (int i = 0; i < threads; i++) outbuf_write(out, workers[i].code.data, workers[i].code.len);
+    }
+    
+    for (int i = 0; i < threads; i++) {
+        parse_tree_free(&workers[i].tree);
+        outbuf_free(&workers[i].errors);
+        outbuf_free(&workers[i].code);
+        free(workers[i].text);
+        free(workers[i].tac);
+    }
+    free(statements);
+    span_list_free(&spans);
+    return status;
+}
@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "compiler.h"
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+_Thread_local CompilerStats compiler_stats;
+
+static const char* phase_names[PHASE_COUNT] = {
+    "Lexical analysis",
+    "FIRST sets",
+    "FOLLOW sets",
+    "LL table",
+    "LR table",
+    "LL parse",
+    "LR parse",
+    "GLR parse",
+    "Pratt parse",
+    "TAC generation",
+    "Assembly output"
+};
+
+void reset_compiler_stats() {
+    memset(&compiler_stats, 0, sizeof(compiler_stats));
+}
+
+const CompilerStats* get_compiler_stats() {
+    return &compiler_stats;
+}
+
+// Fold another thread's counters into this thread's. Phase times add up,
+// so across concurrent threads they are CPU time rather than wall time.
+void add_compiler_stats(const CompilerStats* other) {
+    CompilerStats* s = &compiler_stats;
+    s->tokens += other->tokens;
+    s->bytes_scanned += other->bytes_scanned;
+    s->first_iterations += other->first_iterations;
+    s->follow_iterations += other->follow_iterations;
+    s->ll_lookups += other->ll_lookups;
+    s->expansions += other->expansions;
+    s->matches += other->matches;
+    if (other->ll_max_depth > s->ll_max_depth) s->ll_max_depth = other->ll_max_depth;
+    s->lr_lookups += other->lr_lookups;
+    s->shifts += other->shifts;
+    s->reduces += other->reduces;
+    if (other->lr_max_depth > s->lr_max_depth) s->lr_max_depth = other->lr_max_depth;
+    s->pratt_reduces += other->pratt_reduces;
+    if (other->pratt_max_depth > s->pratt_max_depth) s->pratt_max_depth = other->pratt_max_depth;
+    s->tac_emitted += other->tac_emitted;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        s->phase_ns[p] += other->phase_ns[p];
+        s->phase_cycles[p] += other->phase_cycles[p];
+        s->phase_calls[p] += other->phase_calls[p];
+    }
+}
+
+const char* phase_name(CompilerPhase phase) {
+    return phase >= 0 && phase < PHASE_COUNT ? phase_names[phase] : "?";
+}
+
+uint64_t stats_now_ns() {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Time-stamp counter where the CPU has one; 0 elsewhere
+uint64_t stats_now_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+PhaseTimer phase_begin() {
+    PhaseTimer timer = { stats_now_ns(), stats_now_cycles() };
+    return timer;
+}
+
+void phase_end(CompilerPhase phase, PhaseTimer timer) {
+    compiler_stats.phase_ns[phase] += stats_now_ns() - timer.ns;
+    compiler_stats.phase_cycles[phase] += stats_now_cycles() - timer.cycles;
+    compiler_stats.phase_calls[phase]++;
+}
+
+void print_compiler_stats() {
+    const CompilerStats* s = &compiler_stats;
+    
+    printf("\n=== PERFORMANCE COUNTERS ===\n");
+    printf("%-32s %llu\n", "Tokens produced", (unsigned long long)s->tokens);
+    printf("%-32s %llu\n", "Bytes scanned", (unsigned long long)s->bytes_scanned);
+    printf("%-32s %llu\n", "FIRST fixpoint iterations", (unsigned long long)s->first_iterations);
+    printf("%-32s %llu\n", "FOLLOW fixpoint iterations", (unsigned long long)s->follow_iterations);
+    printf("%-32s %llu\n", "LL table lookups", (unsigned long long)s->ll_lookups);
+    printf("%-32s %llu\n", "LL expansions", (unsigned long long)s->expansions);
+    printf("%-32s %llu\n", "LL matches", (unsigned long long)s->matches);
+    printf("%-32s %d\n", "LL max stack depth", s->ll_max_depth);
+    printf("%-32s %llu\n", "LR table lookups", (unsigned long long)s->lr_lookups);
+    printf("%-32s %llu\n", "LR shifts", (unsigned long long)s->shifts);
+    printf("%-32s %llu\n", "LR reduces", (unsigned long long)s->reduces);
+    printf("%-32s %d\n", "LR max stack depth", s->lr_max_depth);
+    printf("%-32s %llu\n", "Pratt operator reductions", (unsigned long long)s->pratt_reduces);
+    printf("%-32s %d\n", "Pratt max stack depth", s->pratt_max_depth);
+    printf("%-32s %llu\n", "TAC instructions emitted", (unsigned long long)s->tac_emitted);
+    
+    printf("\n%-20s %8s %14s %16s\n", "PHASE", "CALLS", "TIME (us)", "CYCLES");
+    printf("---------------------------------------------------------------\n");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (s->phase_calls[p] == 0) continue;
+        printf("%-20s %8llu %14.1f %16llu\n", phase_names[p],
+               (unsigned long long)s->phase_calls[p], (double)s->phase_ns[p] / 1000.0,
+               (unsigned long long)s->phase_cycles[p]);
+    }
+}
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Build the console compiler (Linux) and check --statements output.
+# Source variables named t0, t1, ... must survive the per-statement
+# renumbering of the generator's %t temporaries, on any thread count, and
+# syntax errors must point at the offending token's line and column.
+cd "$(dirname "$0")" || exit 1
+gcc -Wall -std=c11 -O2 -pthread -o compiler main.c lexer.c ll_parser.c lr_parser.c pratt_parser.c utils.c parse_tree.c trace.c diagnostics.c grammar_gen.c grammar_transform.c stats.c pipeline.c statements.c cache.c cli.c server.c codegen.c x86_encoder.c elf_writer.c || exit 1
+
+status=0
+
+# check NAME EXPECTED COMMAND...: the command's standard output must be EXPECTED
+check() {
+    name=$1
+    expected=$2
+    shift 2
+    actual=$("$@")
+    if [ "$actual" = "$expected" ]; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        printf '%s\n' "$actual"
+        status=1
+    fi
+}
+
+input="t0 = a + b; t1 = t0 * 2; c = a * b + t1; t2 = t1 + t0 * c;"
+expected="
+=== THREE-ADDRESS CODE ===
+0: %t0 = a + b
+1: t0 = %t0
+2: %t1 = t0 * 2
+3: t1 = %t1
+4: %t2 = a * b
+5: %t3 = %t2 + t1
+6: c = %t3
+7: %t4 = t0 * c
+8: %t5 = t1 + %t4
+9: t2 = %t5"
+for threads in 1 2 4; do
+    check "statements, $threads threads" "$expected" \
+        ./compiler --statements --threads $threads -p lr,tac -t none -e "$input"
+done
+
+# Errors on later lines of a statement, after runs of blanks and newlines
+input="x = a + b;
+y =
+   c *
+
+      * d;
+  z = (a + ) ;"
+expected="<expr>:5:7: error: unexpected '*'; expected 'id' or '('
+<expr>:6:12: error: unexpected ')'; expected 'id' or '('
+<expr>: 3 statements, 2 rejected: LR REJECTED"
+for threads in 1 2 4; do
+    check "statement error positions, $threads threads" "$expected" \
+        ./compiler --statements --threads $threads -p lr,tac -e "$input"
+done
+
+expected="<expr>:3:7: error: unexpected '*'; expected 'id' or '('
+<expr>: LR REJECTED"
+check "error position" "$expected" ./compiler -p lr -e "a +
+
+      * b"
+
+exit $status
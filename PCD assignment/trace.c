@@ -0,0 +1,266 @@
+#include "compiler.h"
+
+static void trace_log_emit(TraceSink* sink, const TraceEvent* event) {
+    TraceLog* log = (TraceLog*)sink;
+    if (log->failed) return;
+    
+    if (log->count == log->cap) {
+        int new_cap = log->cap ? log->cap * 2 : 256;
+        TraceEvent* grown = realloc(log->events, (size_t)new_cap * sizeof(TraceEvent));
+        if (grown == NULL) {
+            log->failed = true;
+            return;
+        }
+        log->events = grown;
+        log->cap = new_cap;
+    }
+    log->events[log->count++] = *event;
+}
+
+void trace_log_init(TraceLog* log) {
+    memset(log, 0, sizeof(*log));
+    log->sink.emit = trace_log_emit;
+}
+
+void trace_log_reset(TraceLog* log) {
+    log->count = 0;
+    log->failed = false;
+}
+
+void trace_log_free(TraceLog* log) {
+    free(log->events);
+    trace_log_init(log);
+}
+
+// Lexemes of the input, indexed by the `token` field of the events
+typedef struct {
+    Token* tokens;
+    int count;
+} TokenList;
+
+static bool lex_all(const char* input, TokenList* list) {
+    int cap = 64;
+    list->count = 0;
+    list->tokens = malloc((size_t)cap * sizeof(Token));
+    if (list->tokens == NULL) return false;
+    
+    // Re-lexing for display is not part of the compilation being measured
+    uint64_t tokens = compiler_stats.tokens;
+    uint64_t bytes_scanned = compiler_stats.bytes_scanned;
+    bool ok = true;
+    
+    init_lexer(input);
+    while (true) {
+        if (list->count == cap) {
+            cap *= 2;
+            Token* grown = realloc(list->tokens, (size_t)cap * sizeof(Token));
+            if (grown == NULL) {
+                ok = false;
+                break;
+            }
+            list->tokens = grown;
+        }
+        Token token = get_next_token();
+        list->tokens[list->count++] = token;
+        if (token.type == TOKEN_EOF) break;
+    }
+    
+    compiler_stats.tokens = tokens;
+    compiler_stats.bytes_scanned = bytes_scanned;
+    return ok;
+}
+
+static const char* lexeme_at(const TokenList* list, int index) {
+    if (index >= 0 && index < list->count) return list->tokens[index].lexeme;
+    return "$";
+}
+
+static bool is_epsilon_production(const Production* prod) {
+    return prod->rhs_count == 1 && strcmp(prod->rhs[0], "ε") == 0;
+}
+
+static void format_production(OutputBuffer* out, const Production* prod) {
+    outbuf_printf(out, "%s ->", prod->lhs);
+    for (int i = 0; i < prod->rhs_count; i++) {
+        outbuf_printf(out, " %s", prod->rhs[i]);
+    }
+}
+
+static void format_error(OutputBuffer* out, const TraceEvent* e, Grammar* g, const char* lexeme) {
+    switch (e->error) {
+        case TRACE_ERROR_MISMATCH:
+            outbuf_printf(out, "ERROR: Expected %s but got %s\n", symbol_name(e->symbol, g), lexeme);
+            break;
+        case TRACE_ERROR_NO_PRODUCTION:
+            outbuf_printf(out, "ERROR: No production for [%s, %s]\n", symbol_name(e->symbol, g), lexeme);
+            break;
+        case TRACE_ERROR_NO_GOTO:
+            outbuf_puts(out, "ERROR: No GOTO entry\n");
+            break;
+        case TRACE_ERROR_OVERFLOW:
+            outbuf_puts(out, "ERROR: Parse stack overflow\n");
+            break;
+        case TRACE_ERROR_LEFT_RECURSION:
+            outbuf_printf(out, "ERROR: Left recursion: %s on %s never consumes input\n", symbol_name(e->symbol, g), lexeme);
+            break;
+        case TRACE_ERROR_STACK_EMPTY:
+            outbuf_puts(out, "ERROR: Stack empty but input remaining\n");
+            break;
+        default:
+            if (e->parser == TRACE_LL) outbuf_puts(out, "ERROR: Unexpected input\n");
+            else outbuf_printf(out, "ERROR: Unexpected %s\n", lexeme);
+            break;
+    }
+}
+
+// Replay an LL trace: the symbol stack is rebuilt from the expansions and
+// matches, so the parser itself never formats it
+static void format_ll_trace(OutputBuffer* out, const TraceLog* log, Grammar* g, const TokenList* tokens) {
+    ParseStack stack = { 0 };
+    int top = 0;
+    if (!parse_stack_reserve(&stack, 2)) return;
+    stack.ids[top++] = symbol_id("$", g);
+    stack.ids[top++] = symbol_id(g->start_symbol, g);
+    
+    outbuf_puts(out, "\n=== LL PARSING ===\n");
+    outbuf_printf(out, "%-30s %-30s %-30s\n", "STACK", "INPUT", "ACTION");
+    outbuf_puts(out, "--------------------------------------------------------------------------------------\n");
+    
+    for (int i = 0; i < log->count; i++) {
+        const TraceEvent* e = &log->events[i];
+        const char* lexeme = lexeme_at(tokens, e->token);
+        
+        outbuf_printf(out, "%-30s", "");
+        for (int j = top - 1; j >= 0; j--) {
+            outbuf_printf(out, "%s ", symbol_name(stack.ids[j], g));
+        }
+        outbuf_printf(out, "\t%-30s", lexeme);
+        
+        switch (e->action) {
+            case TRACE_MATCH:
+                outbuf_printf(out, "MATCH %s\n", symbol_name(e->symbol, g));
+                if (top > 0) top--;
+                break;
+            
+            case TRACE_EXPAND: {
+                const Production* prod = &g->productions[e->production];
+                outbuf_puts(out, "Use ");
+                format_production(out, prod);
+                outbuf_puts(out, "\n");
+                
+                if (top > 0) top--;
+                if (!is_epsilon_production(prod) && parse_stack_reserve(&stack, top + prod->rhs_count)) {
+                    for (int j = prod->rhs_count - 1; j >= 0; j--) {
+                        stack.ids[top++] = symbol_id(prod->rhs[j], g);
+                    }
+                }
+                break;
+            }
+            
+            case TRACE_RECOVER:
+                if (e->symbol >= 0) outbuf_printf(out, "RECOVER: pop %s\n", symbol_name(e->symbol, g));
+                else outbuf_printf(out, "RECOVER: skip %s\n", lexeme);
+                if (e->depth < top) top = e->depth;
+                break;
+            
+            case TRACE_ACCEPT:
+                outbuf_puts(out, "ACCEPT\n");
+                break;
+            
+            default:
+                format_error(out, e, g, lexeme);
+                break;
+        }
+    }
+    parse_stack_free(&stack);
+}
+
+// Replay an LR trace. Only grammar symbols are shown on the stack, as in a
+// textbook trace; the states are in the events for consumers that want them.
+static void format_lr_trace(OutputBuffer* out, const TraceLog* log, Grammar* g, const TokenList* tokens) {
+    ParseStack stack = { 0 };
+    int top = 0;
+    
+    outbuf_puts(out, "\n=== LR PARSING (SLR) ===\n");
+    outbuf_printf(out, "%-40s %-20s %-30s\n", "STACK", "INPUT", "ACTION");
+    outbuf_puts(out, "--------------------------------------------------------------------------------------\n");
+    
+    for (int i = 0; i < log->count; i++) {
+        const TraceEvent* e = &log->events[i];
+        const char* lexeme = lexeme_at(tokens, e->token);
+        
+        outbuf_printf(out, "%-40s$ ", "");
+        for (int j = 0; j < top; j++) {
+            outbuf_printf(out, "%s ", symbol_name(stack.ids[j], g));
+        }
+        outbuf_printf(out, "\t%-20s\t", lexeme);
+        
+        switch (e->action) {
+            case TRACE_SHIFT:
+                outbuf_printf(out, "SHIFT %s\n", lexeme);
+                if (parse_stack_reserve(&stack, top + 1)) stack.ids[top++] = e->symbol;
+                break;
+            
+            case TRACE_REDUCE: {
+                const Production* prod = &g->productions[e->production];
+                outbuf_puts(out, "REDUCE by ");
+                format_production(out, prod);
+                outbuf_puts(out, "\n");
+                
+                int len = is_epsilon_production(prod) ? 0 : prod->rhs_count;
+                top = top > len ? top - len : 0;
+                if (parse_stack_reserve(&stack, top + 1)) stack.ids[top++] = e->symbol;
+                break;
+            }
+            
+            case TRACE_RECOVER:
+                if (e->symbol < 0) {
+                    outbuf_printf(out, "RECOVER: skip %s\n", lexeme);
+                    break;
+                }
+                // The stack was cut back to depth - 1 states, i.e. depth - 2
+                // symbols, and the non-terminal pushed
+                outbuf_printf(out, "RECOVER: resume after %s\n", symbol_name(e->symbol, g));
+                if (e->depth - 2 < top) top = e->depth > 2 ? e->depth - 2 : 0;
+                if (parse_stack_reserve(&stack, top + 1)) stack.ids[top++] = e->symbol;
+                break;
+            
+            case TRACE_ACCEPT:
+                outbuf_puts(out, "ACCEPT\n");
+                break;
+            
+            default:
+                format_error(out, e, g, lexeme);
+                break;
+        }
+    }
+    parse_stack_free(&stack);
+}
+
+// Pretty-print a recorded trace as the classic STACK / INPUT / ACTION
+// table. `input` is re-lexed to recover the lexemes, so this must not run
+// while a parse is in progress.
+void format_parse_trace(OutputBuffer* out, const TraceLog* log, Grammar* g, const char* input) {
+    if (log->count == 0) return;
+    
+    TokenList tokens = { NULL, 0 };
+    if (!lex_all(input, &tokens)) tokens.count = 0;
+    
+    if (log->events[0].parser == TRACE_LL) {
+        format_ll_trace(out, log, g, &tokens);
+    } else {
+        format_lr_trace(out, log, g, &tokens);
+    }
+    if (log->failed) outbuf_puts(out, "(trace truncated: out of memory)\n");
+    
+    free(tokens.tokens);
+}
+
+void print_parse_trace(const TraceLog* log, Grammar* g, const char* input) {
+    OutputBuffer out;
+    fflush(stdout);
+    outbuf_init_file(&out, stdout);
+    format_parse_trace(&out, log, g, input);
+    outbuf_flush(&out);
+    outbuf_free(&out);
+}
@@ -1,4 +1,13 @@
+#define _POSIX_C_SOURCE 200809L
 #include "compiler.h"
+#include <stdarg.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
 
 bool is_terminal(const char* symbol, Grammar* g) {
     for (int i = 0; i < g->terminal_count; i++) {
@@ -18,6 +27,41 @@ bool is_non_terminal(const char* symbol, Grammar* g) {
     return false;
 }
 
+// Symbol ids: terminals first, then non-terminals
+int symbol_id(const char* symbol, Grammar* g) {
+    for (int i = 0; i < g->terminal_count; i++) {
+        if (strcmp(g->terminals[i], symbol) == 0) return i;
+    }
+    for (int i = 0; i < g->non_terminal_count; i++) {
+        if (strcmp(g->non_terminals[i], symbol) == 0) return g->terminal_count + i;
+    }
+    return -1;
+}
+
+const char* symbol_name(int id, Grammar* g) {
+    if (id >= 0 && id < g->terminal_count) return g->terminals[id];
+    id -= g->terminal_count;
+    if (id >= 0 && id < g->non_terminal_count) return g->non_terminals[id];
+    return "?";
+}
+
+// Grammar terminal matched by a token: the lexeme itself when the grammar
+// names it, otherwise "id" for identifiers and numbers
+const char* terminal_for_token(const Token* token, Grammar* g) {
+    if (token->type == TOKEN_EOF) return "$";
+    if (is_terminal(token->lexeme, g)) return token->lexeme;
+    if ((token->type == TOKEN_ID || token->type == TOKEN_NUMBER) && is_terminal("id", g)) return "id";
+    return token->lexeme;
+}
+
+// Declared precedence of `terminal`, or NULL
+const PrecedenceDecl* find_precedence(const Grammar* g, const char* terminal) {
+    for (int i = 0; i < g->precedence_count; i++) {
+        if (strcmp(g->precedence[i].terminal, terminal) == 0) return &g->precedence[i];
+    }
+    return NULL;
+}
+
 void print_grammar(Grammar* g) {
     printf("\n=== GRAMMAR ===\n");
     printf("Start Symbol: %s\n\n", g->start_symbol);
@@ -44,12 +88,24 @@ void print_grammar(Grammar* g) {
         if (i < g->non_terminal_count - 1) printf(", ");
     }
     printf(" }\n");
+    
+    if (g->precedence_count > 0) {
+        static const char* names[] = { "%left", "%right", "%nonassoc" };
+        printf("\nPrecedence (loosest first):");
+        for (int i = 0; i < g->precedence_count; i++) {
+            const PrecedenceDecl* d = &g->precedence[i];
+            if (i == 0 || d->level != g->precedence[i - 1].level) printf("\n%s", names[d->assoc]);
+            printf(" %s", d->terminal);
+        }
+        printf("\n");
+    }
 }
 
 void load_sample_grammar(Grammar* g, int choice) {
     g->prod_count = 0;
     g->terminal_count = 0;
     g->non_terminal_count = 0;
+    g->precedence_count = 0;
     
     switch (choice) {
         case 1: {
@@ -244,3 +300,425 @@ void load_sample_grammar(Grammar* g, int choice) {
             break;
     }
 }
+
+// 64-bit FNV-1a; pass the previous result as `hash` to continue a hash
+// over several pieces, or FNV_OFFSET_BASIS to start one
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t n) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < n; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t hash_string(uint64_t hash, const char* s) {
+    // The terminator is included so "ab" + "c" and "a" + "bc" differ
+    return hash_bytes(hash, s, strlen(s) + 1);
+}
+
+// Hash of everything that determines how the grammar parses: start symbol,
+// symbol order (which fixes table layout), productions and precedence
+uint64_t grammar_hash(const Grammar* g) {
+    uint64_t hash = hash_string(FNV_OFFSET_BASIS, g->start_symbol);
+    for (int i = 0; i < g->terminal_count; i++) hash = hash_string(hash, g->terminals[i]);
+    hash = hash_bytes(hash, "|", 1);
+    for (int i = 0; i < g->non_terminal_count; i++) hash = hash_string(hash, g->non_terminals[i]);
+    for (int i = 0; i < g->prod_count; i++) {
+        const Production* prod = &g->productions[i];
+        hash = hash_bytes(hash, "\n", 1);
+        hash = hash_string(hash, prod->lhs);
+        for (int j = 0; j < prod->rhs_count; j++) hash = hash_string(hash, prod->rhs[j]);
+    }
+    for (int i = 0; i < g->precedence_count; i++) {
+        const PrecedenceDecl* d = &g->precedence[i];
+        int level_assoc[2] = { d->level, (int)d->assoc };
+        hash = hash_string(hash, d->terminal);
+        hash = hash_bytes(hash, level_assoc, sizeof(level_assoc));
+    }
+    return hash;
+}
+
+// Read a whole file into a NUL-terminated heap buffer
+char* read_text_file(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    
+    size_t len = 0;
+    size_t cap = 4096;
+    char* text = malloc(cap);
+    while (text != NULL) {
+        if (len + 1 == cap) {
+            char* grown = realloc(text, cap * 2);
+            if (grown == NULL) {
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
+            cap *= 2;
+        }
+        size_t n = fread(text + len, 1, cap - len - 1, file);
+        len += n;
+        if (n == 0) break;
+    }
+    
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (text == NULL || failed) {
+        free(text);
+        return NULL;
+    }
+    text[len] = '\0';
+    if (length) *length = len;
+    return text;
+}
+
+static bool add_symbol(char names[][MAX_TOKEN_LEN], int* count, const char* name) {
+    for (int i = 0; i < *count; i++) {
+        if (strcmp(names[i], name) == 0) return true;
+    }
+    if (*count == MAX_SYMBOLS) return false;
+    strcpy(names[(*count)++], name);
+    return true;
+}
+
+// Split off the next whitespace-separated word of a line, NULL at the end
+static char* next_word(char** cursor) {
+    char* p = *cursor;
+    while (*p != '\0' && isspace((unsigned char)*p)) p++;
+    if (*p == '\0') return NULL;
+    
+    char* word = p;
+    while (*p != '\0' && !isspace((unsigned char)*p)) p++;
+    if (*p != '\0') *p++ = '\0';
+    *cursor = p;
+    return word;
+}
+
+// Parse a "%left a b", "%right ..." or "%nonassoc ..." line into one new
+// precedence level
+static bool parse_precedence_line(Grammar* g, const char* keyword, char* cursor, char* error, size_t error_size) {
+    Associativity assoc;
+    if (strcmp(keyword, "%left") == 0) assoc = ASSOC_LEFT;
+    else if (strcmp(keyword, "%right") == 0) assoc = ASSOC_RIGHT;
+    else if (strcmp(keyword, "%nonassoc") == 0) assoc = ASSOC_NONASSOC;
+    else {
+        snprintf(error, error_size, "unknown declaration %s", keyword);
+        return false;
+    }
+    
+    int level = g->precedence_count > 0 ? g->precedence[g->precedence_count - 1].level + 1 : 1;
+    int count = 0;
+    const char* word;
+    while ((word = next_word(&cursor)) != NULL) {
+        if (find_precedence(g, word) != NULL) {
+            snprintf(error, error_size, "precedence of '%s' declared twice", word);
+            return false;
+        }
+        if (g->precedence_count == MAX_SYMBOLS || strlen(word) >= MAX_TOKEN_LEN) {
+            snprintf(error, error_size, "too many precedence declarations (max %d)", MAX_SYMBOLS);
+            return false;
+        }
+        PrecedenceDecl* d = &g->precedence[g->precedence_count++];
+        strcpy(d->terminal, word);
+        d->level = level;
+        d->assoc = assoc;
+        count++;
+    }
+    if (count == 0) {
+        snprintf(error, error_size, "%s needs at least one terminal", keyword);
+        return false;
+    }
+    return true;
+}
+
+// Parse one "A -> x y | z" rule, or a precedence declaration, into `g`
+static bool parse_grammar_rule(Grammar* g, char* line, char* error, size_t error_size) {
+    char* cursor = line;
+    char* lhs = next_word(&cursor);
+    if (lhs == NULL) return true;
+    if (lhs[0] == '%') return parse_precedence_line(g, lhs, cursor, error, error_size);
+    
+    char* arrow = next_word(&cursor);
+    if (arrow == NULL || strcmp(arrow, "->") != 0 || strcmp(lhs, "->") == 0) {
+        snprintf(error, error_size, "expected \"A -> ...\"");
+        return false;
+    }
+    if (strlen(lhs) >= MAX_TOKEN_LEN || !add_symbol(g->non_terminals, &g->non_terminal_count, lhs)) {
+        snprintf(error, error_size, "too many non-terminals (max %d)", MAX_SYMBOLS);
+        return false;
+    }
+    if (g->start_symbol[0] == '\0') strcpy(g->start_symbol, lhs);
+    
+    // Alternatives separated by "|"; an empty alternative means ε
+    while (true) {
+        if (g->prod_count == MAX_PRODUCTIONS) {
+            snprintf(error, error_size, "too many productions (max %d)", MAX_PRODUCTIONS);
+            return false;
+        }
+        Production* prod = &g->productions[g->prod_count++];
+        strcpy(prod->lhs, lhs);
+        prod->rhs_count = 0;
+        
+        const char* word;
+        while ((word = next_word(&cursor)) != NULL && strcmp(word, "|") != 0) {
+            if (strcmp(word, "eps") == 0) word = "ε";
+            if (prod->rhs_count == MAX_PRODUCTIONS || strlen(word) >= MAX_TOKEN_LEN) {
+                snprintf(error, error_size, "alternative too long");
+                return false;
+            }
+            strcpy(prod->rhs[prod->rhs_count++], word);
+        }
+        if (prod->rhs_count == 0) strcpy(prod->rhs[prod->rhs_count++], "ε");
+        if (word == NULL) return true;
+    }
+}
+
+// Load a grammar written one rule per line as "A -> x y | z". Symbols are
+// separated by whitespace, "ε" or "eps" is the empty string and "#" starts
+// a comment. Every symbol that appears on a left-hand side is a
+// non-terminal, everything else a terminal; the first rule names the start
+// symbol. Lines "%left ...", "%right ..." and "%nonassoc ..." declare
+// operator precedence, loosest first. On failure a message with the line
+// number is left in `error`.
+bool load_grammar_file(Grammar* g, const char* path, char* error, size_t error_size) {
+    char* text = read_text_file(path, NULL);
+    if (text == NULL) {
+        snprintf(error, error_size, "%s: cannot read file", path);
+        return false;
+    }
+    
+    g->prod_count = 0;
+    g->terminal_count = 0;
+    g->non_terminal_count = 0;
+    g->precedence_count = 0;
+    g->start_symbol[0] = '\0';
+    
+    char message[128];
+    int line_no = 1;
+    for (char* line = text; line != NULL; line_no++) {
+        char* end = strchr(line, '\n');
+        if (end) *end = '\0';
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        
+        if (!parse_grammar_rule(g, line, message, sizeof(message))) {
+            snprintf(error, error_size, "%s:%d: %s", path, line_no, message);
+            free(text);
+            return false;
+        }
+        line = end ? end + 1 : NULL;
+    }
+    free(text);
+    
+    if (g->prod_count == 0) {
+        snprintf(error, error_size, "%s: no productions", path);
+        return false;
+    }
+    
+    // Everything not defined by a rule is a terminal
+    for (int i = 0; i < g->prod_count; i++) {
+        for (int j = 0; j < g->productions[i].rhs_count; j++) {
+            const char* symbol = g->productions[i].rhs[j];
+            if (strcmp(symbol, "ε") == 0 || is_non_terminal(symbol, g)) continue;
+            if (!add_symbol(g->terminals, &g->terminal_count, symbol)) {
+                snprintf(error, error_size, "%s: too many terminals (max %d)", path, MAX_SYMBOLS);
+                return false;
+            }
+        }
+    }
+    if (!add_symbol(g->terminals, &g->terminal_count, "$")) {
+        snprintf(error, error_size, "%s: too many terminals (max %d)", path, MAX_SYMBOLS);
+        return false;
+    }
+    for (int i = 0; i < g->precedence_count; i++) {
+        if (!is_terminal(g->precedence[i].terminal, g) || strcmp(g->precedence[i].terminal, "$") == 0) {
+            snprintf(error, error_size, "%s: precedence declared for '%s', which is not a terminal",
+                     path, g->precedence[i].terminal);
+            return false;
+        }
+    }
+    return true;
+}
+
+void outbuf_init(OutputBuffer* ob) {
+    ob->data = NULL;
+    ob->len = 0;
+    ob->cap = 0;
+    ob->file = NULL;
+    ob->fd = -1;
+    ob->failed = false;
+}
+
+void outbuf_init_file(OutputBuffer* ob, FILE* file) {
+    outbuf_init(ob);
+    ob->file = file;
+}
+
+void outbuf_init_fd(OutputBuffer* ob, int fd) {
+    outbuf_init(ob);
+    ob->fd = fd;
+}
+
+void outbuf_reset(OutputBuffer* ob) {
+    ob->len = 0;
+    ob->failed = false;
+    if (ob->data) ob->data[0] = '\0';
+}
+
+void outbuf_free(OutputBuffer* ob) {
+    free(ob->data);
+    ob->data = NULL;
+    ob->len = 0;
+    ob->cap = 0;
+}
+
+static inline bool outbuf_has_sink(const OutputBuffer* ob) {
+    return ob->file != NULL || ob->fd >= 0;
+}
+
+// Make room for `extra` more bytes plus the terminating NUL, doubling the
+// capacity so that a sequence of appends costs amortized O(1) per byte.
+static bool outbuf_reserve(OutputBuffer* ob, size_t extra) {
+    size_t needed = ob->len + extra + 1;
+    if (needed <= ob->cap) return true;
+    
+    size_t new_cap = ob->cap ? ob->cap : OUTBUF_INITIAL_CAPACITY;
+    while (new_cap < needed) new_cap *= 2;
+    
+    char* data = realloc(ob->data, new_cap);
+    if (data == NULL) {
+        ob->failed = true;
+        return false;
+    }
+    ob->data = data;
+    ob->cap = new_cap;
+    return true;
+}
+
+#ifndef _WIN32
+static bool write_all_iov(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) return false;
+        
+        // Skip fully written segments, then advance into a partial one
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return true;
+}
+#endif
+
+// Send the pending bytes followed by an optional extra block to the sink in
+// one batch. On POSIX both segments go out in a single writev call, so large
+// blocks never have to be copied into the buffer first.
+static bool outbuf_drain(OutputBuffer* ob, const char* extra, size_t extra_len) {
+    bool ok = true;
+    
+    if (ob->file) {
+        if (ob->len > 0 && fwrite(ob->data, 1, ob->len, ob->file) != ob->len) ok = false;
+        if (extra_len > 0 && fwrite(extra, 1, extra_len, ob->file) != extra_len) ok = false;
+    } else if (ob->fd >= 0) {
+#ifdef _WIN32
+        if (ob->len > 0 && _write(ob->fd, ob->data, (unsigned)ob->len) != (int)ob->len) ok = false;
+        if (extra_len > 0 && _write(ob->fd, extra, (unsigned)extra_len) != (int)extra_len) ok = false;
+#else
+        struct iovec iov[2];
+        int count = 0;
+        if (ob->len > 0) {
+            iov[count].iov_base = ob->data;
+            iov[count].iov_len = ob->len;
+            count++;
+        }
+        if (extra_len > 0) {
+            iov[count].iov_base = (void*)extra;
+            iov[count].iov_len = extra_len;
+            count++;
+        }
+        ok = write_all_iov(ob->fd, iov, count);
+#endif
+    }
+    
+    if (!ok) ob->failed = true;
+    ob->len = 0;
+    if (ob->data) ob->data[0] = '\0';
+    return ok;
+}
+
+void outbuf_write(OutputBuffer* ob, const char* data, size_t n) {
+    if (n == 0) return;
+    
+    if (outbuf_has_sink(ob)) {
+        if (n >= OUTBUF_FLUSH_THRESHOLD) {
+            outbuf_drain(ob, data, n);
+            return;
+        }
+        if (ob->len + n > OUTBUF_FLUSH_THRESHOLD) {
+            outbuf_drain(ob, NULL, 0);
+        }
+    }
+    
+    if (!outbuf_reserve(ob, n)) return;
+    memcpy(ob->data + ob->len, data, n);
+    ob->len += n;
+    ob->data[ob->len] = '\0';
+}
+
+void outbuf_puts(OutputBuffer* ob, const char* s) {
+    outbuf_write(ob, s, strlen(s));
+}
+
+void outbuf_printf(OutputBuffer* ob, const char* fmt, ...) {
+    va_list args;
+    
+    // Format straight into the spare capacity; only retry after growing
+    size_t avail = ob->cap > ob->len ? ob->cap - ob->len : 0;
+    va_start(args, fmt);
+    int n = vsnprintf(avail ? ob->data + ob->len : NULL, avail, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        ob->failed = true;
+        return;
+    }
+    
+    if ((size_t)n >= avail) {
+        if (outbuf_has_sink(ob) && ob->len + (size_t)n > OUTBUF_FLUSH_THRESHOLD) {
+            outbuf_drain(ob, NULL, 0);
+        }
+        if (!outbuf_reserve(ob, (size_t)n)) return;
+        va_start(args, fmt);
+        vsnprintf(ob->data + ob->len, ob->cap - ob->len, fmt, args);
+        va_end(args);
+    }
+    ob->len += (size_t)n;
+    
+    if (outbuf_has_sink(ob) && ob->len > OUTBUF_FLUSH_THRESHOLD) {
+        outbuf_drain(ob, NULL, 0);
+    }
+}
+
+bool outbuf_flush(OutputBuffer* ob) {
+    if (!outbuf_has_sink(ob)) return !ob->failed;
+    bool ok = outbuf_drain(ob, NULL, 0);
+    if (ob->file && fflush(ob->file) != 0) {
+        ob->failed = true;
+        ok = false;
+    }
+    return ok && !ob->failed;
+}
+
+const char* outbuf_cstr(OutputBuffer* ob) {
+    if (!outbuf_reserve(ob, 0)) return "";
+    ob->data[ob->len] = '\0';
+    return ob->data;
+}
@@ -0,0 +1,417 @@
+#define _DEFAULT_SOURCE
+#include "codegen.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Register numbers as used in ModRM/SIB encodings
+enum {
+    REG_RAX = 0,
+    REG_RCX = 1,
+    REG_RDX = 2,
+    REG_RBX = 3,
+    REG_RSP = 4,
+    REG_RBP = 5,
+    REG_RSI = 6,
+    REG_RDI = 7,
+    REG_RIP = -1    // RIP-relative reference into the data section
+};
+
+#define REX_W 0x48
+
+// First integer argument register of the host calling convention
+#ifdef _WIN32
+#define REG_ARG0 REG_RCX
+#else
+#define REG_ARG0 REG_RDI
+#endif
+
+// Memory operand of the form [base + disp]. For REG_RIP the displacement
+// is an offset into the data section and is emitted as a relocation.
+typedef struct {
+    int base;
+    int32_t disp;
+} X86Mem;
+
+// Where operands live: a stack frame plus the caller's variable array
+// (JIT), or fixed slots in the object file's data section
+typedef struct {
+    bool in_data_section;
+    int var_count;
+} X86Layout;
+
+void x86_code_init(X86Code* code) {
+    code->bytes = NULL;
+    code->len = 0;
+    code->cap = 0;
+    code->relocs = NULL;
+    code->reloc_count = 0;
+    code->reloc_cap = 0;
+    code->failed = false;
+}
+
+void x86_code_free(X86Code* code) {
+    free(code->bytes);
+    free(code->relocs);
+    x86_code_init(code);
+}
+
+static void add_data_reloc(X86Code* code, int64_t addend) {
+    if (code->reloc_count == code->reloc_cap) {
+        int new_cap = code->reloc_cap ? code->reloc_cap * 2 : 16;
+        X86Reloc* relocs = realloc(code->relocs, (size_t)new_cap * sizeof(X86Reloc));
+        if (relocs == NULL) {
+            code->failed = true;
+            return;
+        }
+        code->relocs = relocs;
+        code->reloc_cap = new_cap;
+    }
+    code->relocs[code->reloc_count].offset = code->len;
+    code->relocs[code->reloc_count].addend = addend;
+    code->reloc_count++;
+}
+
+static void put_byte(X86Code* code, unsigned char byte) {
+    if (code->len == code->cap) {
+        size_t new_cap = code->cap ? code->cap * 2 : 256;
+        unsigned char* bytes = realloc(code->bytes, new_cap);
+        if (bytes == NULL) {
+            code->failed = true;
+            return;
+        }
+        code->bytes = bytes;
+        code->cap = new_cap;
+    }
+    code->bytes[code->len++] = byte;
+}
+
+static void put_imm32(X86Code* code, int32_t value) {
+    uint32_t v = (uint32_t)value;
+    for (int i = 0; i < 4; i++) put_byte(code, (unsigned char)(v >> (8 * i)));
+}
+
+static void put_imm64(X86Code* code, int64_t value) {
+    uint64_t v = (uint64_t)value;
+    for (int i = 0; i < 8; i++) put_byte(code, (unsigned char)(v >> (8 * i)));
+}
+
+static inline bool fits_int32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// ModRM (+SIB, +displacement) for a register/memory operand pair
+static void put_modrm_mem(X86Code* code, int reg, X86Mem mem) {
+    if (mem.base == REG_RIP) {
+        // mod=00 rm=101: [rip + disp32]. The disp32 field is the last thing
+        // in every instruction that uses this form, so the PC-relative
+        // addend is the data offset minus the field size.
+        put_byte(code, (unsigned char)(((reg & 7) << 3) | 5));
+        add_data_reloc(code, (int64_t)mem.disp - 4);
+        put_imm32(code, 0);
+        return;
+    }
+    
+    bool disp8 = mem.disp >= -128 && mem.disp <= 127;
+    int mod = (mem.disp == 0 && mem.base != REG_RBP) ? 0 : (disp8 ? 1 : 2);
+    
+    put_byte(code, (unsigned char)((mod << 6) | ((reg & 7) << 3) | (mem.base & 7)));
+    if (mem.base == REG_RSP) put_byte(code, 0x24);  // SIB: base = rsp, no index
+    
+    if (mod == 1) put_byte(code, (unsigned char)(int8_t)mem.disp);
+    else if (mod == 2) put_imm32(code, mem.disp);
+}
+
+static void put_modrm_reg(X86Code* code, int reg, int rm) {
+    put_byte(code, (unsigned char)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// mov reg, [mem]
+static void emit_load(X86Code* code, int reg, X86Mem mem) {
+    put_byte(code, REX_W);
+    put_byte(code, 0x8B);
+    put_modrm_mem(code, reg, mem);
+}
+
+// mov [mem], reg
+static void emit_store(X86Code* code, X86Mem mem, int reg) {
+    put_byte(code, REX_W);
+    put_byte(code, 0x89);
+    put_modrm_mem(code, reg, mem);
+}
+
+// mov reg, imm (sign-extended imm32 when it fits, movabs otherwise)
+static void emit_load_imm(X86Code* code, int reg, int64_t value) {
+    put_byte(code, REX_W);
+    if (fits_int32(value)) {
+        put_byte(code, 0xC7);
+        put_modrm_reg(code, 0, reg);
+        put_imm32(code, (int32_t)value);
+    } else {
+        put_byte(code, (unsigned char)(0xB8 + reg));
+        put_imm64(code, value);
+    }
+}
+
+// add/sub/imul reg, [mem] and reg, reg
+static void emit_alu_mem(X86Code* code, char op, int reg, X86Mem mem) {
+    put_byte(code, REX_W);
+    if (op == '+') put_byte(code, 0x03);
+    else if (op == '-') put_byte(code, 0x2B);
+    else { put_byte(code, 0x0F); put_byte(code, 0xAF); }
+    put_modrm_mem(code, reg, mem);
+}
+
+static void emit_alu_reg(X86Code* code, char op, int reg, int src) {
+    put_byte(code, REX_W);
+    if (op == '+') put_byte(code, 0x03);
+    else if (op == '-') put_byte(code, 0x2B);
+    else { put_byte(code, 0x0F); put_byte(code, 0xAF); }
+    put_modrm_reg(code, reg, src);
+}
+
+// lea reg, [reg + disp]
+static void emit_lea(X86Code* code, int reg, X86Mem mem) {
+    put_byte(code, REX_W);
+    put_byte(code, 0x8D);
+    put_modrm_mem(code, reg, mem);
+}
+
+// imul reg, reg, imm32
+static void emit_imul_imm(X86Code* code, int reg, int32_t value) {
+    put_byte(code, REX_W);
+    put_byte(code, 0x69);
+    put_modrm_reg(code, reg, reg);
+    put_imm32(code, value);
+}
+
+// shl reg, imm8
+static void emit_shl(X86Code* code, int reg, int count) {
+    put_byte(code, REX_W);
+    put_byte(code, 0xC1);
+    put_modrm_reg(code, 4, reg);
+    put_byte(code, (unsigned char)count);
+}
+
+// cqo; idiv [mem] / idiv reg
+static void emit_idiv_mem(X86Code* code, X86Mem mem) {
+    put_byte(code, REX_W);
+    put_byte(code, 0x99);
+    put_byte(code, REX_W);
+    put_byte(code, 0xF7);
+    put_modrm_mem(code, 7, mem);
+}
+
+static void emit_idiv_reg(X86Code* code, int reg) {
+    put_byte(code, REX_W);
+    put_byte(code, 0x99);
+    put_byte(code, REX_W);
+    put_byte(code, 0xF7);
+    put_modrm_reg(code, 7, reg);
+}
+
+// add/sub rsp, imm32
+static void emit_adjust_rsp(X86Code* code, int32_t delta) {
+    put_byte(code, REX_W);
+    put_byte(code, 0x81);
+    put_modrm_reg(code, delta < 0 ? 5 : 0, REG_RSP);
+    put_imm32(code, delta < 0 ? -delta : delta);
+}
+
+static int power_of_two_shift(int64_t value) {
+    if (value <= 1 || (value & (value - 1)) != 0) return -1;
+    int shift = 0;
+    while ((value >> shift) != 1) shift++;
+    return shift;
+}
+
+static X86Mem operand_mem(const X86Layout* layout, const Operand* operand) {
+    X86Mem mem;
+    int64_t slot = operand->value;
+    if (layout->in_data_section) {
+        // Variables first, then temporaries
+        mem.base = REG_RIP;
+        if (operand->kind == OPERAND_TEMP) slot += layout->var_count;
+    } else {
+        mem.base = (operand->kind == OPERAND_VAR) ? REG_ARG0 : REG_RSP;
+    }
+    mem.disp = (int32_t)(slot * 8);
+    return mem;
+}
+
+static bool same_slot(const Operand* a, const Operand* b) {
+    return a->kind == b->kind && a->kind != OPERAND_CONST && a->value == b->value;
+}
+
+static void emit_operand_load(X86Code* code, const X86Layout* layout, int reg, const Operand* operand) {
+    if (operand->kind == OPERAND_CONST) emit_load_imm(code, reg, operand->value);
+    else emit_load(code, reg, operand_mem(layout, operand));
+}
+
+// Apply `rax = rax op arg2`, using lea/shl/imul-imm forms for small literals
+static void emit_binary(X86Code* code, const X86Layout* layout, char op, const Operand* arg2) {
+    if (arg2->kind != OPERAND_CONST) {
+        if (op == '/') emit_idiv_mem(code, operand_mem(layout, arg2));
+        else emit_alu_mem(code, op, REG_RAX, operand_mem(layout, arg2));
+        return;
+    }
+    
+    int64_t value = arg2->value;
+    if ((op == '+' || op == '-') && fits_int32(value) && value != INT32_MIN) {
+        X86Mem mem = { REG_RAX, (int32_t)(op == '+' ? value : -value) };
+        emit_lea(code, REG_RAX, mem);
+    } else if (op == '*' && power_of_two_shift(value) > 0) {
+        emit_shl(code, REG_RAX, power_of_two_shift(value));
+    } else if (op == '*' && fits_int32(value)) {
+        emit_imul_imm(code, REG_RAX, (int32_t)value);
+    } else {
+        emit_load_imm(code, REG_RCX, value);
+        if (op == '/') emit_idiv_reg(code, REG_RCX);
+        else emit_alu_reg(code, op, REG_RAX, REG_RCX);
+    }
+}
+
+static void encode_body(const TACProgram* prog, X86Code* code, const X86Layout* layout) {
+    const Operand* in_rax = NULL;
+    for (int i = 0; i < prog->count; i++) {
+        const ResolvedTAC* instr = &prog->code[i];
+        
+        if (in_rax == NULL || !same_slot(in_rax, &instr->arg1)) {
+            emit_operand_load(code, layout, REG_RAX, &instr->arg1);
+        }
+        if (instr->op != '=') emit_binary(code, layout, instr->op, &instr->arg2);
+        
+        emit_store(code, operand_mem(layout, &instr->result), REG_RAX);
+        in_rax = &instr->result;
+    }
+    
+    if (prog->count == 0) emit_load_imm(code, REG_RAX, 0);
+}
+
+// Encode the program as a function `int64_t f(int64_t* vars)` following the
+// host calling convention. Division has idiv semantics, so a zero divisor
+// traps exactly as the generated assembly would.
+bool encode_tac_x86(const TACProgram* prog, X86Code* code) {
+    X86Layout layout = { false, prog->var_count };
+    int32_t frame = prog->temp_count * 8;
+    
+    if (frame > 0) emit_adjust_rsp(code, -frame);
+    encode_body(prog, code, &layout);
+    if (frame > 0) emit_adjust_rsp(code, frame);
+    put_byte(code, 0xC3);  // ret
+    
+    return !code->failed;
+}
+
+// Encode the program for a relocatable object: `int64_t expr_eval(void)`
+// at offset 0 reading and writing data-section slots (variables, then
+// temporaries), optionally followed by a `_start` that calls it and exits
+// with status 0 like the NASM output. *start_offset receives its offset.
+bool encode_tac_x86_object(const TACProgram* prog, X86Code* code, bool with_start, size_t* start_offset) {
+    X86Layout layout = { true, prog->var_count };
+    
+    encode_body(prog, code, &layout);
+    put_byte(code, 0xC3);  // ret
+    
+    if (with_start) {
+        *start_offset = code->len;
+        put_byte(code, 0xE8);  // call expr_eval
+        put_imm32(code, -(int32_t)(code->len + 4));
+        emit_load_imm(code, REG_RAX, 60);  // sys_exit
+        emit_load_imm(code, REG_RDI, 0);
+        put_byte(code, 0x0F);  // syscall
+        put_byte(code, 0x05);
+    }
+    
+    return !code->failed;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+bool jit_compile(const TACProgram* prog, JitCode* jit) {
+    jit->memory = NULL;
+    jit->size = 0;
+    jit->function = NULL;
+    
+    X86Code code;
+    x86_code_init(&code);
+    if (!encode_tac_x86(prog, &code)) {
+        x86_code_free(&code);
+        return false;
+    }
+
+#ifdef _WIN32
+    void* memory = VirtualAlloc(NULL, code.len, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (memory == NULL) {
+        x86_code_free(&code);
+        return false;
+    }
+    memcpy(memory, code.bytes, code.len);
+    
+    DWORD old_protect;
+    if (!VirtualProtect(memory, code.len, PAGE_EXECUTE_READ, &old_protect)) {
+        VirtualFree(memory, 0, MEM_RELEASE);
+        x86_code_free(&code);
+        return false;
+    }
+    FlushInstructionCache(GetCurrentProcess(), memory, code.len);
+    size_t size = code.len;
+#else
+    // Map writable, copy, then flip to read+execute so the page is never
+    // writable and executable at the same time
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = (code.len + (size_t)page - 1) & ~((size_t)page - 1);
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        x86_code_free(&code);
+        return false;
+    }
+    memcpy(memory, code.bytes, code.len);
+    
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        x86_code_free(&code);
+        return false;
+    }
+#endif
+
+    x86_code_free(&code);
+    jit->memory = memory;
+    jit->size = size;
+    jit->function = (JitFunction)memory;
+    return true;
+}
+
+void jit_release(JitCode* jit) {
+    if (jit->memory) {
+#ifdef _WIN32
+        VirtualFree(jit->memory, 0, MEM_RELEASE);
+#else
+        munmap(jit->memory, jit->size);
+#endif
+    }
+    jit->memory = NULL;
+    jit->size = 0;
+    jit->function = NULL;
+}
+
+#else
+
+bool jit_compile(const TACProgram* prog, JitCode* jit) {
+    (void)prog;
+    jit->memory = NULL;
+    jit->size = 0;
+    jit->function = NULL;
+    return false;  // Host is not x86-64
+}
+
+void jit_release(JitCode* jit) {
+    jit->memory = NULL;
+    jit->size = 0;
+    jit->function = NULL;
+}
+
+#endif